@@ -0,0 +1,124 @@
+/**
+ * @file concurrent_bench.cpp
+ * @author MeerkatBoss
+ * @brief Lock-free stack scalability benchmark
+ * @version 0.1
+ * @date 2022-10-06
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include <stdio.h>
+#include <pthread.h>
+
+#include "concurrent_stack.h"
+
+typedef StackProtection<STK_CANARY_PROT | STK_HASH_PROT> bench_policy;
+
+/**
+ * @brief
+ * Total number of push/pop pairs for each thread count
+ */
+static const size_t TOTAL_PAIRS = (size_t)1 << 21;
+
+static const size_t THREAD_COUNTS[] = { 1, 2, 4, 8, 16, 32, 64 };
+
+static const size_t MAX_THREADS = 64;
+
+struct locked_stack
+{
+    pthread_mutex_t                         lock;
+    TypedStack<void*, bench_policy>         stack;
+};
+
+struct bench_args
+{
+    ConcurrentStack<void*, bench_policy>*   concurrent;
+    locked_stack*                           locked;
+    size_t                                  pairs;
+};
+
+static void* RunConcurrent(void* raw_args)
+{
+    bench_args* args = (bench_args*)raw_args;
+    for (size_t i = 0; i < args->pairs; i++)
+    {
+        ConcurrentStackPush(args->concurrent, args);
+        ConcurrentStackPop(args->concurrent);
+    }
+    return NULL;
+}
+
+static void* RunLocked(void* raw_args)
+{
+    bench_args* args = (bench_args*)raw_args;
+    for (size_t i = 0; i < args->pairs; i++)
+    {
+        pthread_mutex_lock(&args->locked->lock);
+        StackPush(&args->locked->stack, args);
+        pthread_mutex_unlock(&args->locked->lock);
+
+        pthread_mutex_lock(&args->locked->lock);
+        StackPop(&args->locked->stack);
+        pthread_mutex_unlock(&args->locked->lock);
+    }
+    return NULL;
+}
+
+/**
+ * @brief
+ * Run benchmark in several threads
+ * @return Throughput in millions of operations per second
+ */
+static double Measure(void* (*run)(void*), bench_args* args, size_t thread_count)
+{
+    pthread_t threads[MAX_THREADS] = {};
+
+    args->pairs = TOTAL_PAIRS / thread_count;
+
+    unsigned long long start = GetTimeNs();
+    for (size_t i = 0; i < thread_count; i++)
+        pthread_create(&threads[i], NULL, run, args);
+    for (size_t i = 0; i < thread_count; i++)
+        pthread_join(threads[i], NULL);
+    unsigned long long elapsed = GetTimeNs() - start;
+
+    return (double)(2 * args->pairs * thread_count) * 1e3 / (double)elapsed;
+}
+
+int main()
+{
+    static ConcurrentStack<void*, bench_policy> concurrent = {};
+    static locked_stack locked = {};
+
+    ConcurrentStackCtor(&concurrent);
+    StackCtor(&locked.stack);
+    pthread_mutex_init(&locked.lock, NULL);
+
+    /* Keep some elements, so that stacks are not drained */
+    for (size_t i = 0; i < MAX_THREADS; i++)
+    {
+        ConcurrentStackPush(&concurrent, &concurrent);
+        StackPush(&locked.stack, &locked);
+    }
+
+    bench_args args = {
+        .concurrent = &concurrent,
+        .locked     = &locked,
+        .pairs      = 0
+    };
+
+    printf("%8s %16s %16s\n", "threads", "lock-free Mop/s", "mutex Mop/s");
+    for (size_t i = 0; i < sizeof(THREAD_COUNTS) / sizeof(*THREAD_COUNTS); i++)
+    {
+        double lock_free = Measure(RunConcurrent, &args, THREAD_COUNTS[i]);
+        double mutex     = Measure(RunLocked,     &args, THREAD_COUNTS[i]);
+        printf("%8zu %16.2f %16.2f\n", THREAD_COUNTS[i], lock_free, mutex);
+    }
+
+    StackDtor(&locked.stack);
+    ConcurrentStackDtor(&concurrent);
+    pthread_mutex_destroy(&locked.lock);
+    return 0;
+}
@@ -0,0 +1,88 @@
+/**
+ * @file hash_bench.cpp
+ * @author MeerkatBoss
+ * @brief Hash backends throughput benchmark
+ * @version 0.1
+ * @date 2022-10-05
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef __x86_64__
+#include <x86intrin.h>
+#endif
+
+#include "utils.h"
+
+/**
+ * @brief
+ * Total number of bytes hashed for each input size
+ */
+static const size_t BYTES_PER_RUN = (size_t)1 << 28;
+
+static const size_t INPUT_SIZES[] = { 8, 64, 256, 4096, 65536 };
+
+/**
+ * @brief
+ * Get current timestamp counter value, or
+ * time in nanoseconds where there is none
+ */
+static unsigned long long GetTicks(void)
+{
+#ifdef __x86_64__
+    return __rdtsc();
+#else
+    return GetTimeNs();
+#endif
+}
+
+int main()
+{
+    const size_t max_size = INPUT_SIZES[sizeof(INPUT_SIZES) / sizeof(*INPUT_SIZES) - 1];
+    unsigned char* buffer = (unsigned char*)calloc(max_size, 1);
+    if (!buffer)
+        return 1;
+
+    for (size_t i = 0; i < max_size; i++)
+        buffer[i] = (unsigned char)(i * 131 + 7);
+
+    size_t backend_count = 0;
+    const hash_backend* backends = GetHashBackends(&backend_count);
+
+#ifdef __x86_64__
+    printf("%-10s %8s %12s\n", "backend", "size", "bytes/cycle");
+#else
+    printf("%-10s %8s %12s\n", "backend", "size", "bytes/ns");
+#endif
+
+    for (size_t i = 0; i < backend_count; i++)
+    {
+        if (SetHashBackend(backends[i].name) != 0)
+        {
+            printf("%-10s not supported\n", backends[i].name);
+            continue;
+        }
+
+        for (size_t j = 0; j < sizeof(INPUT_SIZES) / sizeof(*INPUT_SIZES); j++)
+        {
+            size_t size       = INPUT_SIZES[j];
+            size_t iterations = BYTES_PER_RUN / size;
+
+            volatile hash_t sink = 0;
+            unsigned long long start = GetTicks();
+            for (size_t k = 0; k < iterations; k++)
+                sink = sink + backends[i].hash(buffer, size);
+            unsigned long long ticks = GetTicks() - start;
+
+            printf("%-10s %8zu %12.3f\n", backends[i].name, size,
+                        (double)(iterations * size) / (double)(ticks ? ticks : 1));
+        }
+    }
+
+    free(buffer);
+    return 0;
+}
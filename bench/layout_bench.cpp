@@ -0,0 +1,143 @@
+/**
+ * @file layout_bench.cpp
+ * @author MeerkatBoss
+ * @brief Stack layout benchmark for large arrays of stacks
+ * @version 0.1
+ * @date 2022-10-10
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * @note Pushes to and pops from randomly chosen stacks of array,
+ * which does not fit cache. Cache misses are counted with
+ * `perf_event_open` where it is permitted
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "stack.h"
+
+/* Data is checked only upon request, so that headers dominate */
+typedef StackProtection<STK_DEFAULT_PROT | STK_SAMPLED_CHECK> bench_policy;
+
+/**
+ * @brief
+ * Number of stacks in array
+ */
+static const size_t STACK_COUNT = (size_t)1 << 17;
+
+/**
+ * @brief
+ * Number of push/pop pairs for each layout
+ */
+static const size_t TOTAL_PAIRS = (size_t)1 << 22;
+
+/**
+ * @brief
+ * Elements stored in each stack during benchmark
+ */
+static const size_t INITIAL_SIZE = 4;
+
+/**
+ * @brief
+ * Open cache miss counter of calling thread
+ * @return counter descriptor, -1 if counting is not permitted
+ */
+static int OpenMissCounter(void)
+{
+    perf_event_attr attr = {};
+    attr.type           = PERF_TYPE_HARDWARE;
+    attr.size           = sizeof(attr);
+    attr.config         = PERF_COUNT_HW_CACHE_MISSES;
+    attr.disabled       = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv     = 1;
+
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static unsigned long long ReadCounter(int counter)
+{
+    unsigned long long value = 0;
+    if (counter < 0 || read(counter, &value, sizeof(value)) != (ssize_t)sizeof(value))
+        return 0;
+    return value;
+}
+
+template <typename Policy>
+static void RunLayout(const char* name, int counter)
+{
+    typedef TypedStack<void*, Policy> stack_type;
+
+    stack_type* stacks = (stack_type*)aligned_alloc(alignof(stack_type),
+                                                    STACK_COUNT*sizeof(stack_type));
+    if (!stacks)
+    {
+        printf("%-8s not enough memory\n", name);
+        return;
+    }
+
+    for (size_t i = 0; i < STACK_COUNT; i++)
+    {
+        StackCtor(&stacks[i]);
+        StackSetCheckPeriod(&stacks[i], 0);
+        for (size_t j = 0; j < INITIAL_SIZE; j++)
+            StackPush(&stacks[i], &stacks[i]);
+    }
+
+    unsigned long long state = 0x9E3779B97F4A7C15ULL;
+
+    if (counter >= 0)
+    {
+        ioctl(counter, PERF_EVENT_IOC_RESET,  0);
+        ioctl(counter, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    unsigned long long start = GetTimeNs();
+
+    for (size_t i = 0; i < TOTAL_PAIRS; i++)
+    {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+
+        stack_type* stack = &stacks[state % STACK_COUNT];
+        StackPush(stack, stack);
+        StackPop (stack);
+    }
+
+    unsigned long long elapsed = GetTimeNs() - start;
+    if (counter >= 0)
+        ioctl(counter, PERF_EVENT_IOC_DISABLE, 0);
+    unsigned long long misses = ReadCounter(counter);
+
+    printf("%-8s %8zu %12.1f", name, sizeof(stack_type),
+                               (double)elapsed / (double)(2*TOTAL_PAIRS));
+    if (counter >= 0)
+        printf(" %14.2f\n", (double)misses / (double)(2*TOTAL_PAIRS));
+    else
+        printf(" %14s\n", "n/a");
+
+    for (size_t i = 0; i < STACK_COUNT; i++)
+        StackDtor(&stacks[i]);
+    free(stacks);
+}
+
+int main()
+{
+    int counter = OpenMissCounter();
+
+    printf("%-8s %8s %12s %14s\n", "layout", "bytes", "ns/op", "misses/op");
+
+    RunLayout<bench_policy>                 ("default", counter);
+    RunLayout<WithSplitLayout<bench_policy>>("split",   counter);
+
+    if (counter >= 0)
+        close(counter);
+
+    return 0;
+}
@@ -0,0 +1,281 @@
+/**
+ * @file queue_bench.cpp
+ * @author MeerkatBoss
+ * @brief `SafeStack` command queue benchmark
+ * @version 0.1
+ * @date 2022-10-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * @note Compares operations queued with `SafeStackEnqueue` and
+ * executed by `SafeStackDrain` with direct calls. Before measuring,
+ * checks that queued operations give the same results as direct
+ * ones and that batch, which cannot be applied, has no effect
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "safe_stack.h"
+#include "stack.h"
+#include "allocator.h"
+#include "utils.h"
+
+/**
+ * @brief
+ * Number of random operations compared with direct calls
+ */
+static const size_t CHECKED_OPS = (size_t)1 << 16;
+
+/**
+ * @brief
+ * Number of operations for each measurement
+ */
+static const size_t TOTAL_OPS = (size_t)1 << 20;
+
+/**
+ * @brief
+ * Number of elements in stack before failed batch
+ */
+static const size_t FAILED_BASE = 8;
+
+/**
+ * @brief
+ * Allocations of more than this many bytes fail, zero if none do
+ */
+static size_t fail_above = 0;
+
+static void* FailingRealloc(void*, void* ptr, size_t, size_t new_size)
+{
+    if (fail_above && new_size > fail_above)
+        return NULL;
+    return realloc(ptr, new_size);
+}
+
+static void FailingRelease(void*, void* ptr, size_t)
+{
+    free(ptr);
+}
+
+static const buffer_allocator failing_allocator = {
+    .name       = "failing",
+    .reallocate = FailingRealloc,
+    .release    = FailingRelease,
+    .context    = NULL
+};
+
+static unsigned long long NextRandom(unsigned long long* state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+/**
+ * @brief
+ * Run same random operations directly and through queue
+ * @return Number of mismatched operations
+ */
+static size_t CheckResults(void)
+{
+    SafeStack* direct = SafeStackCtor();
+    SafeStack* queued = SafeStackCtor();
+    if (!direct || !queued || SafeStackAttachQueue(queued, SAFE_STACK_BATCH))
+    {
+        puts("Failed to construct stacks");
+        SafeStackDtor(direct);
+        SafeStackDtor(queued);
+        return 1;
+    }
+
+    unsigned long long state = 0x9E3779B97F4A7C15ULL;
+    size_t mismatches = 0;
+
+    safe_stack_completion completions[SAFE_STACK_BATCH] = {};
+    int          values  [SAFE_STACK_BATCH] = {};
+    int          expected[SAFE_STACK_BATCH] = {};
+    unsigned int errors  [SAFE_STACK_BATCH] = {};
+
+    for (size_t done = 0; done < CHECKED_OPS; done += SAFE_STACK_BATCH)
+    {
+        for (size_t i = 0; i < SAFE_STACK_BATCH; i++)
+        {
+            SafeStackCommand command = (SafeStackCommand)(NextRandom(&state) % 3);
+            values[i] = (int)(NextRandom(&state) % 1000) - 500;
+            completions[i] = {};
+
+            if (command == SAFE_STACK_CMD_PUSH)
+            {
+                SafeStackPush(direct, values[i], &errors[i]);
+                expected[i] = values[i];
+            }
+            else if (command == SAFE_STACK_CMD_POP)
+                expected[i] = SafeStackPop (direct, &errors[i]);
+            else
+                expected[i] = SafeStackPeek(direct, &errors[i]);
+
+            if (SafeStackEnqueue(queued, SAFE_STACK_INT32, command,
+                                 &values[i], &completions[i]))
+                mismatches++;
+        }
+
+        SafeStackDrain(queued, SAFE_STACK_BATCH);
+
+        for (size_t i = 0; i < SAFE_STACK_BATCH; i++)
+        {
+            if (!SafeStackIsCompleted(&completions[i]) ||
+                completions[i].err != errors[i] ||
+                (!errors[i] && values[i] != expected[i]))
+                mismatches++;
+        }
+    }
+
+    unsigned int direct_err = 0;
+    unsigned int queued_err = 0;
+    while (!direct_err)
+    {
+        int expected_top = SafeStackPop(direct, &direct_err);
+        int queued_top   = SafeStackPop(queued, &queued_err);
+        if (direct_err != queued_err || (!direct_err && expected_top != queued_top))
+        {
+            mismatches++;
+            break;
+        }
+    }
+
+    SafeStackDtor(direct);
+    SafeStackDtor(queued);
+    return mismatches;
+}
+
+/**
+ * @brief
+ * Drain batch, which pops some elements and then pushes
+ * more elements than stack may hold without reallocation,
+ * while reallocation fails
+ * @return Number of violated expectations
+ */
+static size_t CheckFailedBatch(void)
+{
+    SafeStack* stack = SafeStackCtor();
+    if (!stack || SafeStackAttachQueue(stack, SAFE_STACK_BATCH))
+    {
+        puts("Failed to construct stack");
+        SafeStackDtor(stack);
+        return 1;
+    }
+
+    for (size_t i = 0; i < FAILED_BASE; i++)
+        SafeStackPush(stack, (int)i, NULL);
+
+    safe_stack_completion completions[SAFE_STACK_BATCH] = {};
+    int values[SAFE_STACK_BATCH] = {};
+
+    for (size_t i = 0; i < SAFE_STACK_BATCH; i++)
+    {
+        values[i] = i < FAILED_BASE / 2 ? -1 : (int)i;
+        SafeStackEnqueue(stack, SAFE_STACK_INT32,
+                         i < FAILED_BASE / 2 ? SAFE_STACK_CMD_POP : SAFE_STACK_CMD_PUSH,
+                         &values[i], &completions[i]);
+    }
+
+    fail_above = 1;
+    SafeStackDrain(stack, SAFE_STACK_BATCH);
+    fail_above = 0;
+
+    size_t violations = 0;
+    for (size_t i = 0; i < SAFE_STACK_BATCH; i++)
+    {
+        if (!SafeStackIsCompleted(&completions[i]) ||
+            !(completions[i].err & STK_NO_MEMORY))
+            violations++;
+        if (i < FAILED_BASE / 2 && values[i] != -1)
+            violations++;
+    }
+
+    unsigned int err = 0;
+    for (size_t i = FAILED_BASE; i > 0; i--)
+        if (SafeStackPop(stack, &err) != (int)i - 1 || err)
+            violations++;
+    SafeStackPop(stack, &err);
+    if (err != STK_EMPTY)
+        violations++;
+
+    SafeStackDtor(stack);
+    return violations;
+}
+
+/**
+ * @brief
+ * Measure push/peek/pop rounds, either direct or queued
+ * @return Time per operation in nanoseconds
+ */
+static double Measure(int use_queue)
+{
+    SafeStack* stack = SafeStackCtor();
+    if (!stack || SafeStackAttachQueue(stack, SAFE_STACK_BATCH))
+    {
+        SafeStackDtor(stack);
+        return 0;
+    }
+
+    static const SafeStackCommand ROUND[] = {
+        SAFE_STACK_CMD_PUSH, SAFE_STACK_CMD_PEEK, SAFE_STACK_CMD_PUSH,
+        SAFE_STACK_CMD_POP,  SAFE_STACK_CMD_PEEK, SAFE_STACK_CMD_POP
+    };
+    static const size_t ROUND_SIZE = sizeof(ROUND) / sizeof(*ROUND);
+
+    safe_stack_completion completions[SAFE_STACK_BATCH] = {};
+    int values[SAFE_STACK_BATCH] = {};
+    size_t batch = SAFE_STACK_BATCH / ROUND_SIZE * ROUND_SIZE;
+
+    unsigned long long start = GetTimeNs();
+    for (size_t done = 0; done < TOTAL_OPS; done += batch)
+    {
+        for (size_t i = 0; i < batch; i++)
+        {
+            values[i] = (int)i;
+            if (!use_queue)
+            {
+                switch (ROUND[i % ROUND_SIZE])
+                {
+                    case SAFE_STACK_CMD_PUSH: SafeStackPush(stack, values[i], NULL); break;
+                    case SAFE_STACK_CMD_POP:  SafeStackPop (stack, NULL);            break;
+                    case SAFE_STACK_CMD_PEEK: SafeStackPeek(stack, NULL);            break;
+                    default: break;
+                }
+            }
+            else
+                SafeStackEnqueue(stack, SAFE_STACK_INT32, ROUND[i % ROUND_SIZE],
+                                 &values[i], &completions[i]);
+        }
+        if (use_queue)
+            SafeStackDrain(stack, batch);
+    }
+    unsigned long long elapsed = GetTimeNs() - start;
+
+    SafeStackDtor(stack);
+    return (double)elapsed / (double)(TOTAL_OPS / batch * batch);
+}
+
+int main()
+{
+    /* Must be set before any buffer is allocated */
+    SetBufferAllocator(&failing_allocator);
+
+    size_t mismatches = CheckResults();
+    size_t violations = CheckFailedBatch();
+
+    printf("queued results: %zu mismatches\n",  mismatches);
+    printf("failed batch:   %zu violations\n", violations);
+    if (mismatches || violations)
+        return 1;
+
+    printf("%-8s %8s\n", "mode", "ns/op");
+    printf("%-8s %8.1f\n", "direct", Measure(0));
+    printf("%-8s %8.1f\n", "queued", Measure(1));
+
+    return 0;
+}
@@ -0,0 +1,156 @@
+/**
+ * @file safe_stack_bench.cpp
+ * @author MeerkatBoss
+ * @brief Concurrent `SafeStack` contention benchmark
+ * @version 0.1
+ * @date 2022-10-13
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * @note Compares stack constructed with `SAFE_STACK_CONCURRENT`
+ * with plain stack wrapped in external mutex. Every thread
+ * pushes, peeks several times and pops
+ *
+ */
+
+#include <stdio.h>
+#include <pthread.h>
+
+#include "safe_stack.h"
+#include "utils.h"
+
+/**
+ * @brief
+ * Total number of push/peek/pop rounds for each thread count
+ */
+static const size_t TOTAL_ROUNDS = (size_t)1 << 18;
+
+/**
+ * @brief
+ * Number of peeks in each round
+ */
+static const size_t PEEKS_PER_ROUND = 4;
+
+static const size_t THREAD_COUNTS[] = { 1, 2, 4, 8, 16 };
+
+static const size_t MAX_THREADS = 16;
+
+struct bench_args
+{
+    SafeStack*      concurrent;
+    SafeStack*      plain;
+    pthread_mutex_t lock;
+    size_t          rounds;
+};
+
+static void* RunConcurrent(void* raw_args)
+{
+    bench_args* args = (bench_args*)raw_args;
+    for (size_t i = 0; i < args->rounds; i++)
+    {
+        SafeStackPush(args->concurrent, (int)i, NULL);
+        for (size_t j = 0; j < PEEKS_PER_ROUND; j++)
+            SafeStackPeek(args->concurrent, NULL);
+        SafeStackPop(args->concurrent, NULL);
+    }
+    return NULL;
+}
+
+static void* RunLocked(void* raw_args)
+{
+    bench_args* args = (bench_args*)raw_args;
+    for (size_t i = 0; i < args->rounds; i++)
+    {
+        pthread_mutex_lock(&args->lock);
+        SafeStackPush(args->plain, (int)i, NULL);
+        pthread_mutex_unlock(&args->lock);
+
+        for (size_t j = 0; j < PEEKS_PER_ROUND; j++)
+        {
+            pthread_mutex_lock(&args->lock);
+            SafeStackPeek(args->plain, NULL);
+            pthread_mutex_unlock(&args->lock);
+        }
+
+        pthread_mutex_lock(&args->lock);
+        SafeStackPop(args->plain, NULL);
+        pthread_mutex_unlock(&args->lock);
+    }
+    return NULL;
+}
+
+/**
+ * @brief
+ * Single-thread baseline without any locks
+ */
+static void* RunPlain(void* raw_args)
+{
+    bench_args* args = (bench_args*)raw_args;
+    for (size_t i = 0; i < args->rounds; i++)
+    {
+        SafeStackPush(args->plain, (int)i, NULL);
+        for (size_t j = 0; j < PEEKS_PER_ROUND; j++)
+            SafeStackPeek(args->plain, NULL);
+        SafeStackPop(args->plain, NULL);
+    }
+    return NULL;
+}
+
+/**
+ * @brief
+ * Run benchmark in several threads
+ * @return Throughput in millions of operations per second
+ */
+static double Measure(void* (*run)(void*), bench_args* args, size_t thread_count)
+{
+    pthread_t threads[MAX_THREADS] = {};
+
+    args->rounds = TOTAL_ROUNDS / thread_count;
+
+    unsigned long long start = GetTimeNs();
+    for (size_t i = 0; i < thread_count; i++)
+        pthread_create(&threads[i], NULL, run, args);
+    for (size_t i = 0; i < thread_count; i++)
+        pthread_join(threads[i], NULL);
+    unsigned long long elapsed = GetTimeNs() - start;
+
+    return (double)((PEEKS_PER_ROUND + 2) * args->rounds * thread_count) * 1e3
+                                                                / (double)elapsed;
+}
+
+int main()
+{
+    bench_args args = {
+        .concurrent = SafeStackCtorFlags(SAFE_STACK_INT32, SAFE_STACK_CONCURRENT),
+        .plain      = SafeStackCtor(),
+        .lock       = PTHREAD_MUTEX_INITIALIZER,
+        .rounds     = 0
+    };
+
+    if (!args.concurrent || !args.plain)
+    {
+        puts("Failed to construct stacks");
+        return 1;
+    }
+
+    /* Keep some elements, so that stacks are not drained */
+    for (size_t i = 0; i < MAX_THREADS; i++)
+    {
+        SafeStackPush(args.concurrent, (int)i, NULL);
+        SafeStackPush(args.plain,      (int)i, NULL);
+    }
+
+    printf("unlocked, 1 thread: %.2f Mop/s\n", Measure(RunPlain, &args, 1));
+
+    printf("%8s %17s %16s\n", "threads", "concurrent Mop/s", "mutex Mop/s");
+    for (size_t i = 0; i < sizeof(THREAD_COUNTS) / sizeof(*THREAD_COUNTS); i++)
+    {
+        double concurrent = Measure(RunConcurrent, &args, THREAD_COUNTS[i]);
+        double mutex      = Measure(RunLocked,     &args, THREAD_COUNTS[i]);
+        printf("%8zu %17.2f %16.2f\n", THREAD_COUNTS[i], concurrent, mutex);
+    }
+
+    SafeStackDtor(args.concurrent);
+    SafeStackDtor(args.plain);
+    return 0;
+}
@@ -0,0 +1,548 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "allocator.h"
+
+/**
+ * @brief
+ * Smallest pool block size is `1 << MIN_CLASS_SHIFT`
+ */
+static const size_t MIN_CLASS_SHIFT = 6;
+
+/**
+ * @brief
+ * Number of pool size classes. Each class holds blocks
+ * twice as big as the previous one
+ */
+static const size_t CLASS_COUNT = 15;
+
+/**
+ * @brief
+ * Memory carved into blocks at once
+ */
+static const size_t SLAB_SIZE = (size_t)1 << 16;
+
+/**
+ * @brief
+ * Number of bytes a thread may keep cached in one class
+ */
+static const size_t CACHE_CLASS_BYTES = (size_t)1 << 18;
+
+/**
+ * @brief
+ * Number of cached free blocks searched for block
+ * following the one being grown in place
+ */
+static const size_t BUDDY_SEARCH_DEPTH = 8;
+
+static_assert(POOL_MAX_BLOCK_SIZE == (size_t)1 << (MIN_CLASS_SHIFT + CLASS_COUNT - 1),
+              "Size classes must cover blocks up to POOL_MAX_BLOCK_SIZE");
+
+/**
+ * @brief
+ * Free pool block
+ */
+struct free_block_
+{
+    free_block_* next;
+};
+
+/**
+ * @brief
+ * Singly-linked list of free blocks of one class
+ */
+struct free_list_
+{
+    free_block_* head;
+    size_t       count;
+};
+
+/**
+ * @brief
+ * Free blocks shared between threads
+ */
+struct shared_class_
+{
+    pthread_mutex_t lock;
+    free_list_      blocks;
+};
+
+/**
+ * @brief
+ * Per-thread pool state
+ */
+struct thread_cache_
+{
+    free_list_      classes[CLASS_COUNT];
+    pool_stats      stats;
+    thread_cache_*  prev;   /* registered caches list */
+    thread_cache_*  next;
+
+    ~thread_cache_();
+};
+
+static shared_class_ shared_classes_[CLASS_COUNT] = {};
+
+static int InitSharedClasses_(void)
+{
+    for (size_t i = 0; i < CLASS_COUNT; i++)
+        pthread_mutex_init(&shared_classes_[i].lock, NULL);
+    return 1;
+}
+
+static int shared_classes_ready_ = InitSharedClasses_();
+
+static pthread_mutex_t  registry_lock_  = PTHREAD_MUTEX_INITIALIZER;
+static thread_cache_*   registry_       = NULL;
+static pool_stats       retired_stats_  = {};   /* stats of exited threads */
+
+/* 0 - not created, 1 - alive, 2 - destroyed */
+static thread_local int             local_cache_state_  = 0;
+static thread_local thread_cache_   local_cache_        = {};
+
+static inline size_t ClassSize_(size_t cls)
+{
+    return (size_t)1 << (cls + MIN_CLASS_SHIFT);
+}
+
+static inline size_t GetClass_(size_t size)
+{
+    size_t cls = 0;
+    while (ClassSize_(cls) < size)
+        cls++;
+    return cls;
+}
+
+static inline size_t CacheLimit_(size_t cls)
+{
+    size_t limit = CACHE_CLASS_BYTES / ClassSize_(cls);
+    return limit < 2 ? 2 : limit;
+}
+
+static inline void ListPush_(free_list_* list, void* ptr)
+{
+    free_block_* block = (free_block_*)ptr;
+    block->next = list->head;
+    list->head  = block;
+    list->count++;
+}
+
+static inline void* ListPop_(free_list_* list)
+{
+    free_block_* block = list->head;
+    if (!block)
+        return NULL;
+    list->head = block->next;
+    list->count--;
+    return block;
+}
+
+/**
+ * @brief
+ * Remove given block from list, if it is among first `depth` blocks
+ * @return 1 if block was removed, 0 otherwise
+ */
+static int ListRemove_(free_list_* list, void* ptr, size_t depth)
+{
+    free_block_** link = &list->head;
+    for (size_t i = 0; i < depth && *link; i++, link = &(*link)->next)
+    {
+        if (*link != ptr)
+            continue;
+        *link = (*link)->next;
+        list->count--;
+        return 1;
+    }
+    return 0;
+}
+
+/* Counters are written only by owning thread and read by `GetPoolStats` */
+#define POOL_STAT_INC(cache, field) \
+    __atomic_store_n(&(cache)->stats.field, (cache)->stats.field + 1, __ATOMIC_RELAXED)
+
+static thread_cache_* GetThreadCache_(void)
+{
+    if (local_cache_state_ == 1)
+        return &local_cache_;
+    if (local_cache_state_ == 2)
+        return NULL;
+
+    thread_cache_* cache = &local_cache_;
+
+    pthread_mutex_lock(&registry_lock_);
+    cache->next = registry_;
+    if (registry_)
+        registry_->prev = cache;
+    registry_ = cache;
+    pthread_mutex_unlock(&registry_lock_);
+
+    local_cache_state_ = 1;
+    return cache;
+}
+
+/**
+ * @brief
+ * Move up to `count` blocks from one list to another
+ */
+static void ListTransfer_(free_list_* from, free_list_* to, size_t count)
+{
+    for (size_t i = 0; i < count && from->head; i++)
+        ListPush_(to, ListPop_(from));
+}
+
+/**
+ * @brief
+ * Carve new slab into blocks of given class
+ * @return Pointer to one of blocks, the rest are added to `list`
+ */
+static void* AllocSlab_(size_t cls, free_list_* list)
+{
+    size_t block_size  = ClassSize_(cls);
+    size_t block_count = SLAB_SIZE / block_size;
+    if (block_count < 2)
+        block_count = 2;
+
+    char* slab = (char*)malloc(block_count * block_size);
+    if (!slab)
+        return NULL;
+
+    /* Blocks are handed out in address order, so that block
+     * following allocated one is likely free for in-place growth */
+    for (size_t i = block_count - 1; i > 0; i--)
+        ListPush_(list, slab + i*block_size);
+
+    return slab;
+}
+
+static void* PoolAlloc_(thread_cache_* cache, size_t cls)
+{
+    shared_class_* shared = &shared_classes_[cls];
+
+    if (!cache)
+    {
+        /* Thread is exiting, use shared lists directly */
+        pthread_mutex_lock(&shared->lock);
+        void* block = ListPop_(&shared->blocks);
+        if (!block)
+            block = AllocSlab_(cls, &shared->blocks);
+        pthread_mutex_unlock(&shared->lock);
+        return block;
+    }
+
+    free_list_* local = &cache->classes[cls];
+
+    void* block = ListPop_(local);
+    if (block)
+    {
+        POOL_STAT_INC(cache, hits);
+        return block;
+    }
+
+    pthread_mutex_lock(&shared->lock);
+    ListTransfer_(&shared->blocks, local, CacheLimit_(cls) / 2);
+    pthread_mutex_unlock(&shared->lock);
+
+    block = ListPop_(local);
+    if (block)
+    {
+        POOL_STAT_INC(cache, refills);
+        return block;
+    }
+
+    POOL_STAT_INC(cache, misses);
+    return AllocSlab_(cls, local);
+}
+
+static void PoolFree_(thread_cache_* cache, void* ptr, size_t cls)
+{
+    shared_class_* shared = &shared_classes_[cls];
+
+    if (!cache)
+    {
+        pthread_mutex_lock(&shared->lock);
+        ListPush_(&shared->blocks, ptr);
+        pthread_mutex_unlock(&shared->lock);
+        return;
+    }
+
+    free_list_* local = &cache->classes[cls];
+    ListPush_(local, ptr);
+    POOL_STAT_INC(cache, releases);
+
+    if (local->count <= CacheLimit_(cls))
+        return;
+
+    /* Give half of cached blocks to other threads */
+    pthread_mutex_lock(&shared->lock);
+    ListTransfer_(local, &shared->blocks, local->count / 2);
+    pthread_mutex_unlock(&shared->lock);
+}
+
+thread_cache_::~thread_cache_()
+{
+    for (size_t cls = 0; cls < CLASS_COUNT; cls++)
+    {
+        pthread_mutex_lock(&shared_classes_[cls].lock);
+        ListTransfer_(&classes[cls], &shared_classes_[cls].blocks, classes[cls].count);
+        pthread_mutex_unlock(&shared_classes_[cls].lock);
+    }
+
+    if (local_cache_state_ == 1)
+    {
+        pthread_mutex_lock(&registry_lock_);
+        if (prev) prev->next = next;
+        else      registry_  = next;
+        if (next) next->prev = prev;
+
+        retired_stats_.hits      += stats.hits;
+        retired_stats_.refills   += stats.refills;
+        retired_stats_.misses    += stats.misses;
+        retired_stats_.in_place  += stats.in_place;
+        retired_stats_.releases  += stats.releases;
+        retired_stats_.oversized += stats.oversized;
+        pthread_mutex_unlock(&registry_lock_);
+    }
+
+    local_cache_state_ = 2;
+}
+
+/**
+ * @brief
+ * Change class of pooled block without moving it. Shrinking block
+ * splits off its upper halves as free blocks of smaller classes.
+ * Growing block to the next class takes block, which immediately
+ * follows it, from free blocks cached by current thread
+ * @return 1 if block was resized, 0 if it must be moved
+ */
+static int PoolResizeInPlace_(thread_cache_* cache, void* ptr, size_t old_class,
+                                                               size_t new_class)
+{
+    if (new_class == old_class)
+        return 1;
+
+    char* block = (char*)ptr;
+
+    if (new_class < old_class)
+    {
+        for (size_t cls = old_class; cls-- > new_class;)
+            PoolFree_(cache, block + ClassSize_(cls), cls);
+        return 1;
+    }
+
+    return new_class == old_class + 1 && cache &&
+           ListRemove_(&cache->classes[old_class], block + ClassSize_(old_class),
+                       BUDDY_SEARCH_DEPTH);
+}
+
+static void* PoolReallocate_(void*, void* ptr, size_t old_size, size_t new_size)
+{
+    thread_cache_* cache = GetThreadCache_();
+
+    if (ptr == NULL)
+        old_size = 0;
+
+    int old_pooled = ptr != NULL && old_size <= POOL_MAX_BLOCK_SIZE;
+    int new_pooled = new_size <= POOL_MAX_BLOCK_SIZE;
+
+    if (!new_pooled && (ptr == NULL || !old_pooled))
+    {
+        if (cache) POOL_STAT_INC(cache, oversized);
+        return realloc(ptr, new_size);
+    }
+
+    size_t new_class = new_pooled ? GetClass_(new_size) : 0;
+
+    if (old_pooled && new_pooled && PoolResizeInPlace_(cache, ptr,
+                                                      GetClass_(old_size), new_class))
+    {
+        if (cache) POOL_STAT_INC(cache, in_place);
+        return ptr;
+    }
+
+    void* result = new_pooled ? PoolAlloc_(cache, new_class) : malloc(new_size);
+    if (!result)
+        return NULL;
+    if (!new_pooled && cache)
+        POOL_STAT_INC(cache, oversized);
+
+    if (ptr)
+    {
+        memcpy(result, ptr, old_size < new_size ? old_size : new_size);
+
+        if (old_pooled)
+            PoolFree_(cache, ptr, GetClass_(old_size));
+        else
+            free(ptr);
+    }
+
+    return result;
+}
+
+static void PoolRelease_(void*, void* ptr, size_t size)
+{
+    if (!ptr)
+        return;
+
+    if (size > POOL_MAX_BLOCK_SIZE)
+    {
+        free(ptr);
+        return;
+    }
+
+    PoolFree_(GetThreadCache_(), ptr, GetClass_(size));
+}
+
+static void* SystemReallocate_(void*, void* ptr, size_t, size_t new_size)
+{
+    return realloc(ptr, new_size);
+}
+
+static void SystemRelease_(void*, void* ptr, size_t)
+{
+    free(ptr);
+}
+
+static const buffer_allocator system_allocator_ = {
+    .name       = "system",
+    .reallocate = SystemReallocate_,
+    .release    = SystemRelease_,
+    .context    = NULL
+};
+
+static const buffer_allocator pool_allocator_ = {
+    .name       = "pool",
+    .reallocate = PoolReallocate_,
+    .release    = PoolRelease_,
+    .context    = NULL
+};
+
+static const buffer_allocator* current_allocator_ = &pool_allocator_;
+
+const buffer_allocator* GetSystemAllocator(void)
+{
+    return &system_allocator_;
+}
+
+const buffer_allocator* GetPoolAllocator(void)
+{
+    return &pool_allocator_;
+}
+
+void SetBufferAllocator(const buffer_allocator* allocator)
+{
+    __atomic_store_n(&current_allocator_,
+                     allocator ? allocator : &pool_allocator_,
+                     __ATOMIC_RELEASE);
+}
+
+const buffer_allocator* GetBufferAllocator(void)
+{
+    return __atomic_load_n(&current_allocator_, __ATOMIC_ACQUIRE);
+}
+
+void* BufferRealloc(void* ptr, size_t old_size, size_t new_size)
+{
+    const buffer_allocator* allocator = GetBufferAllocator();
+    return allocator->reallocate(allocator->context, ptr, old_size, new_size);
+}
+
+void BufferFree(void* ptr, size_t size)
+{
+    const buffer_allocator* allocator = GetBufferAllocator();
+    allocator->release(allocator->context, ptr, size);
+}
+
+void GetPoolStats(pool_stats* stats)
+{
+    pthread_mutex_lock(&registry_lock_);
+
+    *stats = retired_stats_;
+    for (thread_cache_* cache = registry_; cache; cache = cache->next)
+    {
+        stats->hits      += __atomic_load_n(&cache->stats.hits,      __ATOMIC_RELAXED);
+        stats->refills   += __atomic_load_n(&cache->stats.refills,   __ATOMIC_RELAXED);
+        stats->misses    += __atomic_load_n(&cache->stats.misses,    __ATOMIC_RELAXED);
+        stats->in_place  += __atomic_load_n(&cache->stats.in_place,  __ATOMIC_RELAXED);
+        stats->releases  += __atomic_load_n(&cache->stats.releases,  __ATOMIC_RELAXED);
+        stats->oversized += __atomic_load_n(&cache->stats.oversized, __ATOMIC_RELAXED);
+    }
+
+    pthread_mutex_unlock(&registry_lock_);
+}
+
+size_t GetPageSize(void)
+{
+    static const size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    return page_size;
+}
+
+static inline size_t RoundToPages_(size_t size)
+{
+    size_t page_size = GetPageSize();
+    return (size + page_size - 1) / page_size * page_size;
+}
+
+void* MapReserve(size_t size)
+{
+    size_t page_size = GetPageSize();
+    if (size == 0 || size % page_size != 0 || size > SIZE_MAX - 2*page_size)
+        return NULL;
+
+    /* Whole range including guard pages is inaccessible until committed */
+    void* mapped = mmap(NULL, size + 2*page_size, PROT_NONE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mapped == MAP_FAILED)
+        return NULL;
+
+    return (char*)mapped + page_size;
+}
+
+void* MapReserveFile(int fd, size_t size)
+{
+    char* range = (char*)MapReserve(size);
+    if (!range)
+        return NULL;
+
+    /* Replace reserved pages, keeping guard pages around them */
+    void* mapped = mmap(range, size, PROT_NONE, MAP_SHARED | MAP_FIXED, fd, 0);
+    if (mapped == MAP_FAILED)
+    {
+        MapRelease(range, size);
+        return NULL;
+    }
+
+    return range;
+}
+
+int MapCommit(void* range, size_t old_size, size_t new_size)
+{
+    old_size = RoundToPages_(old_size);
+    new_size = RoundToPages_(new_size);
+
+    if (new_size > old_size)
+        return mprotect((char*)range + old_size, new_size - old_size,
+                        PROT_READ | PROT_WRITE);
+
+    if (new_size < old_size)
+    {
+        char* released = (char*)range + new_size;
+        if (madvise(released, old_size - new_size, MADV_DONTNEED) != 0)
+            return -1;
+        return mprotect(released, old_size - new_size, PROT_NONE);
+    }
+
+    return 0;
+}
+
+void MapRelease(void* range, size_t size)
+{
+    if (!range)
+        return;
+
+    size_t page_size = GetPageSize();
+    munmap((char*)range - page_size, size + 2*page_size);
+}
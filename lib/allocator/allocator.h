@@ -0,0 +1,192 @@
+#ifndef BUFFER_ALLOCATOR_H
+#define BUFFER_ALLOCATOR_H
+
+/**
+ * @file allocator.h
+ * @author MeerkatBoss
+ * @brief Pluggable allocators for stack buffers
+ * @version 0.1
+ * @date 2022-10-03
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include <stddef.h>
+
+/**
+ * @brief
+ * Memory allocator. Sizes of allocated blocks are always
+ * known to the caller and passed back to allocator
+ */
+struct buffer_allocator
+{
+    const char* name;
+
+    /**
+     * @brief
+     * Allocate, grow or shrink memory block
+     *
+     * @param[in] context  allocator context
+     * @param[in] ptr      block returned by previous call
+     *                     or `NULL` to allocate new block
+     * @param[in] old_size current block size, ignored if `ptr` is `NULL`
+     * @param[in] new_size required block size
+     * @return pointer to block with at least `new_size` bytes,
+     * preserving first `old_size` bytes, or `NULL` upon failure.
+     * `ptr` stays valid upon failure
+     */
+    void* (*reallocate)(void* context, void* ptr, size_t old_size, size_t new_size);
+
+    /**
+     * @brief
+     * Free memory block
+     *
+     * @param[in] context allocator context
+     * @param[in] ptr     freed block
+     * @param[in] size    block size
+     */
+    void  (*release)   (void* context, void* ptr, size_t size);
+
+    void* context;
+};
+
+/**
+ * @brief
+ * Pool allocator statistics, summed across all threads
+ */
+struct pool_stats
+{
+    size_t hits;        /* allocations served from thread cache */
+    size_t refills;     /* allocations served from shared free lists */
+    size_t misses;      /* allocations which required new memory */
+    size_t in_place;    /* reallocations which did not move block */
+    size_t releases;    /* blocks returned to pool */
+    size_t oversized;   /* requests too big for pool, passed to `realloc` */
+};
+
+/**
+ * @brief
+ * Get allocator, which uses `realloc` and `free`
+ * @return Allocator instance
+ */
+const buffer_allocator* GetSystemAllocator(void);
+
+/**
+ * @brief
+ * Get size-class pool allocator. Blocks of up to
+ * `POOL_MAX_BLOCK_SIZE` bytes are carved from slabs and
+ * recycled through thread-local caches. Larger blocks are
+ * passed to `realloc` and `free`.
+ * Reallocation keeps block in place when shrinking it and
+ * when growing it by one class if the following block is
+ * cached free by current thread; otherwise block is moved
+ * @return Allocator instance
+ */
+const buffer_allocator* GetPoolAllocator(void);
+
+/**
+ * @brief
+ * Largest block size served by pool allocator
+ */
+const size_t POOL_MAX_BLOCK_SIZE = (size_t)1 << 20;
+
+/**
+ * @brief
+ * Set allocator used for stack buffers. Pool allocator
+ * is used by default
+ *
+ * @param[in] allocator new allocator, `NULL` to restore default
+ *
+ * @warning Buffers must be freed by the same allocator, which
+ * allocated them, so allocator should be changed only while no
+ * buffers are allocated
+ */
+void SetBufferAllocator(const buffer_allocator* allocator);
+
+/**
+ * @brief
+ * Get allocator used for stack buffers
+ * @return Current allocator
+ */
+const buffer_allocator* GetBufferAllocator(void);
+
+/**
+ * @brief
+ * Allocate, grow or shrink block using current allocator
+ * @param[in] ptr      block or `NULL`
+ * @param[in] old_size current block size
+ * @param[in] new_size required block size
+ * @return Reallocated block or `NULL` upon failure
+ */
+void* BufferRealloc(void* ptr, size_t old_size, size_t new_size);
+
+/**
+ * @brief
+ * Free block using current allocator
+ * @param[in] ptr  freed block
+ * @param[in] size block size
+ */
+void  BufferFree(void* ptr, size_t size);
+
+/**
+ * @brief
+ * Collect pool allocator statistics
+ * @param[out] stats collected statistics
+ */
+void GetPoolStats(pool_stats* stats);
+
+/**
+ * @brief
+ * Get size of virtual memory page
+ * @return Page size in bytes
+ */
+size_t GetPageSize(void);
+
+/**
+ * @brief
+ * Reserve virtual range without committing memory. Range
+ * is surrounded by inaccessible guard pages, reserved but
+ * not committed pages are inaccessible as well
+ * @param[in] size range size, multiple of page size
+ * @return Range start or `NULL` upon failure
+ */
+void* MapReserve(size_t size);
+
+/**
+ * @brief
+ * Reserve virtual range backed by shared file mapping. Range
+ * is surrounded by guard pages and is inaccessible until committed
+ * @param[in] fd   file descriptor opened for reading and writing.
+ *                 May be closed after the call
+ * @param[in] size range size, multiple of page size. File must
+ *                 be at least this long
+ * @return Range start or `NULL` upon failure
+ */
+void* MapReserveFile(int fd, size_t size);
+
+/**
+ * @brief
+ * Change committed part of reserved range. Committed pages
+ * are readable and writable, decommitted pages are returned
+ * to system and become inaccessible
+ * @param[in] range    range returned by `MapReserve` or `MapReserveFile`
+ * @param[in] old_size currently committed bytes
+ * @param[in] new_size required committed bytes
+ * @return zero upon success, non-zero otherwise
+ *
+ * @note Sizes are rounded up to pages. Anonymous pages committed
+ * again after decommit are filled with zeroes, file pages are
+ * read from file
+ */
+int   MapCommit(void* range, size_t old_size, size_t new_size);
+
+/**
+ * @brief
+ * Release reserved range together with its guard pages
+ * @param[in] range range returned by `MapReserve` or `MapReserveFile`
+ * @param[in] size  range size
+ */
+void  MapRelease(void* range, size_t size);
+
+#endif
@@ -0,0 +1,70 @@
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+#include "adaptive_lock.h"
+
+/**
+ * @brief 
+ * Spin limit bounds. Lock sleeps after at most
+ * `MAX_SPINS` unsuccessful attempts
+ */
+static const unsigned int MIN_SPINS = 16;
+static const unsigned int MAX_SPINS = 1024;
+
+static inline void CpuRelax_(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+static inline void FutexWait_(unsigned int* word, unsigned int value)
+{
+    syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, value, NULL, NULL, 0);
+}
+
+static inline void FutexWake_(unsigned int* word)
+{
+    syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+void LockAcquireSlow_(adaptive_lock* lock)
+{
+    unsigned int limit = __atomic_load_n(&lock->spin_limit, __ATOMIC_RELAXED) / 8;
+    if (limit < MIN_SPINS) limit = MIN_SPINS;
+    if (limit > MAX_SPINS) limit = MAX_SPINS;
+
+    for (unsigned int spins = 0; spins < limit; spins++)
+    {
+        unsigned int expected = LOCK_FREE_;
+        if (__atomic_load_n(&lock->state, __ATOMIC_RELAXED) == LOCK_FREE_ &&
+            __atomic_compare_exchange_n(&lock->state, &expected, LOCK_TAKEN_, false,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        {
+            /* Spin limit is moving average of spins, which were enough */
+            unsigned int average = __atomic_load_n(&lock->spin_limit, __ATOMIC_RELAXED);
+            average += 2*spins - average / 8;
+            __atomic_store_n(&lock->spin_limit, average, __ATOMIC_RELAXED);
+            return;
+        }
+        CpuRelax_();
+    }
+
+    /* Spinning did not help, lock is probably held for long */
+    unsigned int average = __atomic_load_n(&lock->spin_limit, __ATOMIC_RELAXED);
+    if (average > 8*MIN_SPINS)
+        __atomic_store_n(&lock->spin_limit, average - average / 8, __ATOMIC_RELAXED);
+
+    /* Lock is marked as having sleepers even if it is acquired,
+     * as other threads may already sleep on it */
+    while (__atomic_exchange_n(&lock->state, LOCK_SLEEPERS_, __ATOMIC_ACQUIRE) != LOCK_FREE_)
+        FutexWait_(&lock->state, LOCK_SLEEPERS_);
+}
+
+void LockWake_(adaptive_lock* lock)
+{
+    FutexWake_(&lock->state);
+}
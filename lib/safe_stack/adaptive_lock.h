@@ -0,0 +1,84 @@
+#ifndef ADAPTIVE_LOCK_H
+#define ADAPTIVE_LOCK_H
+
+/**
+ * @file adaptive_lock.h
+ * @author MeerkatBoss
+ * @brief Spin-then-sleep lock
+ * @version 0.1
+ * @date 2022-10-13
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ * @note Contended lock is first spun on, then waited on with
+ * `futex`. Spin limit follows average number of spins, after
+ * which lock was acquired, so that lock held for long sleeps
+ * almost immediately, and lock held for short never sleeps.
+ * 
+ * @note Uncontended acquire and release are single atomic
+ * operations and are defined inline.
+ * 
+ */
+
+/**
+ * @brief 
+ * Lock state
+ */
+enum lock_state_ : unsigned int
+{
+    LOCK_FREE_      = 0,
+    LOCK_TAKEN_     = 1,
+    LOCK_SLEEPERS_  = 2,    /* lock is taken and some threads may sleep on it */
+};
+
+/**
+ * @brief 
+ * Spin-then-sleep lock. Zero-initialized lock is free
+ */
+struct adaptive_lock
+{
+    unsigned int    state;      /* `lock_state_` */
+    unsigned int    spin_limit; /* average spins before acquire, times 8 */
+};
+
+/**
+ * @brief 
+ * Acquire contended lock. Called by `LockAcquire`
+ */
+void LockAcquireSlow_(adaptive_lock* lock);
+
+/**
+ * @brief 
+ * Wake thread sleeping on lock. Called by `LockRelease`
+ */
+void LockWake_(adaptive_lock* lock);
+
+/**
+ * @brief 
+ * Acquire lock, waiting for it to be released if necessary
+ * 
+ * @param[inout] lock acquired lock
+ */
+inline void LockAcquire(adaptive_lock* lock)
+{
+    unsigned int expected = LOCK_FREE_;
+    if (__atomic_compare_exchange_n(&lock->state, &expected, LOCK_TAKEN_, false,
+                                    __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        return;
+
+    LockAcquireSlow_(lock);
+}
+
+/**
+ * @brief 
+ * Release lock, acquired by calling thread
+ * 
+ * @param[inout] lock released lock
+ */
+inline void LockRelease(adaptive_lock* lock)
+{
+    if (__atomic_exchange_n(&lock->state, LOCK_FREE_, __ATOMIC_RELEASE) == LOCK_SLEEPERS_)
+        LockWake_(lock);
+}
+
+#endif
@@ -0,0 +1,81 @@
+#include <stdlib.h>
+
+#include "command_ring.h"
+
+int RingCtor(command_ring* ring, size_t capacity)
+{
+    if (!ring) return -1;
+
+    size_t size = 2;
+    while (size < capacity)
+        size *= 2;
+
+    *ring = {};
+    ring->cells = (ring_cell_*) calloc(size, sizeof(*ring->cells));
+    if (!ring->cells)
+        return -1;
+
+    ring->mask = size - 1;
+    for (size_t i = 0; i < size; i++)
+        ring->cells[i].seq = i;
+
+    return 0;
+}
+
+void RingDtor(command_ring* ring)
+{
+    if (!ring) return;
+
+    free(ring->cells);
+    *ring = {};
+}
+
+int RingPush(command_ring* ring, const ring_command* command)
+{
+    size_t pos = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+
+    for (;;)
+    {
+        ring_cell_* cell = &ring->cells[pos & ring->mask];
+        size_t seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+
+        if (seq == pos)
+        {
+            /* Cell is free, claim position */
+            if (__atomic_compare_exchange_n(&ring->tail, &pos, pos + 1, true,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            {
+                cell->command = *command;
+                __atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+                return 0;
+            }
+        }
+        else if ((long long)(seq - pos) < 0)
+        {
+            /* Cell still holds command from previous lap */
+            return -1;
+        }
+        else
+            pos = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+    }
+}
+
+size_t RingPopN(command_ring* ring, ring_command* commands, size_t count)
+{
+    size_t taken = 0;
+
+    while (taken < count)
+    {
+        size_t      pos  = ring->head;
+        ring_cell_* cell = &ring->cells[pos & ring->mask];
+
+        if (__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) != pos + 1)
+            break;
+
+        commands[taken++] = cell->command;
+        __atomic_store_n(&cell->seq, pos + ring->mask + 1, __ATOMIC_RELEASE);
+        ring->head = pos + 1;
+    }
+
+    return taken;
+}
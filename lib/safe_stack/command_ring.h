@@ -0,0 +1,108 @@
+#ifndef COMMAND_RING_H
+#define COMMAND_RING_H
+
+/**
+ * @file command_ring.h
+ * @author MeerkatBoss
+ * @brief Bounded multi-producer single-consumer command queue
+ * @version 0.1
+ * @date 2022-10-14
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ * @note Every cell carries sequence number, which tells whether it
+ * is free for producer at given position or filled for consumer.
+ * Producers only contend on tail and consumer alone moves head,
+ * tail and head are placed on different cache lines.
+ * 
+ */
+
+#include <stddef.h>
+
+/**
+ * @brief 
+ * Cache line size. Producer and consumer positions
+ * are placed on different lines
+ */
+const size_t RING_CACHE_LINE = 64;
+
+/**
+ * @brief 
+ * Command stored in ring
+ */
+struct ring_command
+{
+    unsigned int        op;         /* operation code */
+    unsigned long long  value;      /* operation argument */
+    void*               result;     /* where result is written */
+    void*               completion; /* where completion is reported */
+};
+
+/**
+ * @brief 
+ * Ring cell
+ */
+struct ring_cell_
+{
+    size_t          seq;    /* position, at which cell is free or filled */
+    ring_command    command;
+};
+
+/**
+ * @brief 
+ * Bounded MPSC command queue
+ */
+struct command_ring
+{
+    ring_cell_*     cells;
+    size_t          mask;   /* number of cells minus one */
+
+    alignas(RING_CACHE_LINE)
+    size_t          tail;   /* next position for producers */
+
+    alignas(RING_CACHE_LINE)
+    size_t          head;   /* next position for consumer */
+};
+
+/**
+ * @brief 
+ * Construct ring
+ * 
+ * @param[out] ring     constructed ring
+ * @param[in]  capacity minimal number of commands ring can hold,
+ *                      rounded up to power of two
+ * @return zero upon success, non-zero otherwise
+ */
+int     RingCtor    (command_ring* ring, size_t capacity);
+
+/**
+ * @brief 
+ * Free ring cells. Ring must not be used concurrently
+ * 
+ * @param[inout] ring destroyed ring
+ */
+void    RingDtor    (command_ring* ring);
+
+/**
+ * @brief 
+ * Add command to ring. May be called by several threads at once
+ * 
+ * @param[inout] ring    command ring
+ * @param[in]    command added command
+ * @return zero upon success, non-zero if ring is full
+ */
+int     RingPush    (command_ring* ring, const ring_command* command);
+
+/**
+ * @brief 
+ * Take several commands from ring. Must be called
+ * by one thread at a time
+ * 
+ * @param[inout] ring     command ring
+ * @param[out]   commands taken commands, oldest one is first
+ * @param[in]    count    maximum number of taken commands
+ * @return Number of taken commands
+ */
+size_t  RingPopN    (command_ring* ring, ring_command* commands, size_t count);
+
+#endif
@@ -0,0 +1,189 @@
+#include <stdlib.h>
+
+#include "handle_table.h"
+
+/**
+ * @brief 
+ * Number of entries in one slab
+ */
+static const unsigned int SLAB_ENTRIES = 1u << HANDLE_SLAB_SHIFT;
+
+/**
+ * @brief 
+ * Maximum number of entries in table
+ */
+static const unsigned long long MAX_ENTRIES = (unsigned long long)HANDLE_MAX_SLABS
+                                                                 * SLAB_ENTRIES;
+
+static_assert(MAX_ENTRIES <= 0xFFFFFFFFull, "Entry index must fit 32 bits");
+
+static inline unsigned int HandleIndex_(handle_t handle)
+{
+    return (unsigned int)(handle & 0xFFFFFFFFull);
+}
+
+static inline unsigned int HandleGeneration_(handle_t handle)
+{
+    return (unsigned int)(handle >> 32);
+}
+
+static inline handle_t MakeHandle_(unsigned int index, unsigned int generation)
+{
+    return ((handle_t)generation << 32) | index;
+}
+
+/**
+ * @brief 
+ * Get table entry by index. Index must be less than `table->count`
+ */
+static inline handle_entry_* GetEntry_(const handle_table* table, unsigned int index)
+{
+    handle_entry_* slab = __atomic_load_n(&table->slabs[index >> HANDLE_SLAB_SHIFT],
+                                          __ATOMIC_ACQUIRE);
+    return slab + (index & (SLAB_ENTRIES - 1));
+}
+
+/**
+ * @brief 
+ * Get unused table entry. Table lock must be held
+ * @return Entry index, -1 if table is full or out of memory
+ */
+static long long TakeEntry_(handle_table* table)
+{
+    if (table->free_head != 0)
+    {
+        unsigned int index = table->free_head - 1;
+        table->free_head = GetEntry_(table, index)->next_free;
+        return index;
+    }
+
+    if (table->count == MAX_ENTRIES)
+        return -1;
+
+    unsigned int index = table->count;
+    size_t slab = index >> HANDLE_SLAB_SHIFT;
+
+    if (!table->slabs[slab])
+    {
+        handle_entry_* entries = (handle_entry_*) calloc(SLAB_ENTRIES, sizeof(*entries));
+        if (!entries)
+            return -1;
+
+        /* Readers may see new slab only after its entries are zeroed */
+        __atomic_store_n(&table->slabs[slab], entries, __ATOMIC_RELEASE);
+    }
+
+    return index;
+}
+
+handle_t HandleAlloc(handle_table* table, void* object)
+{
+    if (!table || !object)
+        return 0;
+
+    pthread_mutex_lock(&table->lock);
+
+    long long taken = TakeEntry_(table);
+    if (taken < 0)
+    {
+        pthread_mutex_unlock(&table->lock);
+        return 0;
+    }
+
+    unsigned int   index = (unsigned int)taken;
+    handle_entry_* entry = GetEntry_(table, index);
+
+    unsigned int generation = entry->generation + 1;
+
+    entry->next_free = 0;
+    __atomic_store_n(&entry->object,     object,     __ATOMIC_RELAXED);
+    __atomic_store_n(&entry->generation, generation, __ATOMIC_RELEASE);
+
+    if (index == table->count)
+        __atomic_store_n(&table->count, index + 1, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&table->live, 1, __ATOMIC_RELAXED);
+
+    pthread_mutex_unlock(&table->lock);
+
+    return MakeHandle_(index, generation);
+}
+
+void* HandleGet(const handle_table* table, handle_t handle)
+{
+    if (!table) return NULL;
+
+    unsigned int index      = HandleIndex_(handle);
+    unsigned int generation = HandleGeneration_(handle);
+
+    /* Free entries have even generation, so that zero handle is never valid */
+    if ((generation & 1) == 0)
+        return NULL;
+
+    if (index >= __atomic_load_n(&table->count, __ATOMIC_ACQUIRE))
+        return NULL;
+
+    const handle_entry_* entry = GetEntry_(table, index);
+
+    if (__atomic_load_n(&entry->generation, __ATOMIC_ACQUIRE) != generation)
+        return NULL;
+
+    void* object = __atomic_load_n(&entry->object, __ATOMIC_ACQUIRE);
+
+    /* Entry may have been freed and reused while object was read */
+    if (__atomic_load_n(&entry->generation, __ATOMIC_RELAXED) != generation)
+        return NULL;
+
+    return object;
+}
+
+void* HandleFree(handle_table* table, handle_t handle)
+{
+    if (!table) return NULL;
+
+    pthread_mutex_lock(&table->lock);
+
+    void* object = HandleGet(table, handle);
+    if (!object)
+    {
+        pthread_mutex_unlock(&table->lock);
+        return NULL;
+    }
+
+    unsigned int   index = HandleIndex_(handle);
+    handle_entry_* entry = GetEntry_(table, index);
+
+    __atomic_store_n(&entry->generation, entry->generation + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&entry->object,     (void*)NULL,           __ATOMIC_RELAXED);
+
+    entry->next_free = table->free_head;
+    table->free_head = index + 1;
+    __atomic_sub_fetch(&table->live, 1, __ATOMIC_RELAXED);
+
+    pthread_mutex_unlock(&table->lock);
+
+    return object;
+}
+
+size_t HandleCount(const handle_table* table)
+{
+    if (!table) return 0;
+    return __atomic_load_n(&table->live, __ATOMIC_RELAXED);
+}
+
+void HandleTableDtor(handle_table* table)
+{
+    if (!table) return;
+
+    pthread_mutex_lock(&table->lock);
+
+    for (size_t i = 0; i < HANDLE_MAX_SLABS; i++)
+    {
+        free(table->slabs[i]);
+        table->slabs[i] = NULL;
+    }
+    table->count     = 0;
+    table->free_head = 0;
+    table->live      = 0;
+
+    pthread_mutex_unlock(&table->lock);
+}
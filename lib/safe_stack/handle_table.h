@@ -0,0 +1,124 @@
+#ifndef HANDLE_TABLE_H
+#define HANDLE_TABLE_H
+
+/**
+ * @file handle_table.h
+ * @author MeerkatBoss
+ * @brief Generation-indexed handle table
+ * @version 0.1
+ * @date 2022-10-12
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ * @note Handle consists of entry index in lower 32 bits and
+ * entry generation in upper 32 bits. Generation is odd while
+ * entry is in use and is incremented when entry is allocated
+ * or freed, so that stale and forged handles are rejected by
+ * bounds check and generation comparison, without accessing
+ * any memory outside of table.
+ * 
+ * @note Entries are stored in slabs, which are never moved or
+ * freed while table is alive. Lookup takes no locks and may run
+ * concurrently with allocation and freeing, which are serialized
+ * with table lock.
+ * 
+ */
+
+#include <stddef.h>
+#include <pthread.h>
+
+/**
+ * @brief 
+ * Handle of object stored in table. Zero is never valid
+ */
+typedef unsigned long long handle_t;
+
+/**
+ * @brief 
+ * Number of entries in slab is `1 << HANDLE_SLAB_SHIFT`
+ */
+const unsigned int HANDLE_SLAB_SHIFT = 16;
+
+/**
+ * @brief 
+ * Maximum number of slabs in table
+ */
+const size_t       HANDLE_MAX_SLABS  = 512;
+
+/**
+ * @brief 
+ * Handle table entry
+ */
+struct handle_entry_
+{
+    unsigned int    generation;     /* odd if entry is in use */
+    unsigned int    next_free;      /* next free entry index + 1, 0 if none */
+    void*           object;         /* stored object, NULL if entry is free */
+};
+
+/**
+ * @brief 
+ * Table, which maps handles to objects
+ */
+struct handle_table
+{
+    handle_entry_*  slabs[HANDLE_MAX_SLABS];    /* NULL if slab is not allocated */
+    unsigned int    count;          /* number of entries ever used */
+    unsigned int    free_head;      /* first free entry index + 1, 0 if none */
+    size_t          live;           /* number of entries in use */
+    pthread_mutex_t lock;           /* serializes allocation and freeing */
+};
+
+/**
+ * @brief 
+ * Static `handle_table` initializer
+ */
+#define HANDLE_TABLE_INITIALIZER                        \
+    { .slabs = {}, .count = 0, .free_head = 0, .live = 0, .lock = PTHREAD_MUTEX_INITIALIZER }
+
+/**
+ * @brief 
+ * Store object in table
+ * 
+ * @param[inout] table  handle table
+ * @param[in]    object stored object, not `NULL`
+ * @return Object handle, zero if table is full or out of memory
+ */
+handle_t HandleAlloc(handle_table* table, void* object);
+
+/**
+ * @brief 
+ * Get object by its handle
+ * 
+ * @param[in] table  handle table
+ * @param[in] handle object handle
+ * @return Stored object, `NULL` if handle is stale or invalid
+ */
+void*    HandleGet  (const handle_table* table, handle_t handle);
+
+/**
+ * @brief 
+ * Remove object from table, invalidating its handle
+ * 
+ * @param[inout] table  handle table
+ * @param[in]    handle object handle
+ * @return Removed object, `NULL` if handle is stale or invalid
+ */
+void*    HandleFree (handle_table* table, handle_t handle);
+
+/**
+ * @brief 
+ * Get number of objects stored in table
+ */
+size_t   HandleCount(const handle_table* table);
+
+/**
+ * @brief 
+ * Free table slabs. Stored objects are not freed
+ * and all handles become invalid
+ * 
+ * @param[inout] table handle table
+ */
+void     HandleTableDtor(handle_table* table);
+
+#endif
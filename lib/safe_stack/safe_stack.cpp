@@ -1,128 +1,1080 @@
 #include <stdio.h>
-#include <unistd.h>
-#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
 #include <assert.h>
 
-#define USE_CUSTOM_ELEMENT
-typedef struct
-{
-    int value;
-    int is_poison;
-} element_t;
-const element_t element_poison = {.value = 0, .is_poison = 1};
-inline void PrintElement(element_t element) { printf("%d", element.value); }
-inline int IsPoison(element_t element){ return element.is_poison; }
-
-#define STK_PROT_LEVEL 03
+#include <algorithm>
+#include <type_traits>
 
-#include "stack.h"
+#include "dynamic_stack.h"
 #include "safe_stack.h"
 #include "logger.h"
 
-struct SafeStack
+#include "handle_table.h"
+#include "adaptive_lock.h"
+#include "command_ring.h"
+
+static_assert(sizeof(int) == sizeof(int32_t), "`int` stacks are stored as `int32_t` stacks");
+
+/**
+ * @brief 
+ * Largest `DynamicStack` among element types
+ */
+static const size_t SAFE_STACK_STORAGE = std::max({sizeof(DynamicStack<int8_t>),
+                                                   sizeof(DynamicStack<int16_t>),
+                                                   sizeof(DynamicStack<int32_t>),
+                                                   sizeof(DynamicStack<int64_t>),
+                                                   sizeof(DynamicStack<float>),
+                                                   sizeof(DynamicStack<double>)});
+
+/**
+ * @brief 
+ * Stack referred to by `SafeStack` handle
+ */
+struct safe_stack_t
 {
-    canary_t canary_start;
-    Stack stack;
-    canary_t canary_end;
+    SafeStackElement        element;    /* element type */
+    unsigned int            flags;      /* some combination of `SafeStackFlags` */
+
+    adaptive_lock           lock;       /* held by modifying thread */
+    unsigned int            seq;        /* odd while stack is modified */
+    unsigned int            top_valid;  /* zero if stack is empty */
+    unsigned long long      top;        /* copy of top element */
+
+    safe_stack_t*           next_free;  /* next stack in pool */
+    command_ring*           queue;      /* queued operations, `NULL` if not attached */
+
+    unsigned long long*     sentinels;  /* bit `i` is set if slot `i` holds integer poison
+                                           value, `NULL` if it was never pushed */
+    size_t                  sentinel_words; /* number of words in `sentinels` */
+
+    alignas(DynamicStack<int64_t>)
+    unsigned char           storage[SAFE_STACK_STORAGE];
+                                        /* `DynamicStack` of element type */
 };
 
-static hash_t GetHashKey_()
+/**
+ * @brief 
+ * Protection level of constructed stacks
+ */
+static const unsigned int SAFE_STACK_PROT = STK_CANARY_PROT | STK_HASH_PROT;
+
+/**
+ * @brief 
+ * Number of attempts to read top of concurrent stack without lock
+ */
+static const size_t PEEK_ATTEMPTS = 16;
+
+/**
+ * @brief 
+ * Number of slots described by one word of `safe_stack_t::sentinels`
+ */
+static const size_t SENTINEL_WORD_BITS = 64;
+
+/**
+ * @brief 
+ * Table of live stacks. `SafeStack*` is a handle into
+ * this table, not an address of stack
+ */
+static handle_table safe_stacks = HANDLE_TABLE_INITIALIZER;
+
+static inline handle_t SafeStackHandle_(const SafeStack* safe_stack)
 {
-    hash_t result = 0;
-    int fd = open("/dev/random", O_RDONLY);
-    read(fd, &result, sizeof(&result));
-    close(fd);
-    result = GetHash(&result, sizeof(result));
-    return result;
+    return (handle_t)(uintptr_t)safe_stack;
 }
 
-static const hash_t HASH_KEY = GetHashKey_();
+/**
+ * @brief 
+ * Report result of queued operation
+ */
+static inline void SafeStackComplete_(const ring_command* command, unsigned int err)
+{
+    safe_stack_completion* completion = (safe_stack_completion*)command->completion;
+    if (!completion) return;
+
+    completion->err = err;
+    __atomic_store_n(&completion->done, 1u, __ATOMIC_RELEASE);
+}
 
-static inline SafeStack* SafeStackDecrypt_(SafeStack* safe_stack)
+static inline safe_stack_t* SafeStackLookup_(SafeStack* safe_stack)
 {
-    LOG_ASSERT(MSG_ERROR, safe_stack != NULL, return NULL);
-    safe_stack = (SafeStack*)((hash_t)safe_stack ^ HASH_KEY);
-    LOG_ASSERT(MSG_ERROR,
-        CanReadPointer(safe_stack),
+    safe_stack_t* stack = (safe_stack_t*)HandleGet(&safe_stacks,
+                                                   SafeStackHandle_(safe_stack));
+    LOG_ASSERT(MSG_ERROR, stack != NULL,
         {
-            log_message(MSG_ERROR, "Corrupted stack ptr %p (%#016llx^%#016llx)",
-                safe_stack,
-                (hash_t)safe_stack ^ HASH_KEY, HASH_KEY);
+            log_message(MSG_ERROR, "Invalid stack handle %p", safe_stack);
             return NULL;
         });
+    return stack;
+}
+
+/**
+ * @brief 
+ * Get stack by handle and check its element type
+ * @return Stack, `NULL` if handle is invalid or type does not match
+ */
+static inline safe_stack_t* SafeStackLookupOf_(SafeStack* safe_stack,
+                                               SafeStackElement element)
+{
+    safe_stack_t* stack = SafeStackLookup_(safe_stack);
+    if (!stack) return NULL;
 
-    LOG_ASSERT(MSG_ERROR,
-        safe_stack->canary_start == (CANARY ^ HASH_KEY),
+    LOG_ASSERT(MSG_ERROR, stack->element == element,
         {
-            log_message(MSG_ERROR, "Dead canary %#016llx", safe_stack->canary_start);
+            log_message(MSG_ERROR, "Stack %p holds elements of type %d, not %d",
+                                   safe_stack, stack->element, element);
             return NULL;
         });
-    LOG_ASSERT(MSG_ERROR,
-        safe_stack->canary_end   == (CANARY ^ HASH_KEY),
+    return stack;
+}
+
+/**
+ * @brief 
+ * Call `func` with `DynamicStack` of stack element type
+ * @return Value returned by `func`
+ */
+template <typename Func>
+static unsigned int SafeStackVisit_(safe_stack_t* stack, Func func)
+{
+    switch (stack->element)
+    {
+        case SAFE_STACK_INT8:   return func((DynamicStack<int8_t>*)  stack->storage);
+        case SAFE_STACK_INT16:  return func((DynamicStack<int16_t>*) stack->storage);
+        case SAFE_STACK_INT32:  return func((DynamicStack<int32_t>*) stack->storage);
+        case SAFE_STACK_INT64:  return func((DynamicStack<int64_t>*) stack->storage);
+        case SAFE_STACK_FLOAT:  return func((DynamicStack<float>*)   stack->storage);
+        case SAFE_STACK_DOUBLE: return func((DynamicStack<double>*)  stack->storage);
+        default:                return STK_BAD_PTR;
+    }
+}
+
+/**
+ * @brief 
+ * Element type of `DynamicStack` pointer
+ */
+template <typename Ptr>
+using safe_element_t_ = typename std::remove_pointer_t<Ptr>::element_type;
+
+/**
+ * @brief 
+ * Copy top element to `stack->top`, so that it can be read
+ * without lock. Called by modifying thread
+ */
+static void SafeStackPublishTop_(safe_stack_t* stack)
+{
+    SafeStackVisit_(stack, [stack](auto* typed)
         {
-            log_message(MSG_ERROR, "Dead canary %#016llx", safe_stack->canary_end);
+            typedef safe_element_t_<decltype(typed)> elem_t;
+            static_assert(sizeof(elem_t) <= sizeof(stack->top), "Element does not fit");
+
+            const elem_t* data = NULL;
+            size_t size = DynamicStackGetOps_(typed)->view(typed->storage_, &data);
+
+            elem_t top_value = size ? data[size - 1] : elem_t{};
+            if (size)
+                SentinelRestore_(stack, &top_value, size - 1, 1);
+
+            unsigned long long top = 0;
+            memcpy(&top, &top_value, sizeof(elem_t));
+
+            /* Release stores keep odd `seq` visible to readers of new top */
+            __atomic_store_n(&stack->top,       top,          __ATOMIC_RELEASE);
+            __atomic_store_n(&stack->top_valid, size ? 1u : 0u, __ATOMIC_RELEASE);
+            return 0u;
+        });
+}
+
+/**
+ * @brief 
+ * Lock concurrent stack for reading. Does nothing for other stacks
+ */
+static inline void SafeStackBeginRead_(safe_stack_t* stack)
+{
+    if (stack->flags & SAFE_STACK_CONCURRENT)
+        LockAcquire(&stack->lock);
+}
+
+static inline void SafeStackEndRead_(safe_stack_t* stack)
+{
+    if (stack->flags & SAFE_STACK_CONCURRENT)
+        LockRelease(&stack->lock);
+}
+
+/**
+ * @brief 
+ * Lock concurrent stack for modification and notify lock-free
+ * readers. Does nothing for other stacks
+ */
+static inline void SafeStackBeginWrite_(safe_stack_t* stack)
+{
+    if (!(stack->flags & SAFE_STACK_CONCURRENT)) return;
+
+    LockAcquire(&stack->lock);
+    __atomic_store_n(&stack->seq, stack->seq + 1, __ATOMIC_RELAXED);
+}
+
+static inline void SafeStackEndWrite_(safe_stack_t* stack)
+{
+    if (!(stack->flags & SAFE_STACK_CONCURRENT)) return;
+
+    SafeStackPublishTop_(stack);
+    __atomic_store_n(&stack->seq, stack->seq + 1, __ATOMIC_RELEASE);
+    LockRelease(&stack->lock);
+}
+
+/**
+ * @brief 
+ * Size of element of given type
+ */
+static inline size_t SafeStackElementSize_(SafeStackElement element)
+{
+    switch (element)
+    {
+        case SAFE_STACK_INT8:   return sizeof(int8_t);
+        case SAFE_STACK_INT16:  return sizeof(int16_t);
+        case SAFE_STACK_INT32:  return sizeof(int32_t);
+        case SAFE_STACK_INT64:  return sizeof(int64_t);
+        case SAFE_STACK_FLOAT:  return sizeof(float);
+        case SAFE_STACK_DOUBLE: return sizeof(double);
+        default:                return 0;
+    }
+}
+
+/**
+ * @brief 
+ * Integer stacks accept every value of their type. Integer poison is
+ * stored as zero and marked in `sentinels`, so that it is not taken
+ * for free slot. Floating-point poison is one NaN and is rejected
+ */
+template <typename T>
+static constexpr bool SAFE_STACK_FULL_RANGE_ = std::is_integral_v<T>;
+
+/**
+ * @brief 
+ * Make `sentinels` describe at least `slots` slots
+ * @return Zero upon success, non-zero if out of memory
+ */
+static int SentinelReserve_(safe_stack_t* stack, size_t slots)
+{
+    size_t words = (slots + SENTINEL_WORD_BITS - 1) / SENTINEL_WORD_BITS;
+    if (words <= stack->sentinel_words)
+        return 0;
+
+    size_t new_words = std::max(words, 2*stack->sentinel_words);
+    unsigned long long* bits = (unsigned long long*)realloc(stack->sentinels,
+                                                    new_words*sizeof(*bits));
+    if (!bits) return -1;
+
+    memset(bits + stack->sentinel_words, 0,
+           (new_words - stack->sentinel_words)*sizeof(*bits));
+    stack->sentinels      = bits;
+    stack->sentinel_words = new_words;
+    return 0;
+}
+
+static inline int SentinelGet_(const safe_stack_t* stack, size_t slot)
+{
+    size_t word = slot / SENTINEL_WORD_BITS;
+    return word < stack->sentinel_words &&
+           (stack->sentinels[word] >> (slot % SENTINEL_WORD_BITS) & 1);
+}
+
+/**
+ * @brief 
+ * Mark slots [index, index + count) as holding `values`.
+ * Slots holding poison must be reserved with `SentinelReserve_`
+ */
+template <typename T>
+static void SentinelMark_(safe_stack_t* stack, const T* values, size_t index, size_t count)
+{
+    if constexpr (SAFE_STACK_FULL_RANGE_<T>)
+    for (size_t i = 0; i < count; i++)
+    {
+        size_t word = (index + i) / SENTINEL_WORD_BITS;
+        if (word >= stack->sentinel_words)
+            return;
+
+        unsigned long long mask = 1ull << ((index + i) % SENTINEL_WORD_BITS);
+        if (ElementTraits<T>::IsPoison(values[i]))
+            stack->sentinels[word] |=  mask;
+        else
+            stack->sentinels[word] &= ~mask;
+    }
+}
+
+/**
+ * @brief 
+ * Put poison back into `values` read from slots [index, index + count)
+ */
+template <typename T>
+static void SentinelRestore_(const safe_stack_t* stack, T* values, size_t index, size_t count)
+{
+    if constexpr (SAFE_STACK_FULL_RANGE_<T>)
+    {
+        if (!stack->sentinels) return;
+
+        for (size_t i = 0; i < count; i++)
+            if (SentinelGet_(stack, index + i))
+                values[i] = ElementTraits<T>::poison;
+    }
+}
+
+/**
+ * @brief 
+ * Copy `values` to `stored`, replacing poison with stored substitute
+ */
+template <typename T>
+static void SentinelSubstitute_(const T* values, T* stored, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        stored[i] = ElementTraits<T>::IsPoison(values[i]) ? T{} : values[i];
+}
+
+/**
+ * @brief 
+ * Allocate and construct stack of given element type
+ * @return Constructed stack, `NULL` upon failure
+ */
+static safe_stack_t* SafeStackCreate_(SafeStackElement element)
+{
+    safe_stack_t* safe_stack = (safe_stack_t*) calloc(1, sizeof(*safe_stack));
+    if (!safe_stack) return NULL;
+
+    safe_stack->element = element;
+
+    unsigned int res = 0;
+    LOG_CATCH_ERROR(
+        {
+            res = SafeStackVisit_(safe_stack, [](auto* stack) -> unsigned int
+                {
+                    return (unsigned int)StackCtorLevel(stack, SAFE_STACK_PROT);
+                });
+        }, res == 0,
+        {
+            free(safe_stack);
             return NULL;
         });
+
     return safe_stack;
 }
 
+/**
+ * @brief 
+ * Destroy stack and free its memory
+ */
+static void SafeStackDestroy_(safe_stack_t* stack)
+{
+    SafeStackVisit_(stack, [](auto* typed) { StackDtor(typed); return 0u; });
+    free(stack->sentinels);
+    free(stack);
+}
+
+/**
+ * @brief 
+ * Memory held by stack
+ */
+static size_t SafeStackBytes_(safe_stack_t* stack)
+{
+    size_t capacity = 0;
+    SafeStackVisit_(stack, [&capacity](auto* typed)
+        {
+            capacity = StackGetCapacity(typed);
+            return 0u;
+        });
+    return sizeof(*stack) + capacity * SafeStackElementSize_(stack->element);
+}
+
+/**
+ * @brief 
+ * Per-thread lists of cleared stacks, one for each element type
+ */
+struct safe_stack_pool_
+{
+    safe_stack_t*   free[SAFE_STACK_DOUBLE + 1];
+    size_t          bytes;      /* memory held by this pool */
+
+    ~safe_stack_pool_();
+};
+
+static size_t pool_limit_ = SAFE_STACK_POOL_LIMIT;
+static size_t pool_bytes_ = 0;          /* memory held by pools of all threads */
+
+static safe_stack_pool_stats pool_stats_ = {};
+
+#define POOL_STAT_INC(field) __atomic_add_fetch(&pool_stats_.field, 1, __ATOMIC_RELAXED)
+
+/* 0 - not created, 1 - alive, 2 - destroyed */
+static thread_local int              local_pool_state_ = 0;
+static thread_local safe_stack_pool_ local_pool_       = {};
+
+static safe_stack_pool_* GetThreadPool_(void)
+{
+    if (local_pool_state_ == 2)
+        return NULL;
+
+    local_pool_state_ = 1;
+    return &local_pool_;
+}
+
+/**
+ * @brief 
+ * Free one stack from pool
+ * @return Zero if pool is empty, non-zero otherwise
+ */
+static int PoolFreeOne_(safe_stack_pool_* pool)
+{
+    for (size_t i = 0; i <= SAFE_STACK_DOUBLE; i++)
+    {
+        safe_stack_t* stack = pool->free[i];
+        if (!stack) continue;
+
+        pool->free[i] = stack->next_free;
+
+        size_t bytes = SafeStackBytes_(stack);
+        pool->bytes -= bytes;
+        __atomic_sub_fetch(&pool_bytes_, bytes, __ATOMIC_RELAXED);
+
+        SafeStackDestroy_(stack);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief 
+ * Free stacks from pool until memory of all pools fits limit
+ */
+static void PoolTrim_(safe_stack_pool_* pool)
+{
+    while (__atomic_load_n(&pool_bytes_, __ATOMIC_RELAXED) >
+           __atomic_load_n(&pool_limit_, __ATOMIC_RELAXED))
+    {
+        if (!PoolFreeOne_(pool))
+            return;
+        POOL_STAT_INC(trimmed);
+    }
+}
+
+safe_stack_pool_::~safe_stack_pool_()
+{
+    while (PoolFreeOne_(this))
+        ;
+    local_pool_state_ = 2;
+}
+
+/**
+ * @brief 
+ * Take stack of given element type from pool of calling thread.
+ * Stack is checked before reuse
+ * @return Stack, `NULL` if there is none
+ */
+static safe_stack_t* PoolTake_(SafeStackElement element)
+{
+    safe_stack_pool_* pool = GetThreadPool_();
+    if (!pool) return NULL;
+
+    while (safe_stack_t* stack = pool->free[element])
+    {
+        pool->free[element] = stack->next_free;
+
+        size_t bytes = SafeStackBytes_(stack);
+        pool->bytes -= bytes;
+        __atomic_sub_fetch(&pool_bytes_, bytes, __ATOMIC_RELAXED);
+
+        /* Stack may have been corrupted while it was in pool */
+        unsigned int err = SafeStackVisit_(stack, [](auto* typed)
+            {
+                return StackCheck(typed);
+            });
+        if (err)
+        {
+            log_message(MSG_ERROR, "Pooled stack %p is corrupted (error %#x)", stack, err);
+            POOL_STAT_INC(rejected);
+            SafeStackDestroy_(stack);
+            continue;
+        }
+
+        stack->next_free = NULL;
+        return stack;
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief 
+ * Clear stack and put it into pool of calling thread
+ * @return Zero if stack was pooled, non-zero if it
+ * must be destroyed
+ */
+static int PoolPut_(safe_stack_t* stack)
+{
+    safe_stack_pool_* pool = GetThreadPool_();
+    if (!pool) return -1;
+
+    unsigned int level = 0;
+    unsigned int err = SafeStackVisit_(stack, [&level](auto* typed)
+        {
+            level = StackGetProtection(typed);
+            return StackClear(typed);
+        });
+    if (err)
+    {
+        POOL_STAT_INC(rejected);
+        return -1;
+    }
+    if (level != SAFE_STACK_PROT)
+        return -1;
+
+    free(stack->sentinels);
+    stack->sentinels      = NULL;
+    stack->sentinel_words = 0;
+
+    size_t bytes = SafeStackBytes_(stack);
+    if (__atomic_add_fetch(&pool_bytes_, bytes, __ATOMIC_RELAXED) >
+        __atomic_load_n(&pool_limit_, __ATOMIC_RELAXED))
+    {
+        __atomic_sub_fetch(&pool_bytes_, bytes, __ATOMIC_RELAXED);
+        PoolTrim_(pool);
+        POOL_STAT_INC(trimmed);
+        return -1;
+    }
+
+    pool->bytes += bytes;
+    stack->next_free = pool->free[stack->element];
+    pool->free[stack->element] = stack;
+    return 0;
+}
+
+void SafeStackPoolSetLimit(size_t bytes)
+{
+    __atomic_store_n(&pool_limit_, bytes, __ATOMIC_RELAXED);
+
+    safe_stack_pool_* pool = GetThreadPool_();
+    if (pool) PoolTrim_(pool);
+}
+
+void SafeStackPoolTrim(void)
+{
+    safe_stack_pool_* pool = GetThreadPool_();
+    if (!pool) return;
+
+    while (PoolFreeOne_(pool))
+        POOL_STAT_INC(trimmed);
+}
+
+void SafeStackPoolGetStats(safe_stack_pool_stats* stats)
+{
+    if (!stats) return;
+
+    stats->hits     = __atomic_load_n(&pool_stats_.hits,     __ATOMIC_RELAXED);
+    stats->misses   = __atomic_load_n(&pool_stats_.misses,   __ATOMIC_RELAXED);
+    stats->rejected = __atomic_load_n(&pool_stats_.rejected, __ATOMIC_RELAXED);
+    stats->trimmed  = __atomic_load_n(&pool_stats_.trimmed,  __ATOMIC_RELAXED);
+    stats->bytes    = __atomic_load_n(&pool_bytes_,          __ATOMIC_RELAXED);
+}
+
 SafeStack* SafeStackCtor()
 {
-    SafeStack* safe_stack = (SafeStack*) calloc(1, sizeof(*safe_stack));
-    int res = 0;
-    LOG_CATCH_ERROR({res = StackCtor(&safe_stack->stack);}, res == 0, return NULL);
-    safe_stack->canary_start = CANARY ^ HASH_KEY;
-    safe_stack->canary_end   = CANARY ^ HASH_KEY;
-    return (SafeStack*)((hash_t)safe_stack ^ HASH_KEY);
+    return SafeStackCtorFlags(SAFE_STACK_INT32, 0);
+}
+
+SafeStack* SafeStackCtorElement(SafeStackElement element)
+{
+    return SafeStackCtorFlags(element, 0);
 }
 
+SafeStack* SafeStackCtorFlags(SafeStackElement element, unsigned int flags)
+{
+    LOG_ASSERT(MSG_ERROR, element >= SAFE_STACK_INT8 && element <= SAFE_STACK_DOUBLE,
+                                                                            return NULL);
+
+    safe_stack_t* safe_stack = NULL;
+    if (flags & SAFE_STACK_POOLED)
+    {
+        safe_stack = PoolTake_(element);
+        if (safe_stack) POOL_STAT_INC(hits);
+        else            POOL_STAT_INC(misses);
+    }
+
+    if (!safe_stack)
+        safe_stack = SafeStackCreate_(element);
+    if (!safe_stack)
+        return NULL;
+
+    safe_stack->flags     = flags & (SAFE_STACK_CONCURRENT | SAFE_STACK_POOLED);
+    safe_stack->lock      = {};
+    safe_stack->top_valid = 0;
+    safe_stack->top       = 0;
+
+    /* Reused stack gets new generation, so that its old handles stay invalid */
+    handle_t handle = HandleAlloc(&safe_stacks, safe_stack);
+    if (!handle)
+    {
+        log_message(MSG_ERROR, "Too many live stacks");
+        SafeStackDestroy_(safe_stack);
+        return NULL;
+    }
+
+    return (SafeStack*)(uintptr_t)handle;
+}
+
+
+unsigned int SafeStackSetProtection(SafeStack* safe_stack, unsigned int level)
+{
+    safe_stack_t* stack = SafeStackLookup_(safe_stack);
+    if (!stack) return STK_BAD_PTR;
+
+    SafeStackBeginWrite_(stack);
+    unsigned int flags = SafeStackVisit_(stack, [level](auto* typed)
+        {
+            return StackSetProtection(typed, level);
+        });
+    SafeStackEndWrite_(stack);
+
+    return flags;
+}
 
 void SafeStackDtor(SafeStack* safe_stack)
 {
-    safe_stack = SafeStackDecrypt_(safe_stack);
-    if (!safe_stack) return;
-    StackDtor(&safe_stack->stack);
-    free(safe_stack);
+    safe_stack_t* stack = (safe_stack_t*)HandleFree(&safe_stacks,
+                                                    SafeStackHandle_(safe_stack));
+    LOG_ASSERT(MSG_ERROR, stack != NULL,
+        {
+            log_message(MSG_ERROR, "Invalid stack handle %p", safe_stack);
+            return;
+        });
+
+    if (stack->queue)
+    {
+        /* Operations still queued will never be executed */
+        ring_command command = {};
+        while (RingPopN(stack->queue, &command, 1))
+            SafeStackComplete_(&command, STK_BAD_PTR);
+
+        RingDtor(stack->queue);
+        free(stack->queue);
+        stack->queue = NULL;
+    }
+
+    if ((stack->flags & SAFE_STACK_POOLED) && PoolPut_(stack) == 0)
+        return;
+
+    SafeStackDestroy_(stack);
 }
 
-int SafeStackPop(SafeStack* safe_stack, unsigned int *err)
+/**
+ * @brief 
+ * Push integer values, some of which are poison, replacing
+ * poison with substitute. Called with stack locked for writing
+ */
+template <typename T>
+static unsigned int SafeStackPushSentinels_(safe_stack_t* stack, DynamicStack<T>* typed,
+                                            const T* values, size_t size, size_t count)
 {
-    safe_stack = SafeStackDecrypt_(safe_stack);
-    if (!safe_stack)
+    /* Bitmap is grown first, so that marking pushed slots cannot fail */
+    if (SentinelReserve_(stack, size + count) != 0)
+        return STK_NO_MEMORY;
+
+    T  local[SAFE_STACK_BATCH] = {};
+    T* stored = count <= SAFE_STACK_BATCH ? local : (T*)calloc(count, sizeof(T));
+    if (!stored) return STK_NO_MEMORY;
+
+    SentinelSubstitute_(values, stored, count);
+    unsigned int err = StackPushN(typed, stored, count);
+
+    if (stored != local)
+        free(stored);
+    return err;
+}
+
+unsigned int SafeStackPushValue(SafeStack* safe_stack, SafeStackElement element,
+                                                       const void* value)
+{
+    return SafeStackPushValues(safe_stack, element, value, 1);
+}
+
+unsigned int SafeStackPopValue(SafeStack* safe_stack, SafeStackElement element,
+                                                      void* value)
+{
+    return SafeStackPopValues(safe_stack, element, value, 1);
+}
+
+unsigned int SafeStackPeekValue(SafeStack* safe_stack, SafeStackElement element,
+                                                       void* value)
+{
+    safe_stack_t* stack = SafeStackLookupOf_(safe_stack, element);
+    if (!stack) return STK_BAD_PTR;
+    if (!value) return STK_BAD_PTR;
+
+    if (!(stack->flags & SAFE_STACK_CONCURRENT))
+        return SafeStackPeekValues(safe_stack, element, value, 1);
+
+    /* Top is read without lock and is valid if no write overlapped */
+    for (size_t i = 0; i < PEEK_ATTEMPTS; i++)
     {
-        TRY_ASSIGN_PTR(err, STK_BAD_PTR);
-        return 0;
-    };
-    return StackPopCopy(&safe_stack->stack, err).value;
+        unsigned int seq = __atomic_load_n(&stack->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1) continue;
+
+        unsigned long long top   = __atomic_load_n(&stack->top,       __ATOMIC_ACQUIRE);
+        unsigned int       valid = __atomic_load_n(&stack->top_valid, __ATOMIC_ACQUIRE);
+
+        if (__atomic_load_n(&stack->seq, __ATOMIC_RELAXED) != seq)
+            continue;
+
+        if (!valid) return STK_EMPTY;
+
+        memcpy(value, &top, SafeStackElementSize_(element));
+        return STK_NO_ERROR;
+    }
+
+    return SafeStackPeekValues(safe_stack, element, value, 1);
+}
+
+unsigned int SafeStackPushValues(SafeStack* safe_stack, SafeStackElement element,
+                                                        const void* values, size_t count)
+{
+    safe_stack_t* stack = SafeStackLookupOf_(safe_stack, element);
+    if (!stack) return STK_BAD_PTR;
+    if (count && !values) return STK_BAD_PTR;
+
+    return SafeStackVisit_(stack, [stack, values, count](auto* typed) -> unsigned int
+        {
+            typedef safe_element_t_<decltype(typed)> elem_t;
+            const elem_t* elements = (const elem_t*)values;
+
+            SafeStackBeginWrite_(stack);
+            const elem_t* data = NULL;
+            size_t size = DynamicStackGetOps_(typed)->view(typed->storage_, &data);
+
+            unsigned int flags = 0;
+            if (!SAFE_STACK_FULL_RANGE_<elem_t> || FindPoison_(elements, count) == count)
+                flags = StackPushN(typed, elements, count);
+            else
+                flags = SafeStackPushSentinels_(stack, typed, elements, size, count);
+
+            if (!flags)
+                SentinelMark_(stack, elements, size, count);
+            SafeStackEndWrite_(stack);
+
+            return flags;
+        });
+}
+
+unsigned int SafeStackPopValues(SafeStack* safe_stack, SafeStackElement element,
+                                                       void* values, size_t count)
+{
+    safe_stack_t* stack = SafeStackLookupOf_(safe_stack, element);
+    if (!stack) return STK_BAD_PTR;
+
+    SafeStackBeginWrite_(stack);
+    unsigned int flags = SafeStackVisit_(stack, [stack, values, count](auto* typed)
+        {
+            typedef safe_element_t_<decltype(typed)> elem_t;
+
+            const elem_t* data = NULL;
+            size_t size = DynamicStackGetOps_(typed)->view(typed->storage_, &data);
+
+            unsigned int err = StackPopN(typed, (elem_t*)values, count);
+            if (!err && values)
+                SentinelRestore_(stack, (elem_t*)values, size - count, count);
+            return err;
+        });
+    SafeStackEndWrite_(stack);
+
+    return flags;
+}
+
+unsigned int SafeStackPeekValues(SafeStack* safe_stack, SafeStackElement element,
+                                                        void* values, size_t count)
+{
+    safe_stack_t* stack = SafeStackLookupOf_(safe_stack, element);
+    if (!stack) return STK_BAD_PTR;
+    if (count && !values) return STK_BAD_PTR;
+
+    SafeStackBeginRead_(stack);
+    unsigned int flags = SafeStackVisit_(stack, [stack, values, count](auto* typed)
+        {
+            typedef safe_element_t_<decltype(typed)> elem_t;
+
+            const elem_t* data = NULL;
+            size_t size = DynamicStackGetOps_(typed)->view(typed->storage_, &data);
+
+            unsigned int err = StackPeekN(typed, (elem_t*)values, count);
+            if (!err)
+                SentinelRestore_(stack, (elem_t*)values, size - count, count);
+            return err;
+        });
+    SafeStackEndRead_(stack);
+
+    return flags;
+}
+
+int SafeStackPop(SafeStack* safe_stack, unsigned int *err)
+{
+    int value = 0;
+    unsigned int flags = SafeStackPopValue(safe_stack, SAFE_STACK_INT32, &value);
+    TRY_ASSIGN_PTR(err, flags);
+    return flags ? 0 : value;
 }
 
 int SafeStackPush(SafeStack* safe_stack, int value, unsigned int *err)
 {
-    safe_stack = SafeStackDecrypt_(safe_stack);
-    if (!safe_stack)
-    {
-        TRY_ASSIGN_PTR(err, STK_BAD_PTR);
-        return 0;
-    };
-    unsigned int flags = StackPush(&safe_stack->stack, {.value = value, .is_poison = 0});
+    unsigned int flags = SafeStackPushValue(safe_stack, SAFE_STACK_INT32, &value);
     TRY_ASSIGN_PTR(err, flags);
-    return value;
+    return flags ? 0 : value;
 }
 
 int SafeStackPeek(SafeStack* safe_stack, unsigned int *err)
 {
-    safe_stack = SafeStackDecrypt_(safe_stack);
-    if (!safe_stack)
+    int value = 0;
+    unsigned int flags = SafeStackPeekValue(safe_stack, SAFE_STACK_INT32, &value);
+    TRY_ASSIGN_PTR(err, flags);
+    return flags ? 0 : value;
+}
+
+size_t SafeStackPushN(SafeStack* safe_stack, const int* values, size_t count,
+                                                            unsigned int *err)
+{
+    unsigned int flags = SafeStackPushValues(safe_stack, SAFE_STACK_INT32, values, count);
+    TRY_ASSIGN_PTR(err, flags);
+    return flags ? 0 : count;
+}
+
+size_t SafeStackPopN(SafeStack* safe_stack, int* values, size_t count,
+                                                            unsigned int *err)
+{
+    unsigned int flags = SafeStackPopValues(safe_stack, SAFE_STACK_INT32, values, count);
+    TRY_ASSIGN_PTR(err, flags);
+    return flags ? 0 : count;
+}
+
+size_t SafeStackPeekN(SafeStack* safe_stack, int* values, size_t count,
+                                                            unsigned int *err)
+{
+    unsigned int flags = SafeStackPeekValues(safe_stack, SAFE_STACK_INT32, values, count);
+    TRY_ASSIGN_PTR(err, flags);
+    return flags ? 0 : count;
+}
+
+unsigned int SafeStackAttachQueue(SafeStack* safe_stack, size_t capacity)
+{
+    safe_stack_t* stack = SafeStackLookup_(safe_stack);
+    if (!stack) return STK_BAD_PTR;
+    if (__atomic_load_n(&stack->queue, __ATOMIC_ACQUIRE)) return STK_NO_ERROR;
+
+    command_ring* queue = (command_ring*) calloc(1, sizeof(*queue));
+    if (!queue) return STK_NO_MEMORY;
+
+    if (RingCtor(queue, capacity) != 0)
     {
-        TRY_ASSIGN_PTR(err, STK_BAD_PTR);
-        return 0;
+        free(queue);
+        return STK_NO_MEMORY;
     }
-    return StackPeek(&safe_stack->stack, err)->value;
+
+    /* Concurrent attach may have published its queue first */
+    command_ring* expected = NULL;
+    if (!__atomic_compare_exchange_n(&stack->queue, &expected, queue, false,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+    {
+        RingDtor(queue);
+        free(queue);
+    }
+
+    return STK_NO_ERROR;
 }
 
-void SafeStackDump(SafeStack* safe_stack)
+unsigned int SafeStackEnqueue(SafeStack* safe_stack, SafeStackElement element,
+                                                     SafeStackCommand command,
+                                                     void* value,
+                                                     safe_stack_completion* completion)
 {
-    safe_stack = SafeStackDecrypt_(safe_stack);
-    StackDump(&safe_stack->stack);
+    safe_stack_t* stack = SafeStackLookupOf_(safe_stack, element);
+    if (!stack) return STK_BAD_PTR;
+
+    command_ring* queue = __atomic_load_n(&stack->queue, __ATOMIC_ACQUIRE);
+    if (!queue) return STK_BAD_PTR;
+    if (command > SAFE_STACK_CMD_PEEK) return STK_BAD_PTR;
+    if (command != SAFE_STACK_CMD_POP && !value) return STK_BAD_PTR;
+
+    ring_command queued = {
+        .op         = command,
+        .value      = 0,
+        .result     = value,
+        .completion = completion
+    };
+
+    if (command == SAFE_STACK_CMD_PUSH)
+    {
+        memcpy(&queued.value, value, SafeStackElementSize_(element));
+        queued.result = NULL;
+    }
+
+    if (completion)
+        *completion = {};
+
+    if (RingPush(queue, &queued) != 0)
+        return STK_NO_MEMORY;
+
+    return STK_NO_ERROR;
 }
 
+/**
+ * @brief 
+ * Execute batch of queued operations. Pushes and pops cancelling
+ * each other are executed in local buffer, then stack is changed
+ * by at most one `StackReplaceN`. Elements below local buffer are
+ * read directly from stack buffer after one check. Results are
+ * delivered only after stack was changed, so that failed batch
+ * has no visible effect
+ */
+template <typename T>
+static void SafeStackRunBatch_(safe_stack_t* stack, DynamicStack<T>* typed,
+                               const ring_command* commands, size_t count)
+{
+    T            pushed[SAFE_STACK_BATCH] = {};     /* pushed elements, not yet in stack */
+    T            below [SAFE_STACK_BATCH] = {};     /* top elements of stack, top is last */
+    T            results[SAFE_STACK_BATCH] = {};    /* values read by pops and peeks */
+    unsigned int errors[SAFE_STACK_BATCH] = {};
+
+    /* Find number of stack elements reached by batch */
+    size_t pushed_size = 0, depth = 0, needed = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        T value = {};
+        memcpy(&value, &commands[i].value, sizeof(T));
+
+        switch (commands[i].op)
+        {
+            case SAFE_STACK_CMD_PUSH:
+                if (!SAFE_STACK_FULL_RANGE_<T> && ElementTraits<T>::IsPoison(value))
+                    errors[i] = STK_POISON_VALUE;
+                else
+                    pushed_size++;
+                break;
+            case SAFE_STACK_CMD_POP:
+                if (pushed_size) pushed_size--;
+                else             needed = std::max(needed, ++depth);
+                break;
+            case SAFE_STACK_CMD_PEEK:
+                if (!pushed_size) needed = std::max(needed, depth + 1);
+                break;
+            default:
+                errors[i] = STK_BAD_PTR;
+                break;
+        }
+    }
+
+    /* Stack is checked here only if batch reads it, `StackReplaceN`
+     * checks it again if batch changes it */
+    unsigned int err = needed ? StackAssert(typed) : STK_NO_ERROR;
+
+    const T* data = NULL;
+    size_t size      = DynamicStackGetOps_(typed)->view(typed->storage_, &data);
+    size_t available = err ? 0 : std::min(needed, size);
+
+    if (available)
+    {
+        memcpy(below, data + size - available, available*sizeof(T));
+        SentinelRestore_(stack, below, size - available, available);
+    }
+
+    size_t consumed = 0;
+    pushed_size = 0;
+    for (size_t i = 0; i < count && !err; i++)
+    {
+        if (errors[i]) continue;
+
+        const T* top = pushed_size          ? &pushed[pushed_size - 1]
+                     : consumed < available ? &below[available - 1 - consumed]
+                     : NULL;
+
+        switch (commands[i].op)
+        {
+            case SAFE_STACK_CMD_PUSH:
+                memcpy(&pushed[pushed_size++], &commands[i].value, sizeof(T));
+                break;
+            case SAFE_STACK_CMD_POP:
+            case SAFE_STACK_CMD_PEEK:
+                if (!top)
+                {
+                    errors[i] = STK_EMPTY;
+                    break;
+                }
+                results[i] = *top;
+                if (commands[i].op == SAFE_STACK_CMD_POP)
+                {
+                    if (pushed_size) pushed_size--;
+                    else             consumed++;
+                }
+                break;
+            default:
+                break;
+        }
+    }
+
+    /* Elements below are no longer needed and hold pushed elements as stored */
+    size_t base = size - consumed;
+    if (!err && FindPoison_(pushed, pushed_size) != pushed_size &&
+        SentinelReserve_(stack, base + pushed_size) != 0)
+        err = STK_NO_MEMORY;
+
+    if (!err && (consumed || pushed_size))
+    {
+        SentinelSubstitute_(pushed, below, pushed_size);
+        err = StackReplaceN(typed, consumed, below, pushed_size);
+        if (!err)
+            SentinelMark_(stack, pushed, base, pushed_size);
+    }
+
+    /* Batch fails as a whole if stack could not be changed */
+    for (size_t i = 0; i < count; i++)
+    {
+        int is_read = commands[i].op == SAFE_STACK_CMD_POP ||
+                      commands[i].op == SAFE_STACK_CMD_PEEK;
+        if (!err && !errors[i] && is_read && commands[i].result)
+            memcpy(commands[i].result, &results[i], sizeof(T));
+
+        SafeStackComplete_(&commands[i], errors[i] ? errors[i] : err);
+    }
+}
+
+size_t SafeStackDrain(SafeStack* safe_stack, size_t max_commands)
+{
+    safe_stack_t* stack = SafeStackLookup_(safe_stack);
+    if (!stack) return 0;
+
+    command_ring* queue = __atomic_load_n(&stack->queue, __ATOMIC_ACQUIRE);
+    if (!queue) return 0;
+
+    ring_command commands[SAFE_STACK_BATCH] = {};
+    size_t executed = 0;
+
+    while (executed < max_commands)
+    {
+        size_t count = RingPopN(queue, commands,
+                                std::min(SAFE_STACK_BATCH, max_commands - executed));
+        if (!count) break;
+
+        SafeStackBeginWrite_(stack);
+        SafeStackVisit_(stack, [stack, &commands, count](auto* typed)
+            {
+                SafeStackRunBatch_(stack, typed, commands, count);
+                return 0u;
+            });
+        SafeStackEndWrite_(stack);
+
+        executed += count;
+    }
+
+    return executed;
+}
+
+void SafeStackDump(SafeStack* safe_stack)
+{
+    safe_stack_t* stack = SafeStackLookup_(safe_stack);
+    if (!stack) return;
+    SafeStackBeginRead_(stack);
+    SafeStackVisit_(stack, [](auto* typed) { return StackDump(typed); });
+    SafeStackEndRead_(stack);
+}
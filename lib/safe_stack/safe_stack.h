@@ -1,22 +1,142 @@
 #ifndef SAFE_STACK_H
 #define SAFE_STACK_H
 
+#include <stddef.h>
+#include <stdint.h>
+
 /**
  * @brief 
- * Safe `Stack` wrapper for type `int`
+ * Safe `Stack` wrapper for elements of several types.
+ * `SafeStack*` is opaque handle and not an address
+ * 
+ * @note Integer elements can hold any value of their type. The most
+ * negative one (e.g. `INT32_MIN`) is used as poison by underlying
+ * `Stack`, so it is stored as zero and marked in per-stack bitmap,
+ * which is allocated only once such value is pushed. Floating-point
+ * elements can hold any value except for one signalling NaN.
+ * Pushing such value fails with `STK_POISON_VALUE`
  */
 struct SafeStack;
 
 /**
  * @brief 
- * Construct `SafeStack` instance
- * @return Constructed instance pointer
+ * Type of `SafeStack` elements. Unsigned integers are stored
+ * as signed integers of the same width
+ */
+enum SafeStackElement
+{
+    SAFE_STACK_INT8,
+    SAFE_STACK_INT16,
+    SAFE_STACK_INT32,
+    SAFE_STACK_INT64,
+    SAFE_STACK_FLOAT,
+    SAFE_STACK_DOUBLE
+};
+
+/**
+ * @brief 
+ * Construct `SafeStack` instance of `int` elements
+ * @return Constructed instance handle, `NULL` upon failure
  */
 SafeStack* SafeStackCtor();
 
 /**
  * @brief 
- * Destroy `SafeStack` instance. Free associated resources
+ * Construct `SafeStack` instance of elements of given type
+ * @param[in] element Element type
+ * @return Constructed instance handle, `NULL` upon failure
+ */
+SafeStack* SafeStackCtorElement(SafeStackElement element);
+
+/**
+ * @brief 
+ * `SafeStack` construction flags
+ */
+enum SafeStackFlags : unsigned int
+{
+    /**
+     * Stack may be used by several threads at once. Calls are
+     * serialized with per-stack lock, `SafeStackPeek` and
+     * `SafeStackPeekValue` usually take no lock. Other
+     * stacks are not locked at all.
+     * `SafeStackDtor` must not run concurrently with other calls
+     */
+    SAFE_STACK_CONCURRENT = 01,
+
+    /**
+     * Stack is taken from and returned to pool of calling thread,
+     * so that construction and destruction allocate no memory.
+     * Stacks are cleared, checked and get new handle upon reuse.
+     * Stacks with changed protection level are not pooled
+     */
+    SAFE_STACK_POOLED     = 02,
+};
+
+/**
+ * @brief 
+ * Default limit of memory held by `SafeStack` pools of all threads
+ */
+const size_t SAFE_STACK_POOL_LIMIT = (size_t)1 << 20;
+
+/**
+ * @brief 
+ * `SafeStack` pool statistics, summed across all threads
+ */
+struct safe_stack_pool_stats
+{
+    size_t hits;        /* stacks constructed from pool */
+    size_t misses;      /* pooled stacks constructed anew */
+    size_t rejected;    /* stacks, which failed check upon release or reuse */
+    size_t trimmed;     /* stacks freed to stay under memory limit */
+    size_t bytes;       /* memory held by pools */
+};
+
+/**
+ * @brief 
+ * Set limit of memory held by `SafeStack` pools of all threads.
+ * Pool of calling thread is trimmed immediately, pools of other
+ * threads are trimmed upon their next `SafeStackDtor`
+ * @param[in] bytes Memory limit. Zero disables pooling
+ */
+void SafeStackPoolSetLimit(size_t bytes);
+
+/**
+ * @brief 
+ * Free all stacks held by pool of calling thread
+ */
+void SafeStackPoolTrim(void);
+
+/**
+ * @brief 
+ * Get `SafeStack` pool statistics
+ * @param[out] stats Statistics
+ */
+void SafeStackPoolGetStats(safe_stack_pool_stats* stats);
+
+/**
+ * @brief 
+ * Construct `SafeStack` instance of elements of given type
+ * @param[in] element Element type
+ * @param[in] flags Some combination of `SafeStackFlags`
+ * @return Constructed instance handle, `NULL` upon failure
+ */
+SafeStack* SafeStackCtorFlags(SafeStackElement element, unsigned int flags);
+
+/**
+ * @brief 
+ * Change protection level of `SafeStack`. Stacks are created
+ * with canary and hash protection
+ * @param[inout] safe_stack `SafeStack` instance
+ * @param[in] level Some combination of `STK_CANARY_PROT`,
+ * `STK_HASH_PROT` and `STK_DEBUG_INFO`
+ * @return Error flags
+ */
+unsigned int SafeStackSetProtection(SafeStack* safe_stack, unsigned int level);
+
+/**
+ * @brief 
+ * Destroy `SafeStack` instance. Free associated resources.
+ * Operations still queued are completed with `STK_BAD_PTR`
  * @param[inout] safe_stack `SafeStack` instance
  */
 void SafeStackDtor(SafeStack* safe_stack);
@@ -49,6 +169,269 @@ int SafeStackPush(SafeStack* safe_stack, int value, unsigned int *err);
  */
 int SafeStackPeek(SafeStack* safe_stack, unsigned int *err);
 
+/**
+ * @brief 
+ * Add several values to stack at once
+ * @param[inout] safe_stack `SafeStack` instance
+ * @param[in] values Added values, the last one becomes top
+ * @param[in] count Number of added values
+ * @param[out] err Error flags. Ignored if set to `NULL`
+ * @return Number of added values, i.e. `count` upon success, 0 otherwise
+ */
+size_t SafeStackPushN(SafeStack* safe_stack, const int* values, size_t count,
+                                                            unsigned int *err);
+
+/**
+ * @brief 
+ * Remove several top values from stack at once
+ * @param[inout] safe_stack `SafeStack` instance
+ * @param[out] values Removed values in the order they were pushed,
+ * i.e. top value is the last one. Ignored if set to `NULL`
+ * @param[in] count Number of removed values
+ * @param[out] err Error flags. Ignored if set to `NULL`
+ * @return Number of removed values, i.e. `count` upon success, 0 otherwise
+ */
+size_t SafeStackPopN(SafeStack* safe_stack, int* values, size_t count,
+                                                            unsigned int *err);
+
+/**
+ * @brief 
+ * Copy several top values from stack at once
+ * @param[inout] safe_stack `SafeStack` instance
+ * @param[out] values Copied values in the order they were pushed,
+ * i.e. top value is the last one
+ * @param[in] count Number of copied values
+ * @param[out] err Error flags. Ignored if set to `NULL`
+ * @return Number of copied values, i.e. `count` upon success, 0 otherwise
+ */
+size_t SafeStackPeekN(SafeStack* safe_stack, int* values, size_t count,
+                                                            unsigned int *err);
+
+/**
+ * @brief 
+ * Add element to stack
+ * @param[inout] safe_stack `SafeStack` instance
+ * @param[in] element Element type, must match stack element type
+ * @param[in] value Added element
+ * @return Error flags
+ */
+unsigned int SafeStackPushValue(SafeStack* safe_stack, SafeStackElement element,
+                                                       const void* value);
+
+/**
+ * @brief 
+ * Remove top element from stack
+ * @param[inout] safe_stack `SafeStack` instance
+ * @param[in] element Element type, must match stack element type
+ * @param[out] value Removed element. Ignored if set to `NULL`
+ * @return Error flags
+ */
+unsigned int SafeStackPopValue (SafeStack* safe_stack, SafeStackElement element,
+                                                       void* value);
+
+/**
+ * @brief 
+ * Copy top element from stack
+ * @param[inout] safe_stack `SafeStack` instance
+ * @param[in] element Element type, must match stack element type
+ * @param[out] value Copied element
+ * @return Error flags
+ */
+unsigned int SafeStackPeekValue(SafeStack* safe_stack, SafeStackElement element,
+                                                       void* value);
+
+/**
+ * @brief 
+ * Add several elements to stack at once
+ * @param[inout] safe_stack `SafeStack` instance
+ * @param[in] element Element type, must match stack element type
+ * @param[in] values Added elements, the last one becomes top
+ * @param[in] count Number of added elements
+ * @return Error flags
+ */
+unsigned int SafeStackPushValues(SafeStack* safe_stack, SafeStackElement element,
+                                                        const void* values, size_t count);
+
+/**
+ * @brief 
+ * Remove several top elements from stack at once
+ * @param[inout] safe_stack `SafeStack` instance
+ * @param[in] element Element type, must match stack element type
+ * @param[out] values Removed elements, top one is the last.
+ * Ignored if set to `NULL`
+ * @param[in] count Number of removed elements
+ * @return Error flags
+ */
+unsigned int SafeStackPopValues (SafeStack* safe_stack, SafeStackElement element,
+                                                        void* values, size_t count);
+
+/**
+ * @brief 
+ * Copy several top elements from stack at once
+ * @param[inout] safe_stack `SafeStack` instance
+ * @param[in] element Element type, must match stack element type
+ * @param[out] values Copied elements, top one is the last
+ * @param[in] count Number of copied elements
+ * @return Error flags
+ */
+unsigned int SafeStackPeekValues(SafeStack* safe_stack, SafeStackElement element,
+                                                        void* values, size_t count);
+
+/**
+ * @brief 
+ * `SafeStackElement` of type `T`
+ */
+template <typename T>
+struct SafeStackElementOf;
+
+template <> struct SafeStackElementOf<int8_t>   { static const SafeStackElement value = SAFE_STACK_INT8;   };
+template <> struct SafeStackElementOf<uint8_t>  { static const SafeStackElement value = SAFE_STACK_INT8;   };
+template <> struct SafeStackElementOf<int16_t>  { static const SafeStackElement value = SAFE_STACK_INT16;  };
+template <> struct SafeStackElementOf<uint16_t> { static const SafeStackElement value = SAFE_STACK_INT16;  };
+template <> struct SafeStackElementOf<int32_t>  { static const SafeStackElement value = SAFE_STACK_INT32;  };
+template <> struct SafeStackElementOf<uint32_t> { static const SafeStackElement value = SAFE_STACK_INT32;  };
+template <> struct SafeStackElementOf<int64_t>  { static const SafeStackElement value = SAFE_STACK_INT64;  };
+template <> struct SafeStackElementOf<uint64_t> { static const SafeStackElement value = SAFE_STACK_INT64;  };
+template <> struct SafeStackElementOf<float>    { static const SafeStackElement value = SAFE_STACK_FLOAT;  };
+template <> struct SafeStackElementOf<double>   { static const SafeStackElement value = SAFE_STACK_DOUBLE; };
+
+/**
+ * @brief 
+ * Construct `SafeStack` instance of elements of type `T`
+ */
+template <typename T>
+inline SafeStack* SafeStackCtorOf()
+{
+    return SafeStackCtorElement(SafeStackElementOf<T>::value);
+}
+
+/**
+ * @brief 
+ * Add element of type `T` to stack
+ */
+template <typename T>
+inline unsigned int SafeStackPushOf(SafeStack* safe_stack, const T& value)
+{
+    return SafeStackPushValue(safe_stack, SafeStackElementOf<T>::value, &value);
+}
+
+/**
+ * @brief 
+ * Remove top element of type `T` from stack
+ * @param[out] err Error flags. Ignored if set to `NULL`
+ */
+template <typename T>
+inline T SafeStackPopOf(SafeStack* safe_stack, unsigned int* err = NULL)
+{
+    T value = {};
+    unsigned int flags = SafeStackPopValue(safe_stack, SafeStackElementOf<T>::value, &value);
+    if (err) *err = flags;
+    return value;
+}
+
+/**
+ * @brief 
+ * Copy top element of type `T` from stack
+ * @param[out] err Error flags. Ignored if set to `NULL`
+ */
+template <typename T>
+inline T SafeStackPeekOf(SafeStack* safe_stack, unsigned int* err = NULL)
+{
+    T value = {};
+    unsigned int flags = SafeStackPeekValue(safe_stack, SafeStackElementOf<T>::value, &value);
+    if (err) *err = flags;
+    return value;
+}
+
+/**
+ * @brief 
+ * Operation queued with `SafeStackEnqueue`
+ */
+enum SafeStackCommand : unsigned int
+{
+    SAFE_STACK_CMD_PUSH,
+    SAFE_STACK_CMD_POP,
+    SAFE_STACK_CMD_PEEK
+};
+
+/**
+ * @brief 
+ * Result of queued operation. Filled by thread,
+ * which drains queue
+ */
+struct safe_stack_completion
+{
+    unsigned int done;  /* non-zero when operation is executed */
+    unsigned int err;   /* error flags of operation */
+};
+
+/**
+ * @brief 
+ * Maximum number of commands executed as one batch
+ */
+const size_t SAFE_STACK_BATCH = 64;
+
+/**
+ * @brief 
+ * Attach command queue to stack, so that other threads may
+ * enqueue operations, which are executed by stack owner.
+ * Must be called before queue is used
+ * 
+ * @param[inout] safe_stack `SafeStack` instance
+ * @param[in] capacity Minimal number of queued commands
+ * @return Error flags
+ */
+unsigned int SafeStackAttachQueue(SafeStack* safe_stack, size_t capacity);
+
+/**
+ * @brief 
+ * Queue operation on stack. May be called by several threads
+ * at once. Operation is executed by `SafeStackDrain`
+ * 
+ * @param[inout] safe_stack `SafeStack` instance with attached queue
+ * @param[in] element Element type, must match stack element type
+ * @param[in] command Queued operation
+ * @param[inout] value Pushed element for `SAFE_STACK_CMD_PUSH`, where
+ * removed or copied element is written otherwise. Must stay valid
+ * until operation is completed. Ignored for pop if set to `NULL`
+ * @param[out] completion Where operation result is reported.
+ * Ignored if set to `NULL`
+ * @return Error flags, `STK_NO_MEMORY` if queue is full
+ */
+unsigned int SafeStackEnqueue(SafeStack* safe_stack, SafeStackElement element,
+                                                     SafeStackCommand command,
+                                                     void* value,
+                                                     safe_stack_completion* completion);
+
+/**
+ * @brief 
+ * Execute queued operations in batches of at most `SAFE_STACK_BATCH`.
+ * Stack is checked at most twice per batch, when batch reads it and
+ * when it changes it, instead of once per operation. Both checks
+ * take constant time, unless full check is due by stack schedule.
+ * Batch is applied atomically: if stack cannot be changed, none
+ * of its operations take effect or deliver values, and all of them
+ * complete with the error. Must be called by one thread at a time
+ * 
+ * @param[inout] safe_stack `SafeStack` instance with attached queue
+ * @param[in] max_commands Maximum number of executed operations
+ * @return Number of executed operations
+ */
+size_t SafeStackDrain(SafeStack* safe_stack, size_t max_commands);
+
+/**
+ * @brief 
+ * Check whether queued operation is completed
+ * 
+ * @param[in] completion Operation completion
+ * @return Non-zero if operation is completed. Its result
+ * may be read after that
+ */
+inline int SafeStackIsCompleted(const safe_stack_completion* completion)
+{
+    return (int)__atomic_load_n(&completion->done, __ATOMIC_ACQUIRE);
+}
+
 /**
  * @brief 
  * Print contents of stack
@@ -0,0 +1,224 @@
+#ifndef CONCURRENT_STACK_H
+#define CONCURRENT_STACK_H
+
+/**
+ * @file _concurrent_stack_interface.h
+ * @author MeerkatBoss
+ * @brief Lock-free stack function definitions
+ * @version 0.1
+ * @date 2022-10-06
+ * 
+ * @warning This header is internal, It IS NOT supposed
+ * to be included outside the scope of the library.
+ * 
+ * @note Stack is a Treiber stack of nodes. Nodes are addressed
+ * by 32-bit indices into arena, which is never returned to system
+ * while stack exists, so that node may be safely read after it
+ * was popped by another thread. Stack head is index combined with
+ * modification counter, which prevents ABA problem.
+ * 
+ * @note Protection is configured with the same policies as for
+ * `TypedStack`. Nodes are framed with canaries and carry checksum
+ * of stored value, both are verified when node is popped. Freed
+ * nodes are poisoned and verified upon reuse.
+ * 
+ */
+
+#include <stddef.h>
+
+#include "_stack_interface.h"
+
+/**
+ * @brief 
+ * Index of node in arena and modification counter
+ * packed into single word. Zero index means no node
+ */
+typedef unsigned long long tagged_index_;
+
+/**
+ * @brief 
+ * Number of arena segments. Segment `k` holds
+ * `CSTK_SEGMENT_BASE << k` nodes
+ */
+const size_t CSTK_SEGMENT_COUNT = 25;
+
+const size_t CSTK_SEGMENT_BASE  = 64;
+
+/**
+ * @brief 
+ * Number of elimination slots, where colliding push and
+ * pop may exchange element without touching stack head
+ */
+const size_t CSTK_ELIMINATION_SLOTS = 8;
+
+/**
+ * @brief 
+ * Size of cache line, variables modified by different
+ * threads are placed on different lines
+ */
+const size_t CSTK_CACHE_LINE = 64;
+
+/**
+ * @brief 
+ * Lock-free stack node
+ */
+template <typename T, typename Policy>
+struct ConcurrentNode_
+{
+    [[no_unique_address]]
+    OptionalField_<Policy::has_canary,  canary_t,   0> canary_start_;
+
+    unsigned int        next;           /* index of next node,
+                                            accessed atomically */
+    T                   value;          /* stored element */
+
+    [[no_unique_address]]
+    OptionalField_<Policy::has_hash,    hash_t,     1> checksum_;
+                                                        /* hash of `value` */
+    [[no_unique_address]]
+    OptionalField_<Policy::has_canary,  canary_t,   2> canary_end_;
+};
+
+/**
+ * @brief 
+ * Elimination slot, padded to cache line
+ */
+struct alignas(CSTK_CACHE_LINE) elimination_slot_
+{
+    tagged_index_ offer;                /* offered node, accessed atomically */
+};
+
+/**
+ * @brief 
+ * Lock-free LIFO data structure. All operations except
+ * construction and destruction may be called concurrently
+ * 
+ * @tparam T      stored type. `ElementTraits<T>` must be defined
+ * @tparam Policy protection policy, e.g. `StackProtection<Level>`
+ */
+template <typename T, typename Policy = StackProtection<STK_DEFAULT_PROT>>
+struct ConcurrentStack
+{
+    typedef T                           element_type;
+    typedef Policy                      policy_type;
+    typedef ConcurrentNode_<T, Policy>  node_type;
+
+    [[no_unique_address]]
+    OptionalField_<Policy::has_canary,      canary_t,       0> canary_start_;
+
+    alignas(CSTK_CACHE_LINE)
+    tagged_index_       head_;          /* top node */
+    alignas(CSTK_CACHE_LINE)
+    tagged_index_       free_;          /* first free node */
+    alignas(CSTK_CACHE_LINE)
+    unsigned long long  allocated_;     /* number of nodes taken from arena */
+    node_type*          segments_[CSTK_SEGMENT_COUNT];
+                                        /* arena, allocated on demand */
+
+    elimination_slot_   elimination_[CSTK_ELIMINATION_SLOTS];
+
+    [[no_unique_address]]
+    OptionalField_<Policy::has_debug_info,  debug_info_,    3> debug_;
+
+    [[no_unique_address]]
+    OptionalField_<Policy::has_canary,      canary_t,       4> canary_end_;
+};
+
+/**
+ * @brief 
+ * Construct `ConcurrentStack` instance from parameters.
+ * Must not be called concurrently with other operations
+ * @param[out] stack     constructed instance
+ * @param[in]  name      variable name. Used only if
+ *                          policy has debug info
+ * @param[in]  func_name declaring function name. Used only if
+ *                          policy has debug info
+ * @param[in]  file_name declaring file name. Used only if
+ *                          policy has debug info
+ * @param[in]  line_num  declaration line. Used only if
+ *                          policy has debug info
+ * @return zero upon successful construction, non-zero otherwise
+ */
+template <typename T, typename Policy>
+int     ConcurrentStackCtor_    (ConcurrentStack<T, Policy>* stack,
+                                const char* name,
+                                const char* func_name,
+                                const char* file_name,
+                                size_t line_num);
+
+/**
+ * @brief 
+ * Construct `ConcurrentStack`
+ * 
+ * @param[out] stack constructed instance
+ * 
+ * @return zero upon successful construction, non-zero otherwise
+ */
+#define ConcurrentStackCtor(stack)                                  \
+                        ConcurrentStackCtor_(stack,                 \
+                                    #stack + (*#stack == '&'),      \
+                                    __PRETTY_FUNCTION__,            \
+                                    __FILE__, __LINE__);
+
+/**
+ * @brief 
+ * Clean up `ConcurrentStack` instance. Free associated resources.
+ * Must not be called concurrently with other operations
+ * 
+ * @param[inout] stack instance to be cleaned up
+ */
+template <typename T, typename Policy>
+void    ConcurrentStackDtor     (ConcurrentStack<T, Policy>* stack);
+
+/**
+ * @brief 
+ * Add element to stack
+ * 
+ * @param[inout] stack `ConcurrentStack` instance
+ * @param[in] value    value to be added
+ * @return zero upon success, some combination of
+ * `ErrorFlags` otherwise. `STK_POISON_VALUE` if value is poison
+ */
+template <typename T, typename Policy>
+unsigned int ConcurrentStackPush    (ConcurrentStack<T, Policy>* stack,
+                                     std::type_identity_t<T> value);
+
+/**
+ * @brief 
+ * Remove top element from stack
+ * 
+ * @param[inout] stack `ConcurrentStack` instance
+ * @return zero upon success, some combination of
+ * `ErrorFlags` otherwise. `STK_CORRUPTED_DATA` if popped
+ * node is damaged, in which case it is removed from stack
+ * but never reused
+ */
+template <typename T, typename Policy>
+unsigned int ConcurrentStackPop     (ConcurrentStack<T, Policy>* stack);
+
+/**
+ * @brief 
+ * Remove top element from stack
+ * 
+ * @param[inout] stack `ConcurrentStack` instance
+ * @param[out] err Error code, i.e some combination of
+ * `ErrorFlags`. Parameter is ignored if set to NULL
+ * @return Removed value, poison upon failure
+ */
+template <typename T, typename Policy>
+T ConcurrentStackPopCopy            (ConcurrentStack<T, Policy>* stack,
+                                     unsigned int* err = NULL);
+
+/**
+ * @brief 
+ * Check stack header integrity. Nodes are checked
+ * when they are popped or reused
+ * 
+ * @param[in] stack `ConcurrentStack` instance
+ * @return zero if no errors found, some combination
+ * of `ErrorFlags` otherwise
+ */
+template <typename T, typename Policy>
+unsigned int ConcurrentStackCheck   (const ConcurrentStack<T, Policy>* stack);
+
+#endif
@@ -0,0 +1,304 @@
+#ifndef DYNAMIC_STACK_H
+#define DYNAMIC_STACK_H
+
+/**
+ * @file _dynamic_stack_interface.h
+ * @author MeerkatBoss
+ * @brief Dynamically protected stack function definitions
+ * @version 0.1
+ * @date 2022-10-11
+ * 
+ * @warning This header is internal, It IS NOT supposed
+ * to be included outside the scope of the library.
+ * 
+ * @note `DynamicStack` selects protection level upon construction
+ * instead of compilation. Its storage holds `TypedStack` with
+ * `StackProtection<Level>` policy and every operation is dispatched
+ * through operations table of that level. Level is masked before
+ * lookup, so that corrupted level cannot redirect call outside
+ * of table. Unprotected stack pushes, pops and peeks without any
+ * checks, as if it were raw array.
+ * 
+ * @note Protection level of live stack can be changed with
+ * `StackSetProtection`. Elements are copied to buffer of new
+ * level, so change takes time proportional to stack size.
+ * 
+ */
+
+#include <stddef.h>
+
+#include "_stack_interface.h"
+
+/**
+ * @brief 
+ * Protection bits, which can be selected at runtime
+ */
+#define STK_DYNAMIC_PROT (STK_CANARY_PROT | STK_HASH_PROT | STK_DEBUG_INFO)
+
+/**
+ * @brief 
+ * Operations of `DynamicStack` with single protection level.
+ * Every operation takes pointer to `TypedStack` of that level
+ */
+template <typename T>
+struct dynamic_stack_ops_
+{
+    int          (*ctor)    (void* stack, const debug_info_* debug,
+                                          const growth_policy* growth);
+    void         (*dtor)    (void* stack);
+    unsigned int (*push)    (void* stack, T value);
+    unsigned int (*pop)     (void* stack);
+    T            (*pop_copy)(void* stack, unsigned int* err);
+    T*           (*peek)    (const void* stack, unsigned int* err);
+    unsigned int (*push_n)  (void* stack, const T* values, size_t count);
+    unsigned int (*pop_n)   (void* stack, T* values, size_t count);
+    unsigned int (*replace_n)(void* stack, size_t pop_count,
+                                           const T* values, size_t push_count);
+    unsigned int (*peek_n)  (const void* stack, T* values, size_t count);
+    unsigned int (*check)   (const void* stack);
+    unsigned int (*assert_) (const void* stack, const char* func,
+                                                const char* file,
+                                                size_t line,
+                                                int force_dump);
+    unsigned int (*move)    (void* dest, void* source);
+    size_t       (*view)    (const void* stack, const T** data);
+    unsigned int (*clear)   (void* stack);
+    size_t       (*capacity)(const void* stack);
+};
+
+/**
+ * @brief 
+ * LIFO data structure with protection level selected at runtime
+ * 
+ * @tparam T stored type. `ElementTraits<T>` must be defined
+ */
+template <typename T>
+struct DynamicStack
+{
+    typedef T                                                   element_type;
+    typedef TypedStack<T, StackProtection<STK_DYNAMIC_PROT>>    largest_type_;
+
+    unsigned int            level_;     /* protection level, index of operations */
+    debug_info_             debug_;     /* kept for levels without debug info */
+    const growth_policy*    growth_;    /* capacity growth policy */
+
+    alignas(largest_type_)
+    unsigned char           storage_[sizeof(largest_type_)];
+                                        /* `TypedStack` of current level */
+};
+
+/**
+ * @brief 
+ * Construct `DynamicStack` instance from parameters.
+ * Called by `StackCtor`, `StackCtorGrowth` and `StackCtorLevel`
+ * @param[out] stack     constructed instance
+ * @param[in]  name      variable name
+ * @param[in]  func_name declaring function name
+ * @param[in]  file_name declaring file name
+ * @param[in]  line_num  declaration line
+ * @param[in]  growth    capacity growth policy, `STK_GROWTH_DEFAULT`
+ *                          if set to NULL. Must outlive the stack
+ * @param[in]  level     some combination of `STK_CANARY_PROT`,
+ *                          `STK_HASH_PROT` and `STK_DEBUG_INFO`.
+ *                          Other bits are ignored
+ * @return zero upon successful construction, non-zero otherwise
+ */
+template <typename T>
+int     StackCtor_      (DynamicStack<T>* stack,
+                        const char* name,
+                        const char* func_name,
+                        const char* file_name,
+                        size_t line_num,
+                        const growth_policy* growth = NULL,
+                        unsigned int level = STK_DEFAULT_PROT);
+
+/**
+ * @brief 
+ * Construct `DynamicStack` with given protection level
+ * 
+ * @param[out] stack constructed instance
+ * @param[in]  level some combination of `STK_CANARY_PROT`,
+ *                      `STK_HASH_PROT` and `STK_DEBUG_INFO`
+ * 
+ * @return zero upon successful construction, non-zero otherwise
+ */
+#define StackCtorLevel(  stack, level)                          \
+                                StackCtor_(stack,               \
+                                    #stack + (*#stack == '&'),  \
+                                    __PRETTY_FUNCTION__,        \
+                                    __FILE__,                   \
+                                    __LINE__,                   \
+                                    NULL,                       \
+                                    level)
+
+/**
+ * @brief 
+ * Clean up `DynamicStack` instance. Free associated resources
+ * 
+ * @param[inout] stack instance to be cleaned up
+ */
+template <typename T>
+void    StackDtor       (DynamicStack<T>* stack);
+
+/**
+ * @brief 
+ * Change protection level of live stack. Stack is checked
+ * before change and its elements are copied to new buffer
+ * 
+ * @param[inout] stack `DynamicStack` instance
+ * @param[in] level    some combination of `STK_CANARY_PROT`,
+ *                      `STK_HASH_PROT` and `STK_DEBUG_INFO`.
+ *                      Other bits are ignored
+ * @return zero upon success, some combination of
+ * `ErrorFlags` otherwise. Stack is left unchanged upon failure
+ */
+template <typename T>
+unsigned int StackSetProtection(DynamicStack<T>* stack, unsigned int level);
+
+/**
+ * @brief 
+ * Get protection level of stack
+ */
+template <typename T>
+unsigned int StackGetProtection(const DynamicStack<T>* stack);
+
+/**
+ * @brief 
+ * Add element to stack
+ * 
+ * @param[inout] stack `DynamicStack` instance
+ * @param[in] value    value to be added
+ * @return zero upon success, some combination of
+ * `ErrorFlags` otherwise. `STK_POISON_VALUE` if value is poison
+ */
+template <typename T>
+unsigned int StackPush  (DynamicStack<T>* stack, std::type_identity_t<T> value);
+
+/**
+ * @brief 
+ * Remove top element from stack
+ * 
+ * @param[inout] stack `DynamicStack` instance
+ * @return zero upon success, some combination of
+ * `ErrorFlags` otherwise
+ */
+template <typename T>
+unsigned int StackPop   (DynamicStack<T>* stack);
+
+/**
+ * @brief 
+ * Remove top element from stack
+ * 
+ * @param[inout] stack `DynamicStack` instance
+ * @param[out] err Error code, i.e some combination of
+ * `ErrorFlags`. Parameter is ignored if set to NULL
+ * @return Removed value
+ */
+template <typename T>
+T StackPopCopy          (DynamicStack<T>* stack, unsigned int* err = NULL);
+
+/**
+ * @brief 
+ * Get top element from stack
+ * 
+ * @param[inout] stack `DynamicStack` instance
+ * @param[out] err Error code, i.e some combination of
+ * `ErrorFlags`. Parameter is ignored if set to NULL
+ * @return Pointer to element in stack, `NULL` if stack
+ * is empty or corrupted
+ * 
+ * @warning Pointer invalidates after call to `StackPop`
+ * or `StackSetProtection` with the same `DynamicStack` instance
+ */
+template <typename T>
+T* StackPeek            (const DynamicStack<T>* stack, unsigned int* err = NULL);
+
+/**
+ * @brief 
+ * Add several elements to stack at once
+ * 
+ * @param[inout] stack `DynamicStack` instance
+ * @param[in] values   added values, last one ends up on top
+ * @param[in] count    number of added values
+ * @return zero upon success, some combination of
+ * `ErrorFlags` otherwise. `STK_POISON_VALUE` if any value is poison
+ */
+template <typename T>
+unsigned int StackPushN (DynamicStack<T>* stack, const T* values, size_t count);
+
+/**
+ * @brief 
+ * Remove several top elements from stack at once
+ * 
+ * @param[inout] stack `DynamicStack` instance
+ * @param[out] values  removed values, top one is last.
+ * Ignored if set to NULL
+ * @param[in] count    number of removed values
+ * @return zero upon success, some combination of
+ * `ErrorFlags` otherwise
+ */
+template <typename T>
+unsigned int StackPopN  (DynamicStack<T>* stack, T* values, size_t count);
+
+/**
+ * @brief 
+ * Replace several top elements of stack with other
+ * elements as one operation
+ * 
+ * @param[inout] stack `DynamicStack` instance
+ * @param[in] pop_count  number of removed values
+ * @param[in] values     added values, last one ends up on top
+ * @param[in] push_count number of added values
+ * @return zero upon success, some combination of
+ * `ErrorFlags` otherwise. Stack is left unchanged upon failure
+ */
+template <typename T>
+unsigned int StackReplaceN(DynamicStack<T>* stack, size_t pop_count,
+                           const T* values, size_t push_count);
+
+/**
+ * @brief 
+ * Copy several top elements of stack without removing them
+ * 
+ * @param[in]  stack  `DynamicStack` instance
+ * @param[out] values copied values, top one is last
+ * @param[in]  count  number of copied values
+ * @return zero upon success, some combination of
+ * `ErrorFlags` otherwise
+ */
+template <typename T>
+unsigned int StackPeekN (const DynamicStack<T>* stack, T* values, size_t count);
+
+/**
+ * @brief 
+ * Remove all elements from stack, poisoning freed slots,
+ * and recompute canaries and hash, so that stack can be
+ * reused as if it was just constructed
+ * 
+ * @param[inout] stack `DynamicStack` instance
+ * @return zero upon success, some combination of
+ * `ErrorFlags` otherwise. Stack is left unchanged upon failure
+ */
+template <typename T>
+unsigned int StackClear (DynamicStack<T>* stack);
+
+/**
+ * @brief 
+ * Get number of elements stack can hold without reallocation
+ */
+template <typename T>
+size_t StackGetCapacity  (const DynamicStack<T>* stack);
+
+/**
+ * @brief 
+ * Check stack integrity. Unprotected stack is
+ * checked for consistent size and poisoned slots
+ * 
+ * @param[in] stack `DynamicStack` instance
+ * @return zero if no errors found, some combination
+ * of `ErrorFlags` otherwise
+ */
+template <typename T>
+unsigned int StackCheck (const DynamicStack<T>* stack);
+
+#endif
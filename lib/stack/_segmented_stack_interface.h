@@ -0,0 +1,174 @@
+#ifndef SEGMENTED_STACK_H
+#define SEGMENTED_STACK_H
+
+/**
+ * @file _segmented_stack_interface.h
+ * @author MeerkatBoss
+ * @brief Segmented stack function definitions
+ * @version 0.1
+ * @date 2022-10-08
+ * 
+ * @warning This header is internal, It IS NOT supposed
+ * to be included outside the scope of the library.
+ * 
+ * @note Segmented stack stores elements in fixed-size chunks
+ * instead of single buffer, so elements are never copied upon
+ * growth. Chunks are canary-framed buffers allocated by
+ * `ReallocWithCanary_` and listed in directory, which stores
+ * only chunk pointers. One empty chunk is cached, so that stack
+ * oscillating around chunk boundary does not allocate memory.
+ * 
+ * @note Segmented stack supports the same operations as `TypedStack`,
+ * except for batch operations and growth policies. Each operation
+ * checks stack header and top chunk only, so its cost does not
+ * depend on stack size. `StackCheck` verifies all chunks.
+ * 
+ */
+
+#include <stddef.h>
+
+#include "_stack_interface.h"
+
+/**
+ * @brief 
+ * Default chunk size in bytes, including canaries.
+ * Chunk of this size fits pool allocator size class
+ */
+const size_t SEGMENT_CHUNK_BYTES = 64 * 1024;
+
+/**
+ * @brief 
+ * LIFO data structure with chunked storage
+ * 
+ * @tparam T      stored type. `ElementTraits<T>` must be defined
+ * @tparam Policy protection policy, e.g. `StackProtection<Level>`
+ * @tparam ChunkCapacity number of elements in chunk
+ */
+template <typename T, typename Policy = StackProtection<STK_DEFAULT_PROT>,
+          size_t ChunkCapacity = ((SEGMENT_CHUNK_BYTES - 2*sizeof(canary_t)) / sizeof(T) > 0
+                                  ? (SEGMENT_CHUNK_BYTES - 2*sizeof(canary_t)) / sizeof(T)
+                                  : 1)>
+struct SegmentedStack
+{
+    typedef T       element_type;
+    typedef Policy  policy_type;
+
+    static const size_t chunk_capacity = ChunkCapacity;
+
+    [[no_unique_address]]
+    OptionalField_<Policy::has_canary,          canary_t,        0> canary_start_;
+
+    T**                 chunks;         /* chunk directory. Chunk `k` holds
+                                            elements from `k*ChunkCapacity` */
+    size_t              chunk_count;    /* chunks in use, at least one */
+    size_t              directory_size; /* directory capacity */
+    size_t              size;           /* stored elements count */
+    T*                  spare_;         /* cached empty chunk or NULL */
+
+    [[no_unique_address]]
+    OptionalField_<Policy::has_hash,            hash_t,          1> hash_;
+    [[no_unique_address]]
+    OptionalField_<Policy::has_hash,            hash_t,          2> data_hash_;
+                                                        /* sum of stored slot hashes */
+    [[no_unique_address]]
+    OptionalField_<Policy::has_debug_info,      debug_info_,     3> debug_;
+
+    [[no_unique_address]]
+    OptionalField_<Policy::has_canary,          canary_t,        5> canary_end_;
+};
+
+/**
+ * @brief 
+ * Construct `SegmentedStack` instance from parameters.
+ * Called by `StackCtor`
+ * @param[out] stack     constructed instance
+ * @param[in]  name      variable name. Used only if
+ *                          policy has debug info
+ * @param[in]  func_name declaring function name. Used only if
+ *                          policy has debug info
+ * @param[in]  file_name declaring file name. Used only if
+ *                          policy has debug info
+ * @param[in]  line_num  declaration line. Used only if
+ *                          policy has debug info
+ * @return zero upon successful construction, non-zero otherwise
+ */
+template <typename T, typename Policy, size_t C>
+int     StackCtor_      (SegmentedStack<T, Policy, C>* stack,
+                        const char* name,
+                        const char* func_name,
+                        const char* file_name,
+                        size_t line_num);
+
+/**
+ * @brief 
+ * Clean up `SegmentedStack` instance. Free associated resources
+ * 
+ * @param[inout] stack instance to be cleaned up
+ */
+template <typename T, typename Policy, size_t C>
+void    StackDtor       (SegmentedStack<T, Policy, C>* stack);
+
+/**
+ * @brief 
+ * Add element to stack. Takes bounded time, as
+ * elements are never moved
+ * 
+ * @param[inout] stack `SegmentedStack` instance
+ * @param[in] value    value to be added
+ * @return zero upon success, some combination of
+ * `ErrorFlags` otherwise. `STK_POISON_VALUE` if value is poison
+ */
+template <typename T, typename Policy, size_t C>
+unsigned int StackPush  (SegmentedStack<T, Policy, C>* stack, std::type_identity_t<T> value);
+
+/**
+ * @brief 
+ * Remove top element from stack
+ * 
+ * @param[inout] stack `SegmentedStack` instance
+ * @return zero upon success, some combination of
+ * `ErrorFlags` otherwise
+ */
+template <typename T, typename Policy, size_t C>
+unsigned int StackPop   (SegmentedStack<T, Policy, C>* stack);
+
+/**
+ * @brief 
+ * Remove top element from stack
+ * 
+ * @param[inout] stack `SegmentedStack` instance
+ * @param[out] err Error code, i.e some combination of
+ * `ErrorFlags`. Parameter is ignored if set to NULL
+ * @return Removed value
+ */
+template <typename T, typename Policy, size_t C>
+T StackPopCopy          (SegmentedStack<T, Policy, C>* stack, unsigned int* err = NULL);
+
+/**
+ * @brief 
+ * Get top element from stack
+ * 
+ * @param[inout] stack `SegmentedStack` instance
+ * @param[out] err Error code, i.e some combination of
+ * `ErrorFlags`. Parameter is ignored if set to NULL
+ * @return Pointer to element in stack, `NULL` if stack
+ * is empty or corrupted
+ * 
+ * @warning Pointer invalidates after call to `StackPop`
+ * with the same `SegmentedStack` instance
+ */
+template <typename T, typename Policy, size_t C>
+T* StackPeek            (const SegmentedStack<T, Policy, C>* stack, unsigned int* err = NULL);
+
+/**
+ * @brief 
+ * Check stack integrity, verifying every chunk
+ * 
+ * @param[in] stack `SegmentedStack` instance
+ * @return zero if no errors found, some combination
+ * of `ErrorFlags` otherwise
+ */
+template <typename T, typename Policy, size_t C>
+unsigned int StackCheck (const SegmentedStack<T, Policy, C>* stack);
+
+#endif
@@ -0,0 +1,95 @@
+#ifndef STACK_DUMP_FORMAT_H
+#define STACK_DUMP_FORMAT_H
+
+/**
+ * @file _stack_dump_format.h
+ * @author MeerkatBoss
+ * @brief Binary stack dump format
+ * @version 0.1
+ * @date 2022-10-09
+ * 
+ * @warning This header is internal, It IS NOT supposed
+ * to be included outside the scope of the library.
+ * 
+ * @note Dump consists of `stack_dump_header`, followed by
+ * `slot_count` slot status bytes (combination of `stack_slot_status`)
+ * and `slot_count` raw slots of `element_size` bytes each. Dump is
+ * written in byte order of the dumping machine and is decoded
+ * by `stkview` tool
+ * 
+ */
+
+#include "_stack_interface.h"
+
+/**
+ * @brief 
+ * Binary dump signature
+ */
+const unsigned long long STK_DUMP_MAGIC   = 0x504D55444B52454DULL; /* "MERKDUMP" */
+
+/**
+ * @brief 
+ * Binary dump format version
+ */
+const unsigned int       STK_DUMP_VERSION = 1;
+
+/**
+ * @brief 
+ * Length of string fields in dump header, including terminating zero.
+ * Longer strings are truncated
+ */
+const size_t             STK_DUMP_STRING_LENGTH = 128;
+
+/**
+ * @brief 
+ * Status of dumped slot
+ */
+enum stack_slot_status : unsigned char
+{
+    STK_SLOT_FREE       = 00,   /* slot is above stack size */
+    STK_SLOT_STORED     = 01,   /* slot is below stack size */
+    STK_SLOT_POISON     = 02,   /* slot holds poison */
+};
+
+/**
+ * @brief 
+ * Binary dump header
+ */
+struct stack_dump_header
+{
+    unsigned long long  magic;              /* `STK_DUMP_MAGIC` */
+    unsigned int        version;            /* `STK_DUMP_VERSION` */
+    unsigned int        errors;             /* `ErrorFlags` found by check */
+    unsigned int        protection;         /* `STK_CANARY_PROT`, `STK_HASH_PROT`
+                                                and `STK_DEBUG_INFO` bits */
+    unsigned int        is_data_readable;
+
+    unsigned long long  stack_address;
+    unsigned long long  data_address;
+    unsigned long long  element_size;
+    unsigned long long  size;
+    unsigned long long  capacity;
+    unsigned long long  reserved;           /* bytes of mapped range, if any */
+
+    hash_t              stored_hash;
+    hash_t              actual_hash;
+    hash_t              stored_data_hash;
+    hash_t              actual_data_hash;
+
+    canary_t            canary_start;       /* stack canaries as stored, */
+    canary_t            canary_end;         /*      expected `CANARY ^ stack_address` */
+    canary_t            data_canary_start;  /* buffer canaries as stored, */
+    canary_t            data_canary_end;    /*      expected `CANARY` */
+
+    unsigned long long  slot_count;         /* number of dumped slots */
+
+    unsigned long long  line_num;           /* declaration line */
+    unsigned long long  caller_line;        /* dumping line */
+    char                name      [STK_DUMP_STRING_LENGTH];
+    char                func_name [STK_DUMP_STRING_LENGTH];
+    char                file_name [STK_DUMP_STRING_LENGTH];
+    char                caller_func[STK_DUMP_STRING_LENGTH];
+    char                caller_file[STK_DUMP_STRING_LENGTH];
+};
+
+#endif
@@ -11,66 +11,36 @@
  * @warning This header is internal, It IS NOT supposed
  * to be included outside the scope of the library.
  * 
+ * @note Stack is implemented as `TypedStack<T, Policy>` template.
+ * `Stack` is its instantiation for `element_t` with protection
+ * level `STK_PROT_LEVEL`, set before including this header.
+ * 
+ * @note When defining custom `element_t`, also define
+ * `STK_BITWISE_POISON` if `IsPoison(element)` is equivalent
+ * to bytewise comparison with `element_poison`
+ * 
  */
 
 #include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
 
-#include "utils.h"
-
-#ifndef USE_CUSTOM_ELEMENT
-    /**
-     * @brief 
-     * Stack element type
-     */
-    typedef void* element_t;
+#include <bit>
+#include <limits>
+#include <type_traits>
+#include <utility>
 
-    /**
-     * @brief 
-     * Invalid element value
-     */
-    const element_t element_poison = NULL;
-
-    inline int IsPoison(element_t element) { return element == NULL; }
-
-    /**
-     * @brief 
-     * Print given element
-     * 
-     * @param[in] element printed element
-     */
-    inline void PrintElement(element_t element) { printf("%p", (element)); }
-#endif
+#include "utils.h"
 
 #define STK_CANARY_PROT 01
 #define STK_HASH_PROT   02
-#define STK_DEBUG_INFO  04 
-
-#ifndef STK_PROT_LEVEL
-#define STK_PROT_LEVEL STK_CANARY_PROT | STK_HASH_PROT | STK_DEBUG_INFO
-#endif
-
-#if (STK_PROT_LEVEL & STK_CANARY_PROT)
-    #define _ON_CANARY(...) __VA_ARGS__
-    #define _NO_CANARY(...)
-#else
-    #define _ON_CANARY(...)
-    #define _NO_CANARY(...) __VA_ARGS__
-#endif
+#define STK_DEBUG_INFO  04
+#define STK_SAMPLED_CHECK 010
 
-#if (STK_PROT_LEVEL & STK_HASH_PROT)
-    #define _ON_HASH(...) __VA_ARGS__
-    #define _NO_HASH(...)
-#else
-    #define _ON_HASH(...)
-    #define _NO_HASH(...) __VA_ARGS__
-#endif
+#define STK_DEFAULT_PROT (STK_CANARY_PROT | STK_HASH_PROT | STK_DEBUG_INFO)
 
-#if (STK_PROT_LEVEL & STK_DEBUG_INFO)
-    #define _ON_DEBUG_INFO(...) __VA_ARGS__
-    #define _NO_DEBUG_INFO(...)
-#else
-    #define _ON_DEBUG_INFO(...)
-    #define _NO_DEBUG_INFO(...) __VA_ARGS__
+#ifndef STK_PROT_LEVEL
+#define STK_PROT_LEVEL STK_DEFAULT_PROT
 #endif
 
 #ifndef NSTACK_CHECK
@@ -83,14 +53,16 @@
 
 typedef unsigned long long canary_t;
 
-const canary_t CANARY = 0xD1AB011CA1C0C0A5ULL;  /* DIABOLICAL COCOAS*/
+/**
+ * @brief 
+ * Cache line size assumed by split stack layout
+ */
+const size_t STK_CACHE_LINE = 64;
 
-_ON_HASH(
-    typedef unsigned long long hash_t;
-)
+const canary_t CANARY = 0xD1AB011CA1C0C0A5ULL;  /* DIABOLICAL COCOAS*/
 
 enum ErrorFlags : unsigned int
-{ 
+{
     STK_NO_ERROR        = 00000,
     STK_EMPTY           = 00001,
     STK_NO_MEMORY       = 00002,
@@ -102,6 +74,8 @@ enum ErrorFlags : unsigned int
     STK_CORRUPTED_SIZE  = 00200,
     STK_CORRUPTED_CAP   = 00400,
     STK_CORRUPTED_DATA  = 01000,
+    STK_BAD_FILE        = 02000,
+    STK_POISON_VALUE    = 04000,    /* value cannot be stored: it is poison */
 };
 
 /**
@@ -119,41 +93,455 @@ struct debug_info_
                             */
 };
 
+/**
+ * @brief 
+ * Schedule of expensive data checks. Cheap header checks
+ * are performed on every operation regardless of schedule
+ */
+struct check_schedule_
+{
+    size_t              period;         /* check data every `period` operations,
+                                            0 to disable */
+    unsigned long long  budget_ns;      /* data checking time allowed per operation,
+                                            0 to disable */
+    size_t              ops_left;       /* operations until next periodic check */
+    unsigned long long  credit_ns;      /* unspent time budget */
+    unsigned long long  last_cost_ns;   /* duration of last data check */
+};
+
+/**
+ * @brief 
+ * Persistent stack file signature
+ */
+const unsigned long long STK_FILE_MAGIC   = 0x4B4154534B52454DULL; /* "MERKSTAK" */
+
+/**
+ * @brief 
+ * Persistent stack file format version
+ */
+const unsigned int       STK_FILE_VERSION = 1;
+
+/**
+ * @brief 
+ * Header of persistent stack file. Header occupies first page
+ * of file and is followed by stack buffer with its canaries
+ */
+struct stack_file_header
+{
+    unsigned long long  magic;          /* `STK_FILE_MAGIC` */
+    unsigned int        version;        /* `STK_FILE_VERSION` */
+    unsigned int        protection;     /* `STK_CANARY_PROT` and `STK_HASH_PROT`
+                                            bits of stack policy */
+    char                hash_backend[16];/* backend used for stored hashes */
+    size_t              element_size;
+    size_t              data_offset;    /* header size, page size of creator */
+    size_t              reserved;       /* bytes reserved for buffer */
+    size_t              size;
+    size_t              capacity;
+    hash_t              data_hash;
+    canary_t            canary;         /* `CANARY` */
+    hash_t              hash;           /* header hash with this field zeroed */
+};
+
+/**
+ * @brief 
+ * Stack capacity growth policy. Capacities are computed
+ * with integer arithmetic only
+ */
+struct growth_policy
+{
+    size_t factor_num;      /* capacity is multiplied by */
+    size_t factor_den;      /*      `factor_num/factor_den` upon growth */
+    size_t min_capacity;    /* capacity of new heap buffer */
+    size_t page_threshold;  /* buffers of at least this many bytes grow
+                                to whole pages, 0 to disable */
+    size_t shrink_ratio;    /* buffer shrinks once its capacity is this many
+                                times bigger than size, 0 to shrink only
+                                upon `StackShrinkToFit` */
+};
+
+/**
+ * @brief 
+ * Double capacity, shrink when less than quarter is used
+ */
+const growth_policy STK_GROWTH_DEFAULT = {
+    .factor_num     = 2,
+    .factor_den     = 1,
+    .min_capacity   = 16,
+    .page_threshold = 0,
+    .shrink_ratio   = 4
+};
+
+/**
+ * @brief 
+ * Grow by golden ratio, which allows allocator to reuse
+ * freed blocks for later growth
+ */
+const growth_policy STK_GROWTH_GOLDEN = {
+    .factor_num     = 89,
+    .factor_den     = 55,
+    .min_capacity   = 16,
+    .page_threshold = 0,
+    .shrink_ratio   = 3
+};
+
+/**
+ * @brief 
+ * Grow by half, buffers bigger than 64 KiB are rounded to pages
+ */
+const growth_policy STK_GROWTH_PAGES = {
+    .factor_num     = 3,
+    .factor_den     = 2,
+    .min_capacity   = 16,
+    .page_threshold = 64 * 1024,
+    .shrink_ratio   = 3
+};
+
+/**
+ * @brief 
+ * Double capacity, never shrink automatically
+ */
+const growth_policy STK_GROWTH_LAZY = {
+    .factor_num     = 2,
+    .factor_den     = 1,
+    .min_capacity   = 16,
+    .page_threshold = 0,
+    .shrink_ratio   = 0
+};
+
+/**
+ * @brief 
+ * Stack element properties. Must be specialized for
+ * every stored type and provide:
+ * 
+ * `static const bool is_bitwise_poison` - whether `IsPoison(element)`
+ *      is equivalent to bytewise comparison with `poison`
+ * 
+ * `static inline const T poison` - invalid element value
+ * 
+ * `static int IsPoison(const T& element)`
+ * 
+ * `static void Print(const T& element)`
+ * 
+ * @tparam T stored type
+ */
+template <typename T>
+struct ElementTraits;
+
+/**
+ * @brief 
+ * Element properties for pointers. `NULL` is used as poison
+ */
+template <typename T>
+struct ElementTraits<T*>
+{
+    static const bool is_bitwise_poison = true;
+
+    static inline T* const poison = NULL;
+
+    static int  IsPoison(T* const& element) { return element == NULL; }
+
+    static void Print   (T* const& element) { printf("%p", (const void*)element); }
+};
+
+/**
+ * @brief 
+ * Element properties for integers. Bit pattern of the most
+ * negative signed value of the same width is used as poison,
+ * so that elements take no extra space
+ */
+template <typename T>
+    requires (std::is_integral_v<T> && !std::is_same_v<T, bool>)
+struct ElementTraits<T>
+{
+    static const bool is_bitwise_poison = true;
+
+    static inline const T poison = (T)std::numeric_limits<std::make_signed_t<T>>::min();
+
+    static int  IsPoison(const T& element) { return element == poison; }
+
+    static void Print   (const T& element)
+    {
+        if constexpr (std::is_signed_v<T>)
+            printf("%lld", (long long)element);
+        else
+            printf("%llu", (unsigned long long)element);
+    }
+};
+
+/**
+ * @brief 
+ * Signalling NaN bit patterns used as floating-point poison.
+ * Arithmetic never produces them
+ */
+const uint32_t STK_FLOAT_POISON_BITS  = 0x7FA0DEADu;
+const uint64_t STK_DOUBLE_POISON_BITS = 0x7FF4DEADBEEFDEADull;
+
+/**
+ * @brief 
+ * Element properties for floating-point numbers.
+ * Poison is compared bitwise, as NaN is not equal to itself
+ */
+template <typename T>
+    requires (std::is_same_v<T, float> || std::is_same_v<T, double>)
+struct ElementTraits<T>
+{
+    typedef std::conditional_t<sizeof(T) == sizeof(uint32_t), uint32_t, uint64_t> bits_t_;
+
+    static const bool is_bitwise_poison = true;
+
+    static inline const T poison = std::bit_cast<T>(sizeof(T) == sizeof(uint32_t)
+                                                    ? (bits_t_)STK_FLOAT_POISON_BITS
+                                                    : (bits_t_)STK_DOUBLE_POISON_BITS);
+
+    static int  IsPoison(const T& element)
+    {
+        return std::bit_cast<bits_t_>(element) == std::bit_cast<bits_t_>(poison);
+    }
+
+    static void Print   (const T& element) { printf("%g", (double)element); }
+};
+
+/**
+ * @brief 
+ * Stack protection policy. Custom policies should inherit
+ * from one of its instantiations and may override any of
+ * its members
+ * 
+ * @tparam Level some combination of `STK_CANARY_PROT`,
+ * `STK_HASH_PROT`, `STK_DEBUG_INFO` and `STK_SAMPLED_CHECK`
+ */
+template <unsigned int Level>
+struct StackProtection
+{
+    static const bool has_canary        = (Level & STK_CANARY_PROT)   != 0;
+    static const bool has_hash          = (Level & STK_HASH_PROT)     != 0;
+    static const bool has_debug_info    = (Level & STK_DEBUG_INFO)    != 0;
+    static const bool has_sampled_check = (Level & STK_SAMPLED_CHECK) != 0;
+
+    static const size_t inline_capacity = 0;   /* elements stored without
+                                                    heap allocation */
+
+    static const bool split_layout      = false;/* see `WithSplitLayout` */
+};
+
+/**
+ * @brief 
+ * Protection policy `Base` with inline storage for
+ * first `Capacity` elements
+ */
+template <size_t Capacity, typename Base = StackProtection<STK_DEFAULT_PROT>>
+struct WithInlineStorage : Base
+{
+    static const size_t inline_capacity = Capacity;
+};
+
+/**
+ * @brief 
+ * Protection policy `Base` with split stack layout. Stack header
+ * is aligned to cache line, debug info is moved to separately
+ * allocated cold structure and header hash covers only fields
+ * describing stack buffer. Fields used by every operation,
+ * except end canary, fit first cache line
+ */
+template <typename Base = StackProtection<STK_DEFAULT_PROT>>
+struct WithSplitLayout : Base
+{
+    static const bool split_layout = true;
+};
+
+/**
+ * @brief 
+ * Empty base, which sets `TypedStack` alignment
+ */
+template <size_t Alignment>
+struct alignas(Alignment) StackAlignment_ {};
+
+/**
+ * @brief 
+ * Placeholder for disabled `TypedStack` field
+ * 
+ * @tparam Tag distinguishes placeholders, so that they
+ * all can occupy no space
+ */
+template <int Tag>
+struct NoField_ {};
+
+/**
+ * @brief 
+ * `Field` if `Enabled` is true, empty placeholder otherwise
+ */
+template <bool Enabled, typename Field, int Tag>
+using OptionalField_ = std::conditional_t<Enabled, Field, NoField_<Tag>>;
+
+/**
+ * @brief 
+ * Inline stack buffer. Has the same layout as heap
+ * buffer, i.e. elements are framed with canaries
+ * if `HasCanary` is true
+ */
+template <typename T, size_t Capacity, bool HasCanary>
+struct InlineStorage_
+{
+    alignas(canary_t) alignas(T)
+    unsigned char bytes[Capacity*sizeof(T) + (HasCanary ? 2*sizeof(canary_t) : 0)];
+};
+
 /**
  * @brief 
  * LIFO data structure
+ * 
+ * @tparam T      stored type. `ElementTraits<T>` must be defined
+ * @tparam Policy protection policy, e.g. `StackProtection<Level>`
  */
-struct Stack
+template <typename T, typename Policy = StackProtection<STK_DEFAULT_PROT>>
+struct TypedStack : StackAlignment_<Policy::split_layout ? STK_CACHE_LINE : 1>
 {
-    _ON_CANARY(     canary_t        canary_start_;)
-                    element_t*        data;           /* stored elements */
-                    size_t          size;           /* stored elements count*/
-                    size_t          capacity;       /* maximum capacity */
-    _ON_HASH(       hash_t          hash_;)
-    _ON_HASH(       hash_t          data_hash_;)
-    _ON_DEBUG_INFO( debug_info_     debug_;)        
-    _ON_CANARY(     canary_t        canary_end_;)
+    typedef T       element_type;
+    typedef Policy  policy_type;
+
+    [[no_unique_address]]
+    OptionalField_<Policy::has_canary,          canary_t,        0> canary_start_;
+
+    T*                  data;           /* stored elements */
+    size_t              size;           /* stored elements count*/
+    size_t              capacity;       /* maximum capacity */
+
+    [[no_unique_address]]
+    OptionalField_<Policy::has_hash,            hash_t,          1> hash_;
+    [[no_unique_address]]
+    OptionalField_<Policy::has_hash,            hash_t,          2> data_hash_;
+                                                        /* sum of stored slot hashes */
+
+    const growth_policy* growth_;       /* capacity growth policy */
+    size_t              reserved_;      /* bytes of mapped range, zero if
+                                            buffer is allocated on heap */
+    stack_file_header*  file_;          /* header of mapped file, NULL if
+                                            stack is not persistent */
+
+    [[no_unique_address]]
+    OptionalField_<Policy::has_sampled_check,   check_schedule_, 4> check_;
+    [[no_unique_address]]
+    OptionalField_<Policy::has_debug_info,
+                   std::conditional_t<Policy::split_layout, debug_info_*, debug_info_>,
+                                                                 3> debug_;
+                                                        /* cold structure is
+                                                            referenced in split layout */
+    [[no_unique_address]]
+    OptionalField_<(Policy::inline_capacity > 0),
+                   InlineStorage_<T, Policy::inline_capacity, Policy::has_canary>,
+                                                                 6> inline_;
+                                                        /* used while stack is small */
+
+    [[no_unique_address]]
+    OptionalField_<Policy::has_canary,          canary_t,        5> canary_end_;
 };
 
+#ifndef USE_CUSTOM_ELEMENT
+    /**
+     * @brief 
+     * Stack element type
+     */
+    typedef void* element_t;
+
+    /**
+     * @brief 
+     * Invalid element value
+     */
+    const element_t element_poison = NULL;
+
+    inline int IsPoison(element_t element) { return element == NULL; }
+
+    /**
+     * @brief 
+     * Print given element
+     * 
+     * @param[in] element printed element
+     */
+    inline void PrintElement(element_t element) { printf("%p", (element)); }
+
+    /**
+     * @brief 
+     * `IsPoison(element)` holds exactly when `element` is bytewise
+     * equal to `element_poison`. Enables vectorized buffer scans
+     */
+    #define STK_BITWISE_POISON
+#else
+    /**
+     * @brief 
+     * Element properties defined by `element_t`, `element_poison`,
+     * `IsPoison` and `PrintElement`
+     */
+    template <>
+    struct ElementTraits<element_t>
+    {
+    #ifdef STK_BITWISE_POISON
+        static const bool is_bitwise_poison = true;
+    #else
+        static const bool is_bitwise_poison = false;
+    #endif
+
+        static inline const element_t poison = element_poison;
+
+        static int  IsPoison(const element_t& element) { return ::IsPoison(element); }
+
+        static void Print   (const element_t& element) { ::PrintElement(element); }
+    };
+#endif
+
+/**
+ * @brief 
+ * Stack of `element_t` with protection level `STK_PROT_LEVEL`
+ */
+typedef TypedStack<element_t, StackProtection<STK_PROT_LEVEL>> Stack;
+
+/**
+ * @brief 
+ * Stack, which stores first `Capacity` elements inline and
+ * allocates heap buffer only when they do not fit
+ */
+template <typename T, size_t Capacity, typename Policy = StackProtection<STK_DEFAULT_PROT>>
+using SmallStack = TypedStack<T, WithInlineStorage<Capacity, Policy>>;
+
+/**
+ * @brief 
+ * Stack with split layout, suited for large arrays of stacks
+ */
+template <typename T, typename Policy = StackProtection<STK_DEFAULT_PROT>>
+using SplitStack = TypedStack<T, WithSplitLayout<Policy>>;
+
 /**
  * @brief 
  * Construct `Stack` instance from parameters
  * @param[out] stack     constructed instance
  * @param[in]  name      variable name. Used only if
- *                          `STK_PROT_LEVEL` & `STK_DEBUG_INFO` != 0
+ *                          policy has debug info
  * @param[in]  func_name declaring function name. Used only if
- *                          `STK_PROT_LEVEL` & `STK_DEBUG_INFO` != 0
+ *                          policy has debug info
  * @param[in]  file_name declaring file name. Used only if
- *                          `STK_PROT_LEVEL` & `STK_DEBUG_INFO` != 0
+ *                          policy has debug info
  * @param[in]  line_num  declaration line. Used only if
- *                          `STK_PROT_LEVEL` & `STK_DEBUG_INFO` != 0
+ *                          policy has debug info
+ * @param[in]  growth    capacity growth policy, `STK_GROWTH_DEFAULT`
+ *                          if set to NULL. Must outlive the stack
+ * @param[in]  max_capacity capacity of mapped storage, zero
+ *                          to store elements on heap
  * @return zero upon successful construction, non-zero otherwise
+ * 
+ * @note Mapped storage reserves virtual range for `max_capacity`
+ * elements upfront and commits its pages as stack grows, so
+ * elements are never copied. Range is surrounded by guard pages
+ * and its uncommitted pages are inaccessible, so overruns fault
+ * immediately. Pages are returned to system when stack shrinks
  */
-int     StackCtor_      (Stack* stack,
+template <typename T, typename Policy>
+int     StackCtor_      (TypedStack<T, Policy>* stack,
                         const char* name,
                         const char* func_name,
                         const char* file_name,
-                        size_t line_num);
+                        size_t line_num,
+                        const growth_policy* growth = NULL,
+                        size_t max_capacity = 0);
 
 /**
  * @brief 
@@ -172,22 +560,138 @@ int     StackCtor_      (Stack* stack,
 
 /**
  * @brief 
- * Clean up `Stack` instance. Free associated resources
+ * Construct `Stack` with given growth policy
+ * 
+ * @param[out] stack  constructed instance
+ * @param[in]  growth capacity growth policy, e.g. `&STK_GROWTH_GOLDEN`
+ * 
+ * @return zero upon successful construction, non-zero otherwise
+ */
+#define StackCtorGrowth( stack, growth)                         \
+                        StackCtor_(stack,                       \
+                                    #stack + (*#stack == '&'),  \
+                                    __PRETTY_FUNCTION__,        \
+                                    __FILE__, __LINE__, growth);
+
+/**
+ * @brief 
+ * Construct `Stack` with mapped storage
+ * 
+ * @param[out] stack        constructed instance
+ * @param[in]  max_capacity maximum number of stored elements
+ * 
+ * @return zero upon successful construction, non-zero otherwise
+ */
+#define StackCtorMapped( stack, max_capacity)                   \
+                        StackCtor_(stack,                       \
+                                    #stack + (*#stack == '&'),  \
+                                    __PRETTY_FUNCTION__,        \
+                                    __FILE__, __LINE__,         \
+                                    NULL, max_capacity);
+
+/**
+ * @brief 
+ * Open persistent stack stored in file, creating file if
+ * it does not exist. Called by `StackOpen`
+ * @param[out] stack        opened instance
+ * @param[in]  path         stack file
+ * @param[in]  max_capacity maximum number of stored elements.
+ *                          Existing file is extended if it has
+ *                          less room, but never truncated
+ * @param[in]  name         variable name. Used only if
+ *                              policy has debug info
+ * @param[in]  func_name    declaring function name. Used only if
+ *                              policy has debug info
+ * @param[in]  file_name    declaring file name. Used only if
+ *                              policy has debug info
+ * @param[in]  line_num     declaration line. Used only if
+ *                              policy has debug info
+ * @param[in]  growth       capacity growth policy, `STK_GROWTH_DEFAULT`
+ *                              if set to NULL. Must outlive the stack
+ * @return zero upon success, some combination of `ErrorFlags`
+ * otherwise. `STK_BAD_FILE` if file cannot be mapped or was
+ * written for different element type, policy or hash backend
+ * 
+ * @note Stack buffer is mapped directly from file and is never
+ * copied. Only file header is verified upon opening, stored
+ * elements are verified against stored data hash by the first
+ * stack check. File header is updated by `StackSync` and
+ * `StackDtor` only, so after a crash stack must be restored
+ * from snapshot made by `StackSnapshot`
+ */
+template <typename T, typename Policy>
+unsigned int StackOpen_ (TypedStack<T, Policy>* stack,
+                        const char* path,
+                        size_t max_capacity,
+                        const char* name,
+                        const char* func_name,
+                        const char* file_name,
+                        size_t line_num,
+                        const growth_policy* growth = NULL);
+
+/**
+ * @brief 
+ * Open persistent stack stored in file
+ * 
+ * @param[out] stack        opened instance
+ * @param[in]  path         stack file
+ * @param[in]  max_capacity maximum number of stored elements
+ * 
+ * @return zero upon success, some combination of `ErrorFlags` otherwise
+ */
+#define StackOpen(       stack, path, max_capacity)             \
+                        StackOpen_(stack, path, max_capacity,   \
+                                    #stack + (*#stack == '&'),  \
+                                    __PRETTY_FUNCTION__,        \
+                                    __FILE__, __LINE__);
+
+/**
+ * @brief 
+ * Write header of persistent stack and flush
+ * stack file to disk
+ * 
+ * @param[inout] stack persistent `Stack` instance
+ * @return zero upon success, some combination of
+ * `ErrorFlags` otherwise
+ */
+template <typename T, typename Policy>
+unsigned int StackSync  (TypedStack<T, Policy>* stack);
+
+/**
+ * @brief 
+ * Write consistent copy of stack to file, which can
+ * be opened with `StackOpen` later. Works for any stack,
+ * persistent or not
+ * 
+ * @param[in] stack `Stack` instance
+ * @param[in] path  snapshot file, overwritten if exists
+ * @return zero upon success, some combination of
+ * `ErrorFlags` otherwise
+ */
+template <typename T, typename Policy>
+unsigned int StackSnapshot(const TypedStack<T, Policy>* stack, const char* path);
+
+/**
+ * @brief 
+ * Clean up `Stack` instance. Free associated resources.
+ * Persistent stack is synced to its file
  * 
  * @param[inout] stack instance to be cleaned up
  */
-void    StackDtor       (Stack* stack);
+template <typename T, typename Policy>
+void    StackDtor       (TypedStack<T, Policy>* stack);
 
 /**
- * @brief
+ * @brief 
  * Add element to stack
  * 
  * @param[inout] stack `Stack` instance
  * @param[in] value    value to be added
  * @return zero upon success, some combination of
- * `ErrorFlags` otherwise
+ * `ErrorFlags` otherwise. `STK_POISON_VALUE` if value is poison
  */
-unsigned int StackPush  (Stack* stack, element_t value);
+template <typename T, typename Policy>
+unsigned int StackPush  (TypedStack<T, Policy>* stack, std::type_identity_t<T> value);
 
 /**
  * @brief 
@@ -197,10 +701,11 @@ unsigned int StackPush  (Stack* stack, element_t value);
  * @return zero upon success, some combination of
  * `ErrorFlags` otherwise
  */
-unsigned int StackPop   (Stack* stack);
+template <typename T, typename Policy>
+unsigned int StackPop   (TypedStack<T, Policy>* stack);
 
 /**
- * @brief
+ * @brief 
  * Remove top element from stack
  * 
  * @param[inout] stack `Stack` instance
@@ -208,20 +713,198 @@ unsigned int StackPop   (Stack* stack);
  * `ErrorFlags`. Parameter is ignored if set to NULL
  * @return Removed value
  */
-element_t StackPopCopy    (Stack* stack, unsigned int* err);
+template <typename T, typename Policy>
+T StackPopCopy          (TypedStack<T, Policy>* stack, unsigned int* err = NULL);
 
 /**
- * @brief
+ * @brief 
  * Get top element from stack
  * 
  * @param[inout] stack `Stack` instance
  * @param[out] err Error code, i.e some combination of
  * `ErrorFlags`. Parameter is ignored if set to NULL
- * @return Pointer to element in stack
- * 
+ * @return Pointer to element in stack, `NULL` if stack
+ * is empty or corrupted
+* 
  * @warning Pointer invalidates after call to `StackPop`
  * with the same `Stack` instance
  */
-element_t* StackPeek      (const Stack* stack, unsigned int* err);
+template <typename T, typename Policy>
+T* StackPeek            (const TypedStack<T, Policy>* stack, unsigned int* err = NULL);
+
+/**
+ * @brief 
+ * Add several elements to stack. Capacity is reserved
+ * and integrity is checked once per call
+ * 
+ * @param[inout] stack `Stack` instance
+ * @param[in] values   added values, the last one becomes top
+ * @param[in] count    number of added values
+ * @return zero upon success, some combination of
+ * `ErrorFlags` otherwise. `STK_POISON_VALUE` if any value is
+ * poison. Nothing is added upon failure
+ */
+template <typename T, typename Policy>
+unsigned int StackPushN (TypedStack<T, Policy>* stack, const T* values, size_t count);
+
+/**
+ * @brief 
+ * Remove several top elements from stack
+ * 
+ * @param[inout] stack `Stack` instance
+ * @param[out] values  removed values in the order they were
+ * pushed, i.e. top element is the last one. Ignored if set to NULL
+ * @param[in] count    number of removed values
+ * @return zero upon success, some combination of
+ * `ErrorFlags` otherwise. `STK_EMPTY` if stack has less than
+ * `count` elements, in which case nothing is removed
+ */
+template <typename T, typename Policy>
+unsigned int StackPopN  (TypedStack<T, Policy>* stack, T* values, size_t count);
+
+/**
+ * @brief 
+ * Remove several top elements from stack and add several
+ * elements in their place as one operation
+ * 
+ * @param[inout] stack `Stack` instance
+ * @param[in] pop_count  number of removed values
+ * @param[in] values     added values, the last one becomes top
+ * @param[in] push_count number of added values
+ * @return zero upon success, some combination of
+ * `ErrorFlags` otherwise. `STK_POISON_VALUE` if any added value
+ * is poison. Stack is left unchanged upon failure
+ */
+template <typename T, typename Policy>
+unsigned int StackReplaceN(TypedStack<T, Policy>* stack, size_t pop_count,
+                           const T* values, size_t push_count);
+
+/**
+ * @brief 
+ * Copy several top elements from stack
+ * 
+ * @param[in] stack   `Stack` instance
+ * @param[out] values copied values in the order they were
+ * pushed, i.e. top element is the last one
+ * @param[in] count   number of copied values
+ * @return zero upon success, some combination of
+ * `ErrorFlags` otherwise. `STK_EMPTY` if stack has less than
+ * `count` elements
+ */
+template <typename T, typename Policy>
+unsigned int StackPeekN (const TypedStack<T, Policy>* stack, T* values, size_t count);
+
+/**
+ * @brief 
+ * Ensure stack can store `capacity` elements without
+ * reallocation
+ * 
+ * @param[inout] stack `Stack` instance
+ * @param[in] capacity required capacity
+ * @return zero upon success, some combination of
+ * `ErrorFlags` otherwise
+ * 
+ * @note Reserved capacity may be released by automatic
+ * shrinking upon `StackPop`. Use `STK_GROWTH_LAZY` to keep it
+ */
+template <typename T, typename Policy>
+unsigned int StackReserve(TypedStack<T, Policy>* stack, size_t capacity);
+
+/**
+ * @brief 
+ * Release unused stack capacity
+ * 
+ * @param[inout] stack `Stack` instance
+ * @return zero upon success, some combination of
+ * `ErrorFlags` otherwise
+ */
+template <typename T, typename Policy>
+unsigned int StackShrinkToFit(TypedStack<T, Policy>* stack);
+
+/**
+ * @brief 
+ * Set how often stack data is fully checked. Header is
+ * checked on every operation regardless of this setting.
+ * Requires policy with sampled checks
+ * 
+ * @param[inout] stack `Stack` instance
+ * @param[in] period check data every `period` operations.
+ * Zero disables periodic checks
+ * @return zero upon success, some combination of
+ * `ErrorFlags` otherwise
+ */
+template <typename T, typename Policy>
+unsigned int StackSetCheckPeriod(TypedStack<T, Policy>* stack, size_t period);
+
+/**
+ * @brief 
+ * Set average time per operation which may be spent on
+ * stack data checks. Data is checked as soon as accumulated
+ * budget covers the duration of previous check.
+ * Requires policy with sampled checks
+ * 
+ * @param[inout] stack `Stack` instance
+ * @param[in] budget_ns time budget in nanoseconds.
+ * Zero disables budgeted checks
+ * @return zero upon success, some combination of
+ * `ErrorFlags` otherwise
+ */
+template <typename T, typename Policy>
+unsigned int StackSetCheckBudget(TypedStack<T, Policy>* stack, unsigned long long budget_ns);
+
+/**
+ * @brief 
+ * Construct element on top of stack from given arguments,
+ * without creating temporary copy
+ * 
+ * @param[inout] stack `Stack` instance
+ * @param[in] args     arguments of `T` constructor
+ * @return zero upon success, some combination of
+ * `ErrorFlags` otherwise. `STK_POISON_VALUE` if constructed
+ * element is poison
+ */
+template <typename T, typename Policy, typename... Args>
+unsigned int StackEmplace(TypedStack<T, Policy>* stack, Args&&... args);
+
+/**
+ * @brief 
+ * Move stack to another address. Canaries and hash are
+ * updated for new address, buffer is not copied. Stack
+ * with inline storage copies its inline elements
+ * 
+ * @param[out]   dest   unconstructed or destroyed instance
+ * @param[inout] source moved instance. Left destroyed
+ * @return zero upon success, some combination of
+ * `ErrorFlags` otherwise
+ */
+template <typename T, typename Policy>
+unsigned int StackMove  (TypedStack<T, Policy>* dest, TypedStack<T, Policy>* source);
+
+/**
+ * @brief 
+ * Exchange contents of two stacks without copying buffers.
+ * Each stack keeps its debug info and check schedule
+ * 
+ * @param[inout] first  `Stack` instance
+ * @param[inout] second `Stack` instance
+ * @return zero upon success, some combination of
+ * `ErrorFlags` otherwise
+ */
+template <typename T, typename Policy>
+unsigned int StackSwap  (TypedStack<T, Policy>* first, TypedStack<T, Policy>* second);
+
+/**
+ * @brief 
+ * Discard contents of `dest` and transfer buffer of `source`
+ * to it without copying. `source` is left empty, with new
+ * buffer of minimal capacity
+ * 
+ * @param[inout] dest   `Stack` instance
+ * @param[inout] source `Stack` instance
+ * @return zero upon success, some combination of
+ * `ErrorFlags` otherwise
+ */
+template <typename T, typename Policy>
+unsigned int StackSteal (TypedStack<T, Policy>* dest, TypedStack<T, Policy>* source);
 
 #endif
@@ -0,0 +1,176 @@
+#ifndef WORK_DEQUE_H
+#define WORK_DEQUE_H
+
+/**
+ * @file _work_deque_interface.h
+ * @author MeerkatBoss
+ * @brief Work-stealing deque function definitions
+ * @version 0.1
+ * @date 2022-10-07
+ * 
+ * @warning This header is internal, It IS NOT supposed
+ * to be included outside the scope of the library.
+ * 
+ * @note Deque is Chase-Lev work-stealing deque. Single owner
+ * thread pushes and pops elements at the bottom (`bottom_`)
+ * without atomic read-modify-write operations, other threads
+ * steal oldest elements from the top (`top_`).
+ * 
+ * @note Elements are stored in canary-framed buffers allocated
+ * by `ReallocWithCanary_`, free slots are poisoned. Slots freed
+ * by thieves are poisoned by owner later. Hash protection is not
+ * applied, as elements are removed concurrently. To keep owner
+ * operations cheap, deque is fully checked only by `WorkDequeCheck`
+ * and upon destruction.
+ * 
+ */
+
+#include <stddef.h>
+
+#include "_stack_interface.h"
+
+/**
+ * @brief 
+ * Capacity of first deque buffer
+ */
+const size_t WDQ_MIN_CAPACITY = 16;
+
+/**
+ * @brief 
+ * Maximum number of deque buffers. Each buffer
+ * is twice as big as the previous one
+ */
+const size_t WDQ_MAX_BUFFERS  = 40;
+
+/**
+ * @brief 
+ * Work-stealing deque
+ * 
+ * @tparam T      stored type. `ElementTraits<T>` must be defined.
+ * Elements must be small enough to be copied atomically
+ * @tparam Policy protection policy, e.g. `StackProtection<Level>`
+ */
+template <typename T, typename Policy = StackProtection<STK_DEFAULT_PROT>>
+struct WorkDeque
+{
+    typedef T       element_type;
+    typedef Policy  policy_type;
+
+    [[no_unique_address]]
+    OptionalField_<Policy::has_canary,      canary_t,       0> canary_start_;
+
+    alignas(64)
+    long long           top_;           /* first element, advanced by thieves */
+    alignas(64)
+    long long           bottom_;        /* index after last element,
+                                            changed only by owner */
+    long long           poisoned_top_;  /* stolen slots before this
+                                            index are poisoned */
+    unsigned int        current_;       /* index of current buffer */
+    T*                  buffers_[WDQ_MAX_BUFFERS];
+                                        /* all buffers, old ones are kept
+                                            for thieves until destruction */
+
+    [[no_unique_address]]
+    OptionalField_<Policy::has_debug_info,  debug_info_,    3> debug_;
+
+    [[no_unique_address]]
+    OptionalField_<Policy::has_canary,      canary_t,       4> canary_end_;
+};
+
+/**
+ * @brief 
+ * Construct `WorkDeque` instance from parameters
+ * @param[out] deque     constructed instance
+ * @param[in]  name      variable name. Used only if
+ *                          policy has debug info
+ * @param[in]  func_name declaring function name. Used only if
+ *                          policy has debug info
+ * @param[in]  file_name declaring file name. Used only if
+ *                          policy has debug info
+ * @param[in]  line_num  declaration line. Used only if
+ *                          policy has debug info
+ * @return zero upon successful construction, non-zero otherwise
+ */
+template <typename T, typename Policy>
+int     WorkDequeCtor_      (WorkDeque<T, Policy>* deque,
+                            const char* name,
+                            const char* func_name,
+                            const char* file_name,
+                            size_t line_num);
+
+/**
+ * @brief 
+ * Construct `WorkDeque`
+ * 
+ * @param[out] deque constructed instance
+ * 
+ * @return zero upon successful construction, non-zero otherwise
+ */
+#define WorkDequeCtor(deque)                                        \
+                        WorkDequeCtor_(deque,                       \
+                                    #deque + (*#deque == '&'),      \
+                                    __PRETTY_FUNCTION__,            \
+                                    __FILE__, __LINE__);
+
+/**
+ * @brief 
+ * Clean up `WorkDeque` instance. Free associated resources.
+ * Must not be called concurrently with other operations
+ * 
+ * @param[inout] deque instance to be cleaned up
+ */
+template <typename T, typename Policy>
+void    WorkDequeDtor       (WorkDeque<T, Policy>* deque);
+
+/**
+ * @brief 
+ * Add element to the bottom of deque. Owner thread only
+ * 
+ * @param[inout] deque `WorkDeque` instance
+ * @param[in] value    value to be added
+ * @return zero upon success, some combination of
+ * `ErrorFlags` otherwise. `STK_POISON_VALUE` if value is poison
+ */
+template <typename T, typename Policy>
+unsigned int WorkDequePush  (WorkDeque<T, Policy>* deque, std::type_identity_t<T> value);
+
+/**
+ * @brief 
+ * Remove most recently pushed element from the bottom
+ * of deque. Owner thread only
+ * 
+ * @param[inout] deque `WorkDeque` instance
+ * @param[out] err Error code, i.e some combination of
+ * `ErrorFlags`. Parameter is ignored if set to NULL
+ * @return Removed value, poison if deque is empty
+ */
+template <typename T, typename Policy>
+T WorkDequePop              (WorkDeque<T, Policy>* deque, unsigned int* err = NULL);
+
+/**
+ * @brief 
+ * Remove oldest element from the top of deque. May be
+ * called by any thread
+ * 
+ * @param[inout] deque `WorkDeque` instance
+ * @param[out] err Error code, i.e some combination of
+ * `ErrorFlags`. Parameter is ignored if set to NULL
+ * @return Removed value, poison if deque is empty
+ */
+template <typename T, typename Policy>
+T WorkDequeSteal            (WorkDeque<T, Policy>* deque, unsigned int* err = NULL);
+
+/**
+ * @brief 
+ * Check deque integrity, including current buffer
+ * contents. Owner thread only
+ * 
+ * @param[in] deque `WorkDeque` instance
+ * @return zero if no errors found, some combination
+ * of `ErrorFlags` otherwise
+ */
+template <typename T, typename Policy>
+unsigned int WorkDequeCheck (const WorkDeque<T, Policy>* deque);
+
+#endif
@@ -0,0 +1,514 @@
+#ifndef CONCURRENT_STACK_IMPL
+#define CONCURRENT_STACK_IMPL
+
+/**
+ * @file concurrent_stack.h
+ * @author MeerkatBoss
+ * @brief Lock-free stack data structure
+ * @version 0.1
+ * @date 2022-10-06
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ * @warning This header DOES NOT support separate compilation
+ */
+
+#include "_concurrent_stack_interface.h"
+#include "stack.h"
+
+/**
+ * @brief 
+ * Number of spins pusher waits for popper in elimination slot
+ */
+const size_t CSTK_ELIMINATION_SPINS = 64;
+
+/**
+ * @brief 
+ * Maximum number of nodes in arena
+ */
+const unsigned long long CSTK_MAX_NODES =
+        CSTK_SEGMENT_BASE * ((1ULL << CSTK_SEGMENT_COUNT) - 1);
+
+/**
+ * @brief 
+ * Get node index from tagged index
+ */
+inline unsigned int GetTaggedIndex_(tagged_index_ tagged)
+{
+    return (unsigned int)(tagged & 0xFFFFFFFFULL);
+}
+
+/**
+ * @brief 
+ * Replace node index in tagged index, advancing its counter
+ */
+inline tagged_index_ MakeTagged_(tagged_index_ old, unsigned int index)
+{
+    return ((old >> 32) + 1) << 32 | index;
+}
+
+/**
+ * @brief 
+ * Get node by its index
+ * @param[in] stack `ConcurrentStack` instance
+ * @param[in] index node index, non-zero
+ * @return Pointer to node, `NULL` if its segment was not allocated
+ */
+template <typename T, typename Policy>
+ConcurrentNode_<T, Policy>* ConcurrentGetNode_  (const ConcurrentStack<T, Policy>* stack,
+                                                 unsigned int index);
+
+/**
+ * @brief 
+ * Take node from free list or arena. Reused node is checked
+ * to be intact and poisoned
+ * @param[inout] stack `ConcurrentStack` instance
+ * @param[out] index index of taken node
+ * @return zero upon success, some combination of
+ * `ErrorFlags` otherwise
+ */
+template <typename T, typename Policy>
+unsigned int ConcurrentAllocNode_   (ConcurrentStack<T, Policy>* stack, unsigned int* index);
+
+/**
+ * @brief 
+ * Poison node and return it to free list
+ * @param[inout] stack `ConcurrentStack` instance
+ * @param[in] index node index
+ */
+template <typename T, typename Policy>
+void ConcurrentFreeNode_            (ConcurrentStack<T, Policy>* stack, unsigned int index);
+
+/**
+ * @brief 
+ * Check node canaries and, if `check_value` is set,
+ * node checksum, otherwise check that node is poisoned
+ * @param[in] stack `ConcurrentStack` instance
+ * @param[in] node  checked node
+ * @param[in] index node index
+ * @param[in] check_value whether node stores element
+ * @return zero if no errors found, `STK_CORRUPTED_DATA` otherwise
+ */
+template <typename T, typename Policy>
+unsigned int ConcurrentCheckNode_   (const ConcurrentStack<T, Policy>* stack,
+                                     const ConcurrentNode_<T, Policy>* node,
+                                     unsigned int index, int check_value);
+
+/**
+ * @brief 
+ * Push node index to list
+ * @param[inout] list list head
+ * @param[inout] stack `ConcurrentStack` instance
+ * @param[in] index node index
+ * @param[in] eliminate whether to try exchanging node with
+ * concurrent pop upon contention
+ */
+template <typename T, typename Policy>
+void ConcurrentListPush_            (tagged_index_* list,
+                                     ConcurrentStack<T, Policy>* stack,
+                                     unsigned int index, int eliminate);
+
+/**
+ * @brief 
+ * Pop node index from list
+ * @param[inout] list list head
+ * @param[inout] stack `ConcurrentStack` instance
+ * @param[in] eliminate whether to try taking node from
+ * concurrent push upon contention
+ * @return Index of popped node, zero if list is empty
+ */
+template <typename T, typename Policy>
+unsigned int ConcurrentListPop_     (tagged_index_* list,
+                                     ConcurrentStack<T, Policy>* stack,
+                                     int eliminate);
+
+/**
+ * @brief 
+ * Offer node to concurrent pop through elimination slot
+ * @return 1 if node was taken, 0 otherwise
+ */
+template <typename T, typename Policy>
+int ConcurrentEliminatePush_        (ConcurrentStack<T, Policy>* stack, unsigned int index);
+
+/**
+ * @brief 
+ * Take node offered by concurrent push
+ * @return Index of taken node, zero if there is none
+ */
+template <typename T, typename Policy>
+unsigned int ConcurrentEliminatePop_(ConcurrentStack<T, Policy>* stack);
+
+/**
+ * @brief 
+ * Get pseudo-random elimination slot for calling thread
+ */
+inline size_t GetEliminationSlot_(void)
+{
+    static thread_local unsigned int seed = 0;
+    if (seed == 0)
+        seed = (unsigned int)(size_t)&seed | 1;
+
+    /* xorshift32 */
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed % CSTK_ELIMINATION_SLOTS;
+}
+
+/**
+ * @brief 
+ * Log `ConcurrentStack` error
+ * @param[in] stack `ConcurrentStack` instance
+ * @param[in] errs  some combination of `ErrorFlags`
+ * @param[in] what  error description
+ */
+inline void ConcurrentStackReport_(const void* stack, unsigned int errs, const char* what)
+{
+    log_message(MSG_ERROR, "Concurrent stack[%p] %s (error flags: %o)\n",
+                           stack, what, errs);
+}
+
+template <typename T, typename Policy>
+int ConcurrentStackCtor_(ConcurrentStack<T, Policy>* stack,
+                        [[maybe_unused]] const char* name,
+                        [[maybe_unused]] const char* func_name,
+                        [[maybe_unused]] const char* file_name,
+                        [[maybe_unused]] size_t line_num)
+{
+    *stack = {};
+
+    if constexpr (Policy::has_canary)
+    {
+        canary_t canary = CANARY ^ (canary_t)stack;
+        stack->canary_start_ = canary;
+        stack->canary_end_   = canary;
+    }
+
+    if constexpr (Policy::has_debug_info)
+        stack->debug_ = {
+            .name       = name,
+            .func_name  = func_name,
+            .file_name  = file_name,
+            .line_num   = line_num
+        };
+
+    log_message(MSG_TRACE, "Constructed concurrent stack at %p", stack);
+    return 0;
+}
+
+template <typename T, typename Policy>
+void ConcurrentStackDtor(ConcurrentStack<T, Policy>* stack)
+{
+    unsigned int errs = ConcurrentStackCheck(stack);
+    if (errs)
+    {
+        ConcurrentStackReport_(stack, errs, "is CORRUPTED");
+        return;
+    }
+
+    for (size_t k = 0; k < CSTK_SEGMENT_COUNT; k++)
+        if (stack->segments_[k])
+            BufferFree(stack->segments_[k],
+                       (CSTK_SEGMENT_BASE << k) * sizeof(ConcurrentNode_<T, Policy>));
+
+    *stack = {};
+    log_message(MSG_TRACE, "Destroyed concurrent stack at %p", stack);
+}
+
+template <typename T, typename Policy>
+unsigned int ConcurrentStackPush(ConcurrentStack<T, Policy>* stack,
+                                 std::type_identity_t<T> value)
+{
+    unsigned int errs = ConcurrentStackCheck(stack);
+    if (errs)
+    {
+        ConcurrentStackReport_(stack, errs, "is CORRUPTED");
+        return errs;
+    }
+
+    /* Poison marks free nodes */
+    if (ElementTraits<T>::IsPoison(value))
+    {
+        log_message(MSG_WARNING, "Attempt to push poison value to stack %p spotted.", stack);
+        return STK_POISON_VALUE;
+    }
+
+    unsigned int index = 0;
+    errs = ConcurrentAllocNode_(stack, &index);
+    if (errs)
+        return errs;
+
+    ConcurrentNode_<T, Policy>* node = ConcurrentGetNode_(stack, index);
+    node->value = value;
+    if constexpr (Policy::has_hash)
+        node->checksum_ = GetSlotHash(&node->value, sizeof(T), index);
+
+    ConcurrentListPush_(&stack->head_, stack, index, 1);
+
+    return STK_NO_ERROR;
+}
+
+template <typename T, typename Policy>
+T ConcurrentStackPopCopy(ConcurrentStack<T, Policy>* stack, unsigned int* err)
+{
+    unsigned int errs = ConcurrentStackCheck(stack);
+    if (errs)
+    {
+        ConcurrentStackReport_(stack, errs, "is CORRUPTED");
+        TRY_ASSIGN_PTR(err, errs);
+        return ElementTraits<T>::poison;
+    }
+
+    unsigned int index = ConcurrentListPop_(&stack->head_, stack, 1);
+    if (index == 0)
+    {
+        TRY_ASSIGN_PTR(err, STK_EMPTY);
+        return ElementTraits<T>::poison;
+    }
+
+    ConcurrentNode_<T, Policy>* node = ConcurrentGetNode_(stack, index);
+
+    errs = ConcurrentCheckNode_(stack, node, index, 1);
+    if (errs)
+    {
+        /* Damaged node is leaked rather than reused */
+        ConcurrentStackReport_(stack, errs, "popped CORRUPTED node");
+        TRY_ASSIGN_PTR(err, errs);
+        return ElementTraits<T>::poison;
+    }
+
+    T result = node->value;
+    ConcurrentFreeNode_(stack, index);
+
+    TRY_ASSIGN_PTR(err, STK_NO_ERROR);
+    return result;
+}
+
+template <typename T, typename Policy>
+unsigned int ConcurrentStackPop(ConcurrentStack<T, Policy>* stack)
+{
+    unsigned int err = STK_NO_ERROR;
+    ConcurrentStackPopCopy(stack, &err);
+    return err;
+}
+
+template <typename T, typename Policy>
+unsigned int ConcurrentStackCheck(const ConcurrentStack<T, Policy>* stack)
+{
+    if (!CanReadRange(stack, sizeof(*stack)))
+        return STK_BAD_PTR;
+
+    unsigned int flags = STK_NO_ERROR;
+
+    if constexpr (Policy::has_canary)
+    {
+    canary_t canary = CANARY ^ (canary_t)stack;
+    flags |= GetErrorFlag(stack->canary_start_ != canary,       STK_DEAD_CANARY);
+    flags |= GetErrorFlag(stack->canary_end_   != canary,       STK_DEAD_CANARY);
+    }
+
+    return flags;
+}
+
+template <typename T, typename Policy>
+ConcurrentNode_<T, Policy>* ConcurrentGetNode_(const ConcurrentStack<T, Policy>* stack,
+                                               unsigned int index)
+{
+    /* Segment `k` holds nodes [BASE*(2^k - 1), BASE*(2^(k+1) - 1)) */
+    unsigned long long position = index - 1;
+    unsigned long long scaled   = position / CSTK_SEGMENT_BASE + 1;
+    size_t segment = (size_t)(63 - __builtin_clzll(scaled));
+    size_t offset  = (size_t)(position - CSTK_SEGMENT_BASE * ((1ULL << segment) - 1));
+
+    ConcurrentNode_<T, Policy>* nodes =
+            __atomic_load_n(&stack->segments_[segment], __ATOMIC_ACQUIRE);
+
+    return nodes ? nodes + offset : NULL;
+}
+
+template <typename T, typename Policy>
+unsigned int ConcurrentAllocNode_(ConcurrentStack<T, Policy>* stack, unsigned int* index)
+{
+    unsigned int reused = ConcurrentListPop_(&stack->free_, stack, 0);
+    if (reused)
+    {
+        unsigned int errs = ConcurrentCheckNode_(stack, ConcurrentGetNode_(stack, reused),
+                                                 reused, 0);
+        if (errs)
+        {
+            ConcurrentStackReport_(stack, errs, "has CORRUPTED free node");
+            return errs;
+        }
+
+        *index = reused;
+        return STK_NO_ERROR;
+    }
+
+    unsigned long long position = __atomic_fetch_add(&stack->allocated_, 1, __ATOMIC_RELAXED);
+    if (position >= CSTK_MAX_NODES)
+    {
+        log_message(MSG_WARNING, "Concurrent stack %p has no free nodes", stack);
+        return STK_NO_MEMORY;
+    }
+
+    *index = (unsigned int)(position + 1);
+    if (ConcurrentGetNode_(stack, *index))
+        return STK_NO_ERROR;
+
+    /* First node in segment is not necessarily taken first,
+       so any thread may need to allocate segment */
+    typedef typename ConcurrentStack<T, Policy>::node_type node_t;
+
+    size_t segment    = (size_t)(63 - __builtin_clzll(position / CSTK_SEGMENT_BASE + 1));
+    size_t node_count = CSTK_SEGMENT_BASE << segment;
+
+    node_t* nodes = (node_t*)BufferRealloc(NULL, 0, node_count * sizeof(node_t));
+    if (!nodes)
+    {
+        log_message(MSG_WARNING, "Failed to allocate nodes for concurrent stack %p. "
+                                 "Not enough memory", stack);
+        return STK_NO_MEMORY;
+    }
+
+    for (size_t i = 0; i < node_count; i++)
+    {
+        if constexpr (Policy::has_canary)
+        {
+            canary_t canary = CANARY ^ (canary_t)(nodes + i);
+            nodes[i].canary_start_ = canary;
+            nodes[i].canary_end_   = canary;
+        }
+        nodes[i].next  = 0;
+        nodes[i].value = ElementTraits<T>::poison;
+    }
+
+    node_t* expected = NULL;
+    if (!__atomic_compare_exchange_n(&stack->segments_[segment], &expected, nodes, 0,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        BufferFree(nodes, node_count * sizeof(node_t));
+
+    return STK_NO_ERROR;
+}
+
+template <typename T, typename Policy>
+void ConcurrentFreeNode_(ConcurrentStack<T, Policy>* stack, unsigned int index)
+{
+    ConcurrentGetNode_(stack, index)->value = ElementTraits<T>::poison;
+    ConcurrentListPush_(&stack->free_, stack, index, 0);
+}
+
+template <typename T, typename Policy>
+unsigned int ConcurrentCheckNode_([[maybe_unused]] const ConcurrentStack<T, Policy>* stack,
+                                  const ConcurrentNode_<T, Policy>* node,
+                                  [[maybe_unused]] unsigned int index, int check_value)
+{
+    if constexpr (Policy::has_canary)
+    {
+        canary_t canary = CANARY ^ (canary_t)node;
+        if (node->canary_start_ != canary || node->canary_end_ != canary)
+            return STK_CORRUPTED_DATA;
+    }
+
+    if (!check_value)
+        return ElementTraits<T>::IsPoison(node->value) ? STK_NO_ERROR : STK_CORRUPTED_DATA;
+
+    if (ElementTraits<T>::IsPoison(node->value))
+        return STK_CORRUPTED_DATA;
+
+    if constexpr (Policy::has_hash)
+        if (node->checksum_ != GetSlotHash(&node->value, sizeof(T), index))
+            return STK_CORRUPTED_DATA;
+
+    return STK_NO_ERROR;
+}
+
+template <typename T, typename Policy>
+void ConcurrentListPush_(tagged_index_* list, ConcurrentStack<T, Policy>* stack,
+                         unsigned int index, int eliminate)
+{
+    ConcurrentNode_<T, Policy>* node = ConcurrentGetNode_(stack, index);
+
+    tagged_index_ head = __atomic_load_n(list, __ATOMIC_RELAXED);
+    for (;;)
+    {
+        __atomic_store_n(&node->next, GetTaggedIndex_(head), __ATOMIC_RELAXED);
+
+        if (__atomic_compare_exchange_n(list, &head, MakeTagged_(head, index), 1,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+            return;
+
+        if (eliminate && ConcurrentEliminatePush_(stack, index))
+            return;
+    }
+}
+
+template <typename T, typename Policy>
+unsigned int ConcurrentListPop_(tagged_index_* list, ConcurrentStack<T, Policy>* stack,
+                                int eliminate)
+{
+    tagged_index_ head = __atomic_load_n(list, __ATOMIC_ACQUIRE);
+    for (;;)
+    {
+        unsigned int index = GetTaggedIndex_(head);
+        if (index == 0)
+            return 0;
+
+        /* Node may be popped and reused concurrently, in which case
+           its `next` is stale, but CAS below fails due to changed tag */
+        unsigned int next = __atomic_load_n(&ConcurrentGetNode_(stack, index)->next,
+                                            __ATOMIC_RELAXED);
+
+        if (__atomic_compare_exchange_n(list, &head, MakeTagged_(head, next), 1,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE))
+            return index;
+
+        if (eliminate)
+        {
+            unsigned int taken = ConcurrentEliminatePop_(stack);
+            if (taken)
+                return taken;
+        }
+    }
+}
+
+template <typename T, typename Policy>
+int ConcurrentEliminatePush_(ConcurrentStack<T, Policy>* stack, unsigned int index)
+{
+    tagged_index_* slot = &stack->elimination_[GetEliminationSlot_()].offer;
+
+    tagged_index_ empty = __atomic_load_n(slot, __ATOMIC_RELAXED);
+    if (GetTaggedIndex_(empty) != 0)
+        return 0;
+
+    tagged_index_ offer = MakeTagged_(empty, index);
+    if (!__atomic_compare_exchange_n(slot, &empty, offer, 0,
+                                     __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+        return 0;
+
+    for (size_t i = 0; i < CSTK_ELIMINATION_SPINS; i++)
+        if (__atomic_load_n(slot, __ATOMIC_RELAXED) != offer)
+            return 1;
+
+    /* Withdraw offer, failure means it was taken meanwhile */
+    tagged_index_ expected = offer;
+    return !__atomic_compare_exchange_n(slot, &expected, offer & ~0xFFFFFFFFULL, 0,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+template <typename T, typename Policy>
+unsigned int ConcurrentEliminatePop_(ConcurrentStack<T, Policy>* stack)
+{
+    tagged_index_* slot = &stack->elimination_[GetEliminationSlot_()].offer;
+
+    tagged_index_ offer = __atomic_load_n(slot, __ATOMIC_RELAXED);
+    if (GetTaggedIndex_(offer) == 0)
+        return 0;
+
+    if (!__atomic_compare_exchange_n(slot, &offer, offer & ~0xFFFFFFFFULL, 0,
+                                     __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        return 0;
+
+    return GetTaggedIndex_(offer);
+}
+
+#endif
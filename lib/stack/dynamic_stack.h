@@ -0,0 +1,444 @@
+#ifndef DYNAMIC_STACK_IMPL
+#define DYNAMIC_STACK_IMPL
+
+/**
+ * @file dynamic_stack.h
+ * @author MeerkatBoss
+ * @brief Dynamically protected stack data structure
+ * @version 0.1
+ * @date 2022-10-11
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ * @note `DynamicStack` is constructed with the same `StackCtor`
+ * macro and checked with the same `StackAssert` and `StackDump`
+ * macros as `TypedStack`
+ * 
+ * @warning This header DOES NOT support separate compilation
+ */
+
+#include "_dynamic_stack_interface.h"
+#include "stack.h"
+
+/**
+ * @brief 
+ * Check `DynamicStack` and print its contents if it is
+ * corrupted or `force_dump` is set
+ */
+template <typename T>
+unsigned int    StackAssert_       (const DynamicStack<T>* stack,
+                                    const char*   func,
+                                    const char*   file,
+                                    size_t        line,
+                                    int force_dump = 0);
+
+/**
+ * @brief 
+ * Operations of single protection level
+ * 
+ * @tparam T     stored type
+ * @tparam Level some combination of `STK_CANARY_PROT`,
+ * `STK_HASH_PROT` and `STK_DEBUG_INFO`
+ */
+template <typename T, unsigned int Level>
+struct DynamicStackLevel_
+{
+    typedef TypedStack<T, StackProtection<Level>> stack_type;
+
+    static_assert(sizeof (stack_type) <= sizeof (typename DynamicStack<T>::largest_type_) &&
+                  alignof(stack_type) <= alignof(typename DynamicStack<T>::largest_type_),
+                  "Stack of this level does not fit storage");
+
+    static int Ctor(void* stack, const debug_info_* debug, const growth_policy* growth)
+    {
+        return StackCtor_((stack_type*)stack, debug->name, debug->func_name,
+                                              debug->file_name, debug->line_num, growth);
+    }
+
+    static void Dtor(void* stack) { StackDtor((stack_type*)stack); }
+
+    static unsigned int Push(void* raw, T value)
+    {
+        stack_type* stack = (stack_type*)raw;
+
+        if constexpr (Level != 0)
+            return StackPush(stack, value);
+
+        if (ElementTraits<T>::IsPoison(value))
+            return STK_POISON_VALUE;
+
+        if (StackTryGrow_(stack) < 0)
+        {
+            log_message(MSG_WARNING, "Failed to push to stack %p. Not enough memory", stack);
+            return STK_NO_MEMORY;
+        }
+
+        stack->data[stack->size++] = value;
+        return STK_NO_ERROR;
+    }
+
+    static unsigned int Pop(void* raw)
+    {
+        stack_type* stack = (stack_type*)raw;
+
+        if constexpr (Level != 0)
+            return StackPop(stack);
+
+        if (stack->size == 0)
+            return STK_EMPTY;
+
+        /* Free slots stay poisoned, so that level can be raised */
+        stack->data[--stack->size] = ElementTraits<T>::poison;
+        StackTryShrink_(stack);
+
+        return STK_NO_ERROR;
+    }
+
+    static T PopCopy(void* raw, unsigned int* err)
+    {
+        stack_type* stack = (stack_type*)raw;
+
+        if constexpr (Level != 0)
+            return StackPopCopy(stack, err);
+
+        if (stack->size == 0)
+        {
+            TRY_ASSIGN_PTR(err, STK_EMPTY);
+            return ElementTraits<T>::poison;
+        }
+
+        T result = stack->data[--stack->size];
+        stack->data[stack->size] = ElementTraits<T>::poison;
+        StackTryShrink_(stack);
+
+        TRY_ASSIGN_PTR(err, STK_NO_ERROR);
+        return result;
+    }
+
+    static T* Peek(const void* raw, unsigned int* err)
+    {
+        const stack_type* stack = (const stack_type*)raw;
+
+        if constexpr (Level != 0)
+            return StackPeek(stack, err);
+
+        if (stack->size == 0)
+        {
+            TRY_ASSIGN_PTR(err, STK_EMPTY);
+            return NULL;
+        }
+
+        TRY_ASSIGN_PTR(err, STK_NO_ERROR);
+        return stack->data + stack->size - 1;
+    }
+
+    static unsigned int PushN(void* stack, const T* values, size_t count)
+    {
+        return StackPushN((stack_type*)stack, values, count);
+    }
+
+    static unsigned int PopN(void* stack, T* values, size_t count)
+    {
+        return StackPopN((stack_type*)stack, values, count);
+    }
+
+    static unsigned int ReplaceN(void* stack, size_t pop_count,
+                                              const T* values, size_t push_count)
+    {
+        return StackReplaceN((stack_type*)stack, pop_count, values, push_count);
+    }
+
+    static unsigned int PeekN(const void* stack, T* values, size_t count)
+    {
+        return StackPeekN((const stack_type*)stack, values, count);
+    }
+
+    static unsigned int Check(const void* stack)
+    {
+        return StackCheck((const stack_type*)stack);
+    }
+
+    static unsigned int Assert(const void* stack, const char* func,
+                                                  const char* file,
+                                                  size_t line,
+                                                  int force_dump)
+    {
+        return StackAssert_((const stack_type*)stack, func, file, line, force_dump);
+    }
+
+    static unsigned int Move(void* dest, void* source)
+    {
+        return StackMove((stack_type*)dest, (stack_type*)source);
+    }
+
+    static size_t View(const void* raw, const T** data)
+    {
+        const stack_type* stack = (const stack_type*)raw;
+
+        *data = stack->data;
+        return stack->size;
+    }
+
+    static unsigned int Clear(void* raw)
+    {
+        stack_type* stack = (stack_type*)raw;
+
+        unsigned int err = StackPopN(stack, (T*)NULL, stack->size);
+        if (err) return err;
+
+        StackRekey_(stack);
+        return STK_NO_ERROR;
+    }
+
+    static size_t Capacity(const void* stack)
+    {
+        return ((const stack_type*)stack)->capacity;
+    }
+
+    static constexpr dynamic_stack_ops_<T> ops = {
+        .ctor       = Ctor,
+        .dtor       = Dtor,
+        .push       = Push,
+        .pop        = Pop,
+        .pop_copy   = PopCopy,
+        .peek       = Peek,
+        .push_n     = PushN,
+        .pop_n      = PopN,
+        .replace_n  = ReplaceN,
+        .peek_n     = PeekN,
+        .check      = Check,
+        .assert_    = Assert,
+        .move       = Move,
+        .view       = View,
+        .clear      = Clear,
+        .capacity   = Capacity
+    };
+};
+
+/**
+ * @brief 
+ * Operations table indexed by protection level
+ */
+template <typename T>
+inline constexpr dynamic_stack_ops_<T> DynamicStackOps_[STK_DYNAMIC_PROT + 1] = {
+    DynamicStackLevel_<T, 0>::ops, DynamicStackLevel_<T, 1>::ops,
+    DynamicStackLevel_<T, 2>::ops, DynamicStackLevel_<T, 3>::ops,
+    DynamicStackLevel_<T, 4>::ops, DynamicStackLevel_<T, 5>::ops,
+    DynamicStackLevel_<T, 6>::ops, DynamicStackLevel_<T, 7>::ops,
+};
+
+/**
+ * @brief 
+ * Get operations of stack protection level
+ */
+template <typename T>
+inline const dynamic_stack_ops_<T>* DynamicStackGetOps_(const DynamicStack<T>* stack)
+{
+    return &DynamicStackOps_<T>[stack->level_ & STK_DYNAMIC_PROT];
+}
+
+template <typename T>
+int StackCtor_(DynamicStack<T>* stack,
+               const char* name,
+               const char* func_name,
+               const char* file_name,
+               size_t line_num,
+               const growth_policy* growth,
+               unsigned int level)
+{
+    *stack = {};
+
+    if (level & ~(unsigned int)STK_DYNAMIC_PROT)
+        log_message(MSG_WARNING, "Protection bits %o are not available "
+                                 "for dynamic stack %p", level & ~(unsigned int)STK_DYNAMIC_PROT,
+                                                         stack);
+
+    stack->level_  = level & STK_DYNAMIC_PROT;
+    stack->growth_ = growth;
+    stack->debug_  = {
+        .name       = name,
+        .func_name  = func_name,
+        .file_name  = file_name,
+        .line_num   = line_num
+    };
+
+    if (DynamicStackGetOps_(stack)->ctor(stack->storage_, &stack->debug_, growth) != 0)
+    {
+        *stack = {};
+        return -1;
+    }
+
+    return 0;
+}
+
+template <typename T>
+void StackDtor(DynamicStack<T>* stack)
+{
+    if (!stack) return;
+
+    DynamicStackGetOps_(stack)->dtor(stack->storage_);
+    *stack = {};
+}
+
+template <typename T>
+unsigned int StackSetProtection(DynamicStack<T>* stack, unsigned int level)
+{
+    if (!stack) return STK_BAD_PTR;
+
+    if (level & ~(unsigned int)STK_DYNAMIC_PROT)
+        log_message(MSG_WARNING, "Protection bits %o are not available "
+                                 "for dynamic stack %p", level & ~(unsigned int)STK_DYNAMIC_PROT,
+                                                         stack);
+    level &= STK_DYNAMIC_PROT;
+
+    const dynamic_stack_ops_<T>* old_ops = DynamicStackGetOps_(stack);
+    const dynamic_stack_ops_<T>* new_ops = &DynamicStackOps_<T>[level];
+
+    unsigned int err = StackAssert(stack);
+    if (err) return err;
+
+    if (new_ops == old_ops)
+        return STK_NO_ERROR;
+
+    /* New stack is built aside, so that failure leaves old one intact */
+    alignas(typename DynamicStack<T>::largest_type_)
+    unsigned char temp[sizeof(stack->storage_)] = {};
+
+    if (new_ops->ctor(temp, &stack->debug_, stack->growth_) != 0)
+        return STK_NO_MEMORY;
+
+    const T* data = NULL;
+    size_t   size = old_ops->view(stack->storage_, &data);
+
+    err = new_ops->push_n(temp, data, size);
+    if (err)
+    {
+        new_ops->dtor(temp);
+        return err;
+    }
+
+    old_ops->dtor(stack->storage_);
+    new_ops->move(stack->storage_, temp);
+    stack->level_ = level;
+
+    log_message(MSG_TRACE, "Changed protection level of stack %p to %o", stack, level);
+    return STK_NO_ERROR;
+}
+
+template <typename T>
+unsigned int StackGetProtection(const DynamicStack<T>* stack)
+{
+    return stack->level_ & STK_DYNAMIC_PROT;
+}
+
+template <typename T>
+unsigned int StackPush(DynamicStack<T>* stack, std::type_identity_t<T> value)
+{
+    if (!stack) return STK_BAD_PTR;
+    return DynamicStackGetOps_(stack)->push(stack->storage_, value);
+}
+
+template <typename T>
+unsigned int StackPop(DynamicStack<T>* stack)
+{
+    if (!stack) return STK_BAD_PTR;
+    return DynamicStackGetOps_(stack)->pop(stack->storage_);
+}
+
+template <typename T>
+T StackPopCopy(DynamicStack<T>* stack, unsigned int* err)
+{
+    if (!stack)
+    {
+        TRY_ASSIGN_PTR(err, STK_BAD_PTR);
+        return ElementTraits<T>::poison;
+    }
+    return DynamicStackGetOps_(stack)->pop_copy(stack->storage_, err);
+}
+
+template <typename T>
+T* StackPeek(const DynamicStack<T>* stack, unsigned int* err)
+{
+    if (!stack)
+    {
+        TRY_ASSIGN_PTR(err, STK_BAD_PTR);
+        return NULL;
+    }
+    return DynamicStackGetOps_(stack)->peek(stack->storage_, err);
+}
+
+template <typename T>
+unsigned int StackPushN(DynamicStack<T>* stack, const T* values, size_t count)
+{
+    if (!stack) return STK_BAD_PTR;
+    return DynamicStackGetOps_(stack)->push_n(stack->storage_, values, count);
+}
+
+template <typename T>
+unsigned int StackPopN(DynamicStack<T>* stack, T* values, size_t count)
+{
+    if (!stack) return STK_BAD_PTR;
+    return DynamicStackGetOps_(stack)->pop_n(stack->storage_, values, count);
+}
+
+template <typename T>
+unsigned int StackReplaceN(DynamicStack<T>* stack, size_t pop_count,
+                           const T* values, size_t push_count)
+{
+    if (!stack) return STK_BAD_PTR;
+    return DynamicStackGetOps_(stack)->replace_n(stack->storage_, pop_count,
+                                                 values, push_count);
+}
+
+template <typename T>
+unsigned int StackPeekN(const DynamicStack<T>* stack, T* values, size_t count)
+{
+    if (!stack) return STK_BAD_PTR;
+    return DynamicStackGetOps_(stack)->peek_n(stack->storage_, values, count);
+}
+
+template <typename T>
+unsigned int StackClear(DynamicStack<T>* stack)
+{
+    if (!stack) return STK_BAD_PTR;
+    return DynamicStackGetOps_(stack)->clear(stack->storage_);
+}
+
+template <typename T>
+size_t StackGetCapacity(const DynamicStack<T>* stack)
+{
+    if (!stack) return 0;
+    return DynamicStackGetOps_(stack)->capacity(stack->storage_);
+}
+
+template <typename T>
+unsigned int StackCheck(const DynamicStack<T>* stack)
+{
+    if (!CanReadRange(stack, sizeof(*stack)))
+        return STK_BAD_PTR;
+    return DynamicStackGetOps_(stack)->check(stack->storage_);
+}
+
+template <typename T>
+unsigned int StackAssert_(const DynamicStack<T>* stack,
+                          const char* func,
+                          const char* file,
+                          size_t line,
+                          int force_dump)
+{
+    if (!CanReadRange(stack, sizeof(*stack)))
+    {
+        log_message(MSG_ERROR, "Invalid dynamic stack pointer %p\n"
+                               "\tin %s:%zu in file \'%s\'\n",
+                               stack, func, line, file);
+        return STK_BAD_PTR;
+    }
+
+    if (force_dump)
+        log_message(MSG_INFO, "Dynamic stack[%p] protection level: %o\n",
+                              stack, StackGetProtection(stack));
+
+    return DynamicStackGetOps_(stack)->assert_(stack->storage_, func, file, line, force_dump);
+}
+
+#endif
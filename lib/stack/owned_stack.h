@@ -0,0 +1,148 @@
+#ifndef OWNED_STACK_H
+#define OWNED_STACK_H
+
+/**
+ * @file owned_stack.h
+ * @author MeerkatBoss
+ * @brief Owning wrapper of `TypedStack`
+ * @version 0.1
+ * @date 2022-10-10
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ * @note `OwnedStack` constructs stack upon creation and destroys
+ * it upon destruction. It can be moved, but not copied. Moving
+ * transfers buffer and updates canaries and hash for new address,
+ * so it takes constant time. Stack with inline storage copies
+ * its inline elements.
+ * 
+ * @note Operations return `ErrorFlags` the same way as functions
+ * they wrap. Underlying `TypedStack` is available through `Get`
+ * 
+ * @warning This header DOES NOT support separate compilation
+ */
+
+#include <source_location>
+
+#include "stack.h"
+
+/**
+ * @brief 
+ * Owning wrapper of `TypedStack<T, Policy>`
+ * 
+ * @tparam T      stored type. `ElementTraits<T>` must be defined
+ * @tparam Policy protection policy, e.g. `StackProtection<Level>`
+ */
+template <typename T, typename Policy = StackProtection<STK_DEFAULT_PROT>>
+class OwnedStack
+{
+public:
+    typedef TypedStack<T, Policy> stack_type;
+
+    /**
+     * @brief 
+     * Construct empty stack
+     * 
+     * @param[in] name     stack name. Used only if policy has debug info
+     * @param[in] growth   capacity growth policy, `STK_GROWTH_DEFAULT`
+     *                      if set to NULL. Must outlive the stack
+     * @param[in] location declaration place. Used only if policy
+     *                      has debug info
+     */
+    explicit OwnedStack(const char* name = "OwnedStack",
+                        const growth_policy* growth = NULL,
+                        std::source_location location = std::source_location::current())
+    {
+        if (StackCtor_(&stack_, name, location.function_name(), location.file_name(),
+                       location.line(), growth) != 0)
+            stack_ = {};
+    }
+
+    /* Moved-from and failed stacks are not moved, so that they
+     * are not reported as corrupted */
+    OwnedStack(OwnedStack&& other) noexcept
+    {
+        if (other.IsConstructed())
+            StackMove(&stack_, &other.stack_);
+    }
+
+    OwnedStack& operator=(OwnedStack&& other) noexcept
+    {
+        if (this == &other)
+            return *this;
+
+        if (IsConstructed())
+            StackDtor(&stack_);
+        stack_ = {};
+
+        if (other.IsConstructed())
+            StackMove(&stack_, &other.stack_);
+
+        return *this;
+    }
+
+    OwnedStack(const OwnedStack&)            = delete;
+    OwnedStack& operator=(const OwnedStack&) = delete;
+
+    ~OwnedStack()
+    {
+        if (IsConstructed())
+            StackDtor(&stack_);
+    }
+
+    /**
+     * @brief 
+     * Check whether stack was constructed and not moved from
+     */
+    bool IsConstructed() const { return stack_.data != NULL; }
+
+    size_t Size()     const { return stack_.size; }
+    size_t Capacity() const { return stack_.capacity; }
+
+    unsigned int Push(std::type_identity_t<T> value) { return StackPush(&stack_, value); }
+
+    /**
+     * @brief 
+     * Construct element on top of stack from `args`
+     */
+    template <typename... Args>
+    unsigned int Emplace(Args&&... args)
+    {
+        return StackEmplace(&stack_, std::forward<Args>(args)...);
+    }
+
+    unsigned int Pop() { return StackPop(&stack_); }
+
+    T PopCopy(unsigned int* err = NULL) { return StackPopCopy(&stack_, err); }
+
+    /**
+     * @brief 
+     * Get top element. Pointer invalidates after `Pop`
+     */
+    T* Peek(unsigned int* err = NULL) const { return StackPeek(&stack_, err); }
+
+    unsigned int Reserve(size_t capacity) { return StackReserve(&stack_, capacity); }
+
+    unsigned int Check() const { return StackCheck(&stack_); }
+
+    /**
+     * @brief 
+     * Exchange contents with `other` without copying buffers
+     */
+    unsigned int Swap(OwnedStack& other) { return StackSwap(&stack_, &other.stack_); }
+
+    /**
+     * @brief 
+     * Discard contents and take buffer of `other`,
+     * leaving `other` empty
+     */
+    unsigned int Steal(OwnedStack& other) { return StackSteal(&stack_, &other.stack_); }
+
+    stack_type*       Get()       { return &stack_; }
+    const stack_type* Get() const { return &stack_; }
+
+private:
+    stack_type stack_ = {};
+};
+
+#endif
@@ -0,0 +1,571 @@
+#ifndef SEGMENTED_STACK_IMPL
+#define SEGMENTED_STACK_IMPL
+
+/**
+ * @file segmented_stack.h
+ * @author MeerkatBoss
+ * @brief Segmented stack data structure
+ * @version 0.1
+ * @date 2022-10-08
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ * @note `SegmentedStack` is constructed with the same `StackCtor`
+ * macro and checked with the same `StackAssert` and `StackDump`
+ * macros as `TypedStack`
+ * 
+ * @warning This header DOES NOT support separate compilation
+ */
+
+#include "_segmented_stack_interface.h"
+#include "stack.h"
+
+/**
+ * @brief 
+ * Check stack header and chunk directory
+ * @param[in] stack `SegmentedStack` instance
+ * @return zero if no errors found, some combination
+ * of `ErrorFlags` otherwise
+ */
+template <typename T, typename Policy, size_t C>
+unsigned int    StackHeaderCheck_   (const SegmentedStack<T, Policy, C>* stack);
+
+/**
+ * @brief 
+ * Check single chunk: canaries, stored elements and
+ * poisoned free slots
+ * @param[in] chunk chunk data
+ * @param[in] fill  number of elements in chunk
+ * @return zero if no errors found, some combination
+ * of `ErrorFlags` otherwise
+ */
+template <typename Policy, typename T, size_t C>
+unsigned int    SegmentedChunkCheck_(const T* chunk, size_t fill);
+
+/**
+ * @brief 
+ * Check stack header and top chunk. Takes time
+ * independent of stack size. Called by `StackAssert`
+ * @param[in] stack `SegmentedStack` instance
+ * @return zero if no errors found, some combination
+ * of `ErrorFlags` otherwise
+ */
+template <typename T, typename Policy, size_t C>
+unsigned int    StackScheduledCheck_(const SegmentedStack<T, Policy, C>* stack);
+
+/**
+ * @brief 
+ * Check stack and print its contents. Called by `StackAssert` and `StackDump`
+ * @param[in] stack `SegmentedStack` instance
+ * @param[in] func  calling function name
+ * @param[in] file  calling file name
+ * @param[in] line  calling line
+ * @param[in] force perform full check and print stack contents
+ * even if no errors were found
+ * @return zero if no errors found, some combination
+ * of `ErrorFlags` otherwise
+ */
+template <typename T, typename Policy, size_t C>
+unsigned int    StackAssert_        (const SegmentedStack<T, Policy, C>* stack,
+                                     const char*  func,
+                                     const char*  file,
+                                     size_t       line,
+                                     int force);
+
+/**
+ * @brief 
+ * Get number of elements in chunk
+ * @param[in] stack `SegmentedStack` instance
+ * @param[in] chunk chunk index
+ * @return Number of elements
+ */
+template <typename T, typename Policy, size_t C>
+size_t          SegmentedChunkFill_ (const SegmentedStack<T, Policy, C>* stack, size_t chunk);
+
+/**
+ * @brief 
+ * Append chunk to directory, taking cached chunk if there is one
+ * @param[inout] stack `SegmentedStack` instance
+ * @return zero upon success, non-zero otherwise
+ */
+template <typename T, typename Policy, size_t C>
+int             SegmentedAddChunk_  (SegmentedStack<T, Policy, C>* stack);
+
+/**
+ * @brief 
+ * Remove empty top chunk from directory. Chunk is cached,
+ * if there is no cached chunk yet, and freed otherwise
+ * @param[inout] stack `SegmentedStack` instance
+ */
+template <typename T, typename Policy, size_t C>
+void            SegmentedRemoveChunk_(SegmentedStack<T, Policy, C>* stack);
+
+/**
+ * @brief 
+ * Get stack slot by element index
+ * @param[in] stack `SegmentedStack` instance
+ * @param[in] index element index
+ * @return Pointer to slot
+ */
+template <typename T, typename Policy, size_t C>
+T*              SegmentedSlot_      (const SegmentedStack<T, Policy, C>* stack, size_t index);
+
+/**
+ * @brief 
+ * Calculate stack header hash
+ * @param[in] stack `SegmentedStack` instance
+ * @return Hash value
+ */
+template <typename T, typename Policy, size_t C>
+hash_t          GetStackHash_       (const SegmentedStack<T, Policy, C>* stack);
+
+/**
+ * @brief 
+ * Update stack header hash
+ * @param[inout] stack `SegmentedStack` instance
+ */
+template <typename T, typename Policy, size_t C>
+void            StackUpdateHash_    (SegmentedStack<T, Policy, C>* stack);
+
+template <typename T, typename Policy, size_t C>
+int StackCtor_(SegmentedStack<T, Policy, C>* stack,
+               [[maybe_unused]] const char* name,
+               [[maybe_unused]] const char* func_name,
+               [[maybe_unused]] const char* file_name,
+               [[maybe_unused]] size_t line_num)
+{
+    static_assert(C > 0, "Chunk must hold at least one element");
+
+    *stack = {};
+
+    stack->chunks = (T**)BufferRealloc(NULL, 0, sizeof(T*));
+    if (!stack->chunks)
+        return -1;
+
+    stack->chunks[0] = ReallocWithCanary_<Policy>((T*)NULL, 0, C);
+    if (!stack->chunks[0])
+    {
+        BufferFree(stack->chunks, sizeof(T*));
+        stack->chunks = NULL;
+        return -1;
+    }
+
+    stack->chunk_count    = 1;
+    stack->directory_size = 1;
+
+    if constexpr (Policy::has_canary)
+    {
+        canary_t canary = CANARY ^ (canary_t)stack;
+        stack->canary_start_ = canary;
+        stack->canary_end_   = canary;
+    }
+
+    if constexpr (Policy::has_debug_info)
+        stack->debug_ = {
+            .name       = name,
+            .func_name  = func_name,
+            .file_name  = file_name,
+            .line_num   = line_num
+        };
+
+    StackUpdateHash_(stack);
+
+    log_message(MSG_TRACE, "Constructed segmented stack at %p", stack);
+    return 0;
+}
+
+template <typename T, typename Policy, size_t C>
+void StackDtor(SegmentedStack<T, Policy, C>* stack)
+{
+    if (StackAssert(stack) != STK_NO_ERROR)
+        return;
+
+    for (size_t i = 0; i < stack->chunk_count; i++)
+        FreeWithCanary_<Policy>(stack->chunks[i], C);
+    if (stack->spare_)
+        FreeWithCanary_<Policy>(stack->spare_, C);
+    BufferFree(stack->chunks, stack->directory_size*sizeof(T*));
+
+    *stack = {};
+    log_message(MSG_TRACE, "Destroyed segmented stack at %p", stack);
+}
+
+template <typename T, typename Policy, size_t C>
+unsigned int StackPush(SegmentedStack<T, Policy, C>* stack, std::type_identity_t<T> value)
+{
+    unsigned int err = StackAssert(stack);
+    if (err) return err;
+
+    if (ElementTraits<T>::IsPoison(value))
+    {
+        log_message(MSG_WARNING, "Attempt to push poison value to stack %p spotted.", stack);
+        return STK_POISON_VALUE;
+    }
+
+    if (stack->size == stack->chunk_count*C && SegmentedAddChunk_(stack) != 0)
+    {
+        log_message(MSG_WARNING, "Failed to push to stack %p. Not enough memory", stack);
+        return STK_NO_MEMORY;
+    }
+
+    T* slot = SegmentedSlot_(stack, stack->size);
+    *slot = value;
+    if constexpr (Policy::has_hash)
+        stack->data_hash_ += GetSlotHash(slot, sizeof(T), stack->size);
+    stack->size++;
+
+    StackUpdateHash_(stack);
+
+    return STK_NO_ERROR;
+}
+
+template <typename T, typename Policy, size_t C>
+unsigned int StackPop(SegmentedStack<T, Policy, C>* stack)
+{
+    unsigned int err = 0;
+    StackPopCopy(stack, &err);
+
+    if (err == STK_EMPTY)
+        log_message(MSG_WARNING, "Attempt to pop empty stack %p spotted.", stack);
+
+    return err;
+}
+
+template <typename T, typename Policy, size_t C>
+T StackPopCopy(SegmentedStack<T, Policy, C>* stack, unsigned int* err)
+{
+    unsigned int err_flags = StackAssert(stack);
+    if (err_flags)
+    {
+        TRY_ASSIGN_PTR(err, err_flags);
+        return ElementTraits<T>::poison;
+    }
+
+    if (stack->size == 0)
+    {
+        TRY_ASSIGN_PTR(err, STK_EMPTY);
+        return ElementTraits<T>::poison;
+    }
+
+    stack->size--;
+    T* slot  = SegmentedSlot_(stack, stack->size);
+    T result = *slot;
+    if constexpr (Policy::has_hash)
+        stack->data_hash_ -= GetSlotHash(slot, sizeof(T), stack->size);
+    *slot = ElementTraits<T>::poison;
+
+    if (stack->chunk_count > 1 && stack->size == (stack->chunk_count - 1)*C)
+        SegmentedRemoveChunk_(stack);
+
+    StackUpdateHash_(stack);
+
+    TRY_ASSIGN_PTR(err, STK_NO_ERROR);
+    return result;
+}
+
+template <typename T, typename Policy, size_t C>
+T* StackPeek(const SegmentedStack<T, Policy, C>* stack, unsigned int* err)
+{
+    unsigned int err_flags = StackAssert(stack);
+    if (err_flags)
+    {
+        TRY_ASSIGN_PTR(err, err_flags);
+        return NULL;
+    }
+
+    if (stack->size == 0)
+    {
+        TRY_ASSIGN_PTR(err, STK_EMPTY);
+        return NULL;
+    }
+
+    TRY_ASSIGN_PTR(err, STK_NO_ERROR);
+    return SegmentedSlot_(stack, stack->size - 1);
+}
+
+template <typename T, typename Policy, size_t C>
+unsigned int StackCheck(const SegmentedStack<T, Policy, C>* stack)
+{
+    unsigned int flags = StackHeaderCheck_(stack);
+
+    if (flags & (STK_BAD_PTR | STK_CORRUPTED_SIZE | STK_CORRUPTED_CAP | STK_BAD_DATA_PTR))
+        return flags;
+
+    [[maybe_unused]] hash_t data_hash = 0;
+
+    /* Chunks are independent, so every chunk is checked
+       even if errors were found in previous ones */
+    for (size_t i = 0; i < stack->chunk_count; i++)
+    {
+        size_t fill = SegmentedChunkFill_(stack, i);
+        unsigned int chunk_flags = SegmentedChunkCheck_<Policy, T, C>(stack->chunks[i], fill);
+
+        flags |= chunk_flags;
+        if constexpr (Policy::has_hash)
+            if (!(chunk_flags & STK_BAD_DATA_PTR))
+                data_hash += GetSlotsHash(stack->chunks[i], fill, sizeof(T), i*C);
+    }
+
+    if (stack->spare_)
+        flags |= SegmentedChunkCheck_<Policy, T, C>(stack->spare_, 0);
+
+    if constexpr (Policy::has_hash)
+    if (!(flags & STK_BAD_DATA_PTR))
+        flags |= GetErrorFlag(data_hash != stack->data_hash_, STK_WRONG_DATA_HASH);
+
+    return flags;
+}
+
+template <typename T, typename Policy, size_t C>
+unsigned int StackScheduledCheck_(const SegmentedStack<T, Policy, C>* stack)
+{
+    unsigned int flags = StackHeaderCheck_(stack);
+
+    if (flags & (STK_BAD_PTR | STK_CORRUPTED_SIZE | STK_CORRUPTED_CAP | STK_BAD_DATA_PTR))
+        return flags;
+
+    /* Data hash covers all chunks, so it is checked by `StackCheck` only */
+    size_t top = stack->chunk_count - 1;
+    return flags | SegmentedChunkCheck_<Policy, T, C>(stack->chunks[top],
+                                                      SegmentedChunkFill_(stack, top));
+}
+
+template <typename T, typename Policy, size_t C>
+unsigned int StackHeaderCheck_(const SegmentedStack<T, Policy, C>* stack)
+{
+    if (!CanReadRange(stack, sizeof(*stack)))
+        return STK_BAD_PTR;
+
+    unsigned int flags = STK_NO_ERROR;
+
+    if constexpr (Policy::has_hash)
+    flags |= GetErrorFlag(GetStackHash_(stack) != stack->hash_, STK_WRONG_HASH);
+
+    if constexpr (Policy::has_canary)
+    {
+    canary_t canary = CANARY ^ (canary_t)stack;
+    flags |= GetErrorFlag(stack->canary_start_ != canary,       STK_DEAD_CANARY);
+    flags |= GetErrorFlag(stack->canary_end_   != canary,       STK_DEAD_CANARY);
+    }
+
+    flags |= GetErrorFlag(stack->chunk_count == 0,              STK_CORRUPTED_CAP);
+    flags |= GetErrorFlag(stack->chunk_count > stack->directory_size,
+                                                                STK_CORRUPTED_CAP);
+    flags |= GetErrorFlag(stack->directory_size > SIZE_MAX / sizeof(T*),
+                                                                STK_CORRUPTED_CAP);
+    if (flags & STK_CORRUPTED_CAP)
+        return flags;
+
+    /* Only top chunk may be empty, and only if it is the only one */
+    flags |= GetErrorFlag(stack->size > stack->chunk_count*C,   STK_CORRUPTED_SIZE);
+    flags |= GetErrorFlag(stack->chunk_count > 1 &&
+                          stack->size <= (stack->chunk_count - 1)*C,
+                                                                STK_CORRUPTED_SIZE);
+
+    if (!CanReadRange(stack->chunks, stack->directory_size*sizeof(T*)))
+        return flags | STK_BAD_DATA_PTR;
+
+    return flags;
+}
+
+template <typename Policy, typename T, size_t C>
+unsigned int SegmentedChunkCheck_(const T* chunk, size_t fill)
+{
+    const size_t canary_size = Policy::has_canary ? sizeof(canary_t) : 0;
+    if (!CanReadRange((const char*)chunk - canary_size, C*sizeof(T) + 2*canary_size))
+        return STK_BAD_DATA_PTR;
+
+    unsigned int flags = STK_NO_ERROR;
+
+    if constexpr (Policy::has_canary)
+    {
+    const canary_t* start = ((const canary_t*) chunk) - 1;
+    const canary_t* end   =  (const canary_t*)(chunk + C);
+
+    flags |= GetErrorFlag(CANARY != *start || CANARY != *end, STK_CORRUPTED_DATA);
+    }
+
+    if constexpr (ElementTraits<T>::is_bitwise_poison)
+    {
+        if (FindPattern(chunk, fill, &ElementTraits<T>::poison, sizeof(T)) != fill ||
+            FindNotPattern(chunk + fill, C - fill,
+                           &ElementTraits<T>::poison, sizeof(T)) != C - fill)
+            flags |= STK_CORRUPTED_DATA;
+    }
+    else
+    {
+        for (size_t i = 0; i < C; i++)
+            if (ElementTraits<T>::IsPoison(chunk[i]) != (i >= fill))
+            {
+                flags |= STK_CORRUPTED_DATA;
+                break;
+            }
+    }
+
+    return flags;
+}
+
+template <typename T, typename Policy, size_t C>
+unsigned int StackAssert_(const SegmentedStack<T, Policy, C>* stack,
+                            const char*  func,
+                            const char*  file,
+                            size_t       line,
+                            int force)
+{
+    unsigned int errs = force ? StackCheck(stack) : StackScheduledCheck_(stack);
+
+    if (!errs && !force)
+        return STK_NO_ERROR;
+
+    if (errs & STK_BAD_PTR)
+    {
+        log_message(MSG_ERROR, "Stack[%p] is NOT READABLE\n"
+            "\tin %s:%zu in file \'%s\'\n",
+                stack, func, line, file);
+        return errs;
+    }
+
+    message_level level = errs ? MSG_ERROR : MSG_INFO;
+
+    log_message(level, "Dumping segmented stack[%p] (status: %s)\n"
+        "\tin %s:%zu in file \'%s\'\n",
+            stack,
+            errs ? "CORRUPTED" : "ok",
+            func, line, file);
+
+    if constexpr (Policy::has_debug_info)
+    log_message(level, "Stack \'%s\' declared in %s on line %zu, file \'%s\'\n",
+            stack->debug_.name,
+            stack->debug_.func_name,
+            stack->debug_.line_num,
+            stack->debug_.file_name);
+
+    if (errs)
+        log_message(level, "Error flags: %o\n", errs);
+
+    if constexpr (Policy::has_hash)
+    log_message(level, "Hash:"
+            "\tstored: %#llx\n"
+            "\tactual: %#llx\n"
+            "Data hash: %#llx\n",
+            stack->hash_, GetStackHash_(stack), stack->data_hash_);
+
+    if constexpr (Policy::has_canary)
+    log_message(level, "Canary state:\n"
+        "\tstart: %#016llx ^ %#016llx\n"
+        "\tend  : %#016llx ^ %#016llx\n",
+        CANARY, stack->canary_start_ ^ CANARY,
+        CANARY, stack->canary_end_   ^ CANARY);
+
+    log_message(level, "Elements stored: %zu\n"
+        "Chunks in use  : %zu of %zu elements\n"
+        "Directory size : %zu\n",
+        stack->size,
+        stack->chunk_count, C,
+        stack->directory_size);
+
+    log_message(level, "Chunks[%p]:\n", stack->chunks);
+    if (errs & (STK_CORRUPTED_CAP | STK_CORRUPTED_SIZE) ||
+        !CanReadRange(stack->chunks, stack->directory_size*sizeof(T*)))
+    {
+        log_message(level, "\tNOT READABLE\n");
+        return errs;
+    }
+
+    for (size_t i = 0; i < stack->chunk_count; i++)
+    {
+        size_t fill = SegmentedChunkFill_(stack, i);
+        unsigned int chunk_errs =
+                    SegmentedChunkCheck_<Policy, T, C>(stack->chunks[i], fill);
+
+        log_message(level, "\t[%zu] %p: %zu elements, %s",
+            i, stack->chunks[i], fill,
+            chunk_errs ? "CORRUPTED" : "ok");
+    }
+
+    if (stack->spare_)
+        log_message(level, "\tspare %p: %s", stack->spare_,
+            SegmentedChunkCheck_<Policy, T, C>(stack->spare_, 0) ? "CORRUPTED" : "ok");
+
+    return errs;
+}
+
+template <typename T, typename Policy, size_t C>
+size_t SegmentedChunkFill_(const SegmentedStack<T, Policy, C>* stack, size_t chunk)
+{
+    return chunk + 1 < stack->chunk_count ? C : stack->size - chunk*C;
+}
+
+template <typename T, typename Policy, size_t C>
+int SegmentedAddChunk_(SegmentedStack<T, Policy, C>* stack)
+{
+    /* Chunk is obtained first, so that failure leaves stack unchanged */
+    T* chunk = stack->spare_;
+    if (!chunk)
+        chunk = ReallocWithCanary_<Policy>((T*)NULL, 0, C);
+
+    if (!chunk)
+        return -1;
+
+    if (stack->chunk_count == stack->directory_size)
+    {
+        size_t new_size = 2*stack->directory_size;
+        T** chunks = (T**)BufferRealloc(stack->chunks,
+                                        stack->directory_size*sizeof(T*),
+                                        new_size*sizeof(T*));
+        if (!chunks)
+        {
+            if (chunk != stack->spare_)
+                FreeWithCanary_<Policy>(chunk, C);
+            return -1;
+        }
+
+        stack->chunks         = chunks;
+        stack->directory_size = new_size;
+    }
+
+    stack->spare_ = NULL;
+    stack->chunks[stack->chunk_count++] = chunk;
+    return 0;
+}
+
+template <typename T, typename Policy, size_t C>
+void SegmentedRemoveChunk_(SegmentedStack<T, Policy, C>* stack)
+{
+    T* chunk = stack->chunks[--stack->chunk_count];
+    stack->chunks[stack->chunk_count] = NULL;
+
+    if (stack->spare_)
+        FreeWithCanary_<Policy>(chunk, C);
+    else
+        stack->spare_ = chunk;
+}
+
+template <typename T, typename Policy, size_t C>
+T* SegmentedSlot_(const SegmentedStack<T, Policy, C>* stack, size_t index)
+{
+    return stack->chunks[index / C] + index % C;
+}
+
+template <typename T, typename Policy, size_t C>
+hash_t GetStackHash_(const SegmentedStack<T, Policy, C>* stack)
+{
+    if constexpr (Policy::has_hash)
+    {
+        /* Copy bytewise, so that padding is hashed as well */
+        SegmentedStack<T, Policy, C> copy;
+        memcpy(&copy, stack, sizeof(copy));
+        copy.hash_ = 0;
+        return GetHash(&copy, sizeof(copy));
+    }
+    return 0;
+}
+
+template <typename T, typename Policy, size_t C>
+void StackUpdateHash_(SegmentedStack<T, Policy, C>* stack)
+{
+    if constexpr (Policy::has_hash)
+        stack->hash_ = GetStackHash_(stack);
+}
+
+#endif
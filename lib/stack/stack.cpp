@@ -0,0 +1,14 @@
+/**
+ * @file stack.cpp
+ * @author MeerkatBoss
+ * @brief Out-of-line stack functions of library stacks
+ * @version 0.1
+ * @date 2022-10-12
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#include "stack.h"
+
+STK_FOR_LIBRARY_STACKS_(STK_INSTANTIATE_STACK)
@@ -11,50 +11,141 @@
  * @copyright Copyright (c) 2022
  * TODO:                   ^ usually here goes name :)
  * 
- * @note For usage with any desired type define
- * `element_t` type, `element_poison` constant,
- * `int IsPoison(element_t element)` and 
+ * @note `TypedStack<T, Policy>` can be used with any type `T`
+ * for which `ElementTraits<T>` is specialized. Protection checks
+ * disabled by `Policy` are not compiled at all.
+ * 
+ * @note For usage of `Stack` with any desired type define
+ * `USE_CUSTOM_ELEMENT`, `element_t` type, `element_poison` constant,
+ * `int IsPoison(element_t element)` and
  * `void PrintElement(element_t element)`
  * functions
  * 
- * @warning This header DOES NOT support separate compilation
+ * @note Operations used on every push and pop are defined inline.
+ * Construction, checks, dumps and reallocation of stacks of `void*`,
+ * fixed-width integers, `float` and `double` with every combination
+ * of `STK_CANARY_PROT`, `STK_HASH_PROT` and `STK_DEBUG_INFO` are
+ * compiled into `libstack` and are not
+ * instantiated in including translation units. Other stacks are
+ * instantiated where they are used, unless library user declares
+ * them with `STK_EXTERN_STACK` and instantiates them in one
+ * translation unit with `STK_INSTANTIATE_STACK`. Define
+ * `STK_HEADER_ONLY` to use header without `libstack`
  */
 
 #include <stdio.h>
 #include <stdlib.h>
-#include <math.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include <new>
 
 #include "_stack_interface.h"
+#include "_stack_dump_format.h"
 #include "logger.h"
+#include "allocator.h"
+
+/**
+ * @brief 
+ * Recalculate hash values in stack from scratch.
+ * Takes time proportional to stack size
+ * @param[inout] stack `Stack` instance
+ */
+template <typename T, typename Policy>
+void        StackRecalculateHash_   (TypedStack<T, Policy>* stack);
 
 /**
  * @brief 
- * Recalculate hash values in stack
+ * Update stack header hash after `data_hash_` was
+ * adjusted incrementally
  * @param[inout] stack `Stack` instance
  */
-void        StackRecalculateHash_   (Stack* stack);
+template <typename T, typename Policy>
+void        StackUpdateHash_        (TypedStack<T, Policy>* stack);
+
+/**
+ * @brief 
+ * Calculate hash of a single stack slot. Data hash
+ * is the sum of hashes of all stored elements
+ * @param[in] stack `Stack` instance
+ * @param[in] index slot index
+ * @return Hash value
+ */
+template <typename T, typename Policy>
+hash_t      GetSlotHash_            (const TypedStack<T, Policy>* stack, size_t index);
+
+/**
+ * @brief 
+ * Calculate stack data hash from scratch
+ * 
+ * @param[in] stack `Stack` instance
+ * @return Hash value
+ */
+template <typename T, typename Policy>
+hash_t      GetDataHash_            (const TypedStack<T, Policy>* stack);
 
 /**
- * @brief
+ * @brief 
  * Calculate stack hash value
  * 
  * @param[in] stack `Stack` instance
  * @return Hash value
  */
-hash_t      GetStackHash_           (const Stack* stack);
+template <typename T, typename Policy>
+hash_t      GetStackHash_           (const TypedStack<T, Policy>* stack);
 
 /**
  * @brief 
- * Check stack integrity
+ * Check stack integrity, including all stored data
+ * 
+ * @param[in] stack `Stack` instance
+ * @return zero upon success, some combination of
+ * `ErrorFlags` otherwise
+ */
+template <typename T, typename Policy>
+unsigned int    StackCheck      (const TypedStack<T, Policy>* stack);
+
+/**
+ * @brief 
+ * Check stack integrity before operation. Takes constant time:
+ * only header, buffer canaries and slots around top are checked.
+ * Whole data is checked only if it is due according to stack
+ * check schedule, or by explicit `StackCheck` and `StackDump`
  * 
  * @param[in] stack `Stack` instance
- * @param[in] func  calling fuction name
- * @param[in] file  calling file name
- * @param[in] line  calling line number
  * @return zero upon success, some combination of
  * `ErrorFlags` otherwise
  */
-unsigned int    StackCheck      (const Stack* stack);
+template <typename T, typename Policy>
+unsigned int    StackScheduledCheck_(const TypedStack<T, Policy>* stack);
+
+/**
+ * @brief 
+ * Check stack header integrity, i.e. canaries, hash,
+ * size and capacity. Takes constant time
+ * 
+ * @param[in] stack `Stack` instance
+ * @return zero upon success, some combination of
+ * `ErrorFlags` otherwise
+ */
+template <typename T, typename Policy>
+unsigned int    StackHeaderCheck_(const TypedStack<T, Policy>* stack);
+
+/**
+ * @brief 
+ * Check buffer canaries and slots around top of stack,
+ * i.e. the ones changed by push and pop. Takes constant time
+ * 
+ * @param[in] stack `Stack` instance
+ * @return zero upon success, some combination of
+ * `ErrorFlags` otherwise
+ */
+template <typename T, typename Policy>
+unsigned int    StackTopCheck_  (const TypedStack<T, Policy>* stack);
 
 /**
  * @brief 
@@ -64,7 +155,57 @@ unsigned int    StackCheck      (const Stack* stack);
  * @return zero upon success, some combination of
  * `ErrorFlags` otherwise
  */
-unsigned int    StackDataCheck_ (const Stack* stack);
+template <typename T, typename Policy>
+unsigned int    StackDataCheck_ (const TypedStack<T, Policy>* stack);
+
+/**
+ * @brief 
+ * Check if whole stack buffer, including canaries,
+ * is readable
+ * 
+ * @param[in] stack `Stack` instance
+ * @return 1 if buffer is readable, 0 otherwise
+ */
+template <typename T, typename Policy>
+int             StackCanReadData_(const TypedStack<T, Policy>* stack);
+
+/**
+ * @brief 
+ * Find first poison value in array. Used to reject
+ * values, which cannot be stored in stack
+ * 
+ * @param[in] values checked values
+ * @param[in] count  number of values
+ * @return Index of found value, `count` if there is none
+ */
+template <typename T>
+size_t          FindPoison_        (const T* values, size_t count);
+
+/**
+ * @brief 
+ * Find first poisoned slot in range [from, to)
+ * 
+ * @param[in] stack `Stack` instance
+ * @param[in] from  range start
+ * @param[in] to    range end
+ * @return Index of found slot, `to` if there is none
+ */
+template <typename T, typename Policy>
+size_t          StackFindPoison_   (const TypedStack<T, Policy>* stack,
+                                    size_t from, size_t to);
+
+/**
+ * @brief 
+ * Find first non-poisoned slot in range [from, to)
+ * 
+ * @param[in] stack `Stack` instance
+ * @param[in] from  range start
+ * @param[in] to    range end
+ * @return Index of found slot, `to` if there is none
+ */
+template <typename T, typename Policy>
+size_t          StackFindNotPoison_(const TypedStack<T, Policy>* stack,
+                                    size_t from, size_t to);
 
 /**
  * @brief 
@@ -75,11 +216,32 @@ unsigned int    StackDataCheck_ (const Stack* stack);
  * @param[in] file  calling file name
  * @param[in] line  calling line number
  */
-unsigned int    StackAssert_       (const Stack*  stack,
+template <typename T, typename Policy>
+unsigned int    StackAssert_       (const TypedStack<T, Policy>*  stack,
                               const char*   func,
                               const char*   file,
                               size_t        line,
-                              int force_dump);
+                              int force_dump = 0);
+
+/**
+ * @brief 
+ * Print `Stack` contents and write binary dump if dump
+ * directory is set. Called by `StackAssert_` upon failure
+ * 
+ * @param[in] stack `Stack` instance
+ * @param[in] errs  errors found by check
+ * @param[in] func  calling fuction name
+ * @param[in] file  calling file name
+ * @param[in] line  calling line number
+ * @return `errs`
+ */
+template <typename T, typename Policy>
+[[gnu::cold, gnu::noinline]]
+unsigned int    StackReport_       (const TypedStack<T, Policy>*  stack,
+                              unsigned int  errs,
+                              const char*   func,
+                              const char*   file,
+                              size_t        line);
 
 /**
  * @brief 
@@ -95,6 +257,77 @@ unsigned int    StackAssert_       (const Stack*  stack,
                                     __PRETTY_FUNCTION__,\
                                     __FILE__, __LINE__, 1)
 
+/**
+ * @brief 
+ * Check stack header and print `Stack` contents upon failure.
+ * Takes constant time, as stored data is not checked
+ * 
+ * @param[in] stack `Stack` instance
+ * @param[in] func  calling fuction name
+ * @param[in] file  calling file name
+ * @param[in] line  calling line number
+ */
+template <typename T, typename Policy>
+unsigned int    StackHeaderAssert_ (const TypedStack<T, Policy>*  stack,
+                              const char*   func,
+                              const char*   file,
+                              size_t        line);
+
+#define StackHeaderAssert(stack) StackHeaderAssert_(stack,  \
+                                    __PRETTY_FUNCTION__,    \
+                                    __FILE__, __LINE__)
+
+/**
+ * @brief 
+ * Check stack and write its binary dump to file.
+ * Called by `StackDumpBinary`
+ * @param[in] stack `Stack` instance
+ * @param[in] path  dump file, overwritten if exists
+ * @param[in] func  calling function name
+ * @param[in] file  calling file name
+ * @param[in] line  calling line
+ * @return Error flags found by check, `STK_BAD_FILE` if
+ * dump could not be written
+ */
+template <typename T, typename Policy>
+unsigned int    StackDumpBinary_   (const TypedStack<T, Policy>*  stack,
+                                    const char*   path,
+                                    const char*   func,
+                                    const char*   file,
+                                    size_t        line);
+
+/**
+ * @brief 
+ * Write binary dump of `Stack` to file. Dump
+ * is decoded by `stkview` tool
+ * 
+ * @param[in] stack `Stack` instance
+ * @param[in] path  dump file
+ */
+#define StackDumpBinary(stack, path) StackDumpBinary_(stack, path,   \
+                                    __PRETTY_FUNCTION__,            \
+                                    __FILE__, __LINE__)
+
+/**
+ * @brief 
+ * Directory, where `StackAssert` and `StackDump` write binary
+ * dumps, `NULL` if binary dumps are disabled
+ */
+inline const char* stack_dump_dir_ = NULL;
+
+/**
+ * @brief 
+ * Set directory for binary dumps written by `StackAssert` and
+ * `StackDump`. Dumps are named `stack-<address>-<number>.stkdump`
+ * 
+ * @param[in] dir existing directory, `NULL` to disable binary dumps.
+ * Must stay valid while dumps are enabled
+ */
+inline void SetStackDumpDir(const char* dir)
+{
+    stack_dump_dir_ = dir;
+}
+
 #define TRY_ASSIGN_PTR(ptr, value) if (ptr) {*(ptr) = value;}
 
 inline enum ErrorFlags GetErrorFlag(int condition, enum ErrorFlags flag)
@@ -105,24 +338,64 @@ inline enum ErrorFlags GetErrorFlag(int condition, enum ErrorFlags flag)
 
 /**
  * @brief 
- * Stack capacity growth coefficient
+ * Granularity of page-rounded buffers
+ */
+const size_t page_size_ = 4096;
+
+/**
+ * @brief 
+ * Buffers of at least this size (in bytes) may be returned
+ * to system upon `realloc`/`free`, so cached readable
+ * ranges must be invalidated after releasing them
+ */
+const size_t unmap_threshold_ = 128 * 1024;
+
+/**
+ * @brief 
+ * Maximum number of slot ranges printed by `StackAssert_`.
+ * Remaining slots are described by binary dump only
+ */
+const size_t dump_max_ranges_ = 32;
+
+/**
+ * @brief 
+ * Write binary dump of stack to file in one write
+ * @param[in] stack `Stack` instance
+ * @param[in] errs  error flags found by check
+ * @param[in] path  dump file
+ * @param[in] func  calling function name
+ * @param[in] file  calling file name
+ * @param[in] line  calling line
+ * @return zero upon success, `STK_BAD_FILE` or
+ * `STK_NO_MEMORY` otherwise
  */
-const double stack_growth_ = 2;
+template <typename T, typename Policy>
+unsigned int StackWriteDump_    (const TypedStack<T, Policy>* stack,
+                                unsigned int errs,
+                                const char* path,
+                                const char* func,
+                                const char* file,
+                                size_t line);
 
 /**
  * @brief 
- * Stack default capacity
+ * Log stack slots as ranges of slots with the same status
+ * @param[in] stack `Stack` instance with readable data
+ * @param[in] level message level
  */
-const size_t default_cap_ = 16;
+template <typename T, typename Policy>
+void        StackLogSlots_      (const TypedStack<T, Policy>* stack, message_level level);
 
 /**
  * @brief 
  * Grow stack if needed so that it will be ready
- * to accept new element
+ * to accept `count` new elements
  * @param[inout] stack `Stack` instance
+ * @param[in] count number of elements to be added
  * @return zero upon success, non-zero otherwise
  */
-int         StackTryGrow_       (Stack* stack);
+template <typename T, typename Policy>
+int         StackTryGrow_       (TypedStack<T, Policy>* stack, size_t count = 1);
 
 /**
  * @brief 
@@ -130,13 +403,38 @@ int         StackTryGrow_       (Stack* stack);
  * @param[inout] stack `Stack` instance
  * @return zero upon success, non-zero otherwise
  */
-int         StackTryShrink_     (Stack* stack);
+template <typename T, typename Policy>
+int         StackTryShrink_     (TypedStack<T, Policy>* stack);
+
+/**
+ * @brief 
+ * Move stack elements to buffer with given capacity. Buffer
+ * is inline if `new_capacity` does not exceed inline capacity
+ * @param[inout] stack `Stack` instance
+ * @param[in] new_capacity required capacity, at least `stack->size`
+ * @return zero upon success, non-zero otherwise
+ */
+template <typename T, typename Policy>
+int         StackResize_        (TypedStack<T, Policy>* stack, size_t new_capacity);
+
+/**
+ * @brief 
+ * Get capacity following `capacity` according
+ * to stack growth policy
+ * @param[in] stack `Stack` instance
+ * @param[in] capacity current capacity
+ * @return Next capacity, greater than `capacity` unless
+ * maximum capacity is reached
+ */
+template <typename T, typename Policy>
+size_t      GetNewCapacity_     (const TypedStack<T, Policy>* stack, size_t capacity);
 
 /**
  * @brief 
  * (Re)allocate array with size `new_size`,
  * add canaries before array start and after
- * its end.
+ * its end if `Policy` requires so. Memory is
+ * obtained from current buffer allocator.
  * @param[inout] old_array pointer to beginning of an
  * array, returned by call to `ReallocWithCanary_` or
  * `NULL`
@@ -152,132 +450,422 @@ int         StackTryShrink_     (Stack* stack);
  * 
  * @warning If new_size is 0 the result is undefined
  */
-element_t*    ReallocWithCanary_  (element_t* old_array,
+template <typename Policy, typename T>
+T*          ReallocWithCanary_  (T* old_array,
                                 size_t old_size,
                                 size_t new_size);
 
+/**
+ * @brief 
+ * Poison elements [old_size, new_size) of array and
+ * put canaries before array start and after its end
+ * if `Policy` requires so
+ * @param[inout] array    array start
+ * @param[in]    old_size number of initialized elements
+ * @param[in]    new_size array length
+ */
+template <typename Policy, typename T>
+void        InitWithCanary_     (T* array, size_t old_size, size_t new_size);
+
+/**
+ * @brief 
+ * Get inline buffer of stack with inline storage
+ * @param[in] stack `Stack` instance
+ * @return Pointer to first element of inline buffer
+ */
+template <typename T, typename Policy>
+T*          StackInlineData_    (const TypedStack<T, Policy>* stack);
+
+/**
+ * @brief 
+ * Check if stack elements are currently stored inline
+ * @param[in] stack `Stack` instance
+ * @return 1 if elements are stored inline, 0 otherwise
+ */
+template <typename T, typename Policy>
+int         StackIsInline_      (const TypedStack<T, Policy>* stack);
+
 /**
  * @brief 
  * Free memory allocated by `ReallocWithCanary_`
  * @param[inout] ptr Memory to be freed
+ * @param[in] size length of freed array
  */
-void        FreeWithCanary_     (element_t* ptr);
+template <typename Policy, typename T>
+void        FreeWithCanary_     (T* ptr, size_t size);
 
-int StackCtor_(Stack* stack,
-                const char* name,
-                const char* func_name,
-                const char* file_name,
-                size_t line_num)
-{
-    element_t* data = ReallocWithCanary_(NULL, 0, default_cap_);
+/**
+ * @brief 
+ * Reserve mapped range for stack elements and
+ * commit pages for initial capacity
+ * @param[inout] stack `Stack` instance
+ * @param[in] max_capacity maximum number of elements
+ * @return zero upon success, non-zero otherwise
+ */
+template <typename T, typename Policy>
+int         StackMapReserve_    (TypedStack<T, Policy>* stack, size_t max_capacity);
 
-    if (!data)
-        return -1; // TODO: What about an enum for errors?)
-    
-    _ON_CANARY(
-        canary_t canary = CANARY ^ (canary_t)stack;
-    )
-    *stack = {
-        _ON_CANARY(     .canary_start_  = canary,)
-                        .data           = data,
-                        .size           = 0,
-                        .capacity       = default_cap_,
-        _ON_HASH(       .hash_          = 0,)
-        _ON_HASH(       .data_hash_     = 0,)
-        _ON_DEBUG_INFO(
-                        .debug_         = {
-                            .name       = name,
-                            .func_name  = func_name,
-                            .file_name  = file_name,
-                            .line_num   = line_num
-                        },
-        )
-        _ON_CANARY(     .canary_end_    = canary,)
-    };
+/**
+ * @brief 
+ * Commit or decommit pages of mapped stack, so that
+ * it holds exactly `new_capacity` elements. Elements
+ * stay in place
+ * @param[inout] stack `Stack` instance
+ * @param[in] new_capacity required capacity, at least `stack->size`
+ * @return zero upon success, non-zero otherwise
+ */
+template <typename T, typename Policy>
+int         StackMapResize_     (TypedStack<T, Policy>* stack, size_t new_capacity);
 
-    StackRecalculateHash_(stack);
-    
-    log_message(MSG_TRACE, "Constructed stack at %p", stack);
-    return 0;
-}
+/**
+ * @brief 
+ * Get maximum capacity of mapped stack
+ * @param[in] stack `Stack` instance
+ * @return Number of elements fitting reserved range
+ */
+template <typename T, typename Policy>
+size_t      StackMappedCapacity_(const TypedStack<T, Policy>* stack);
+
+/**
+ * @brief 
+ * Validate growth policy and assign it to stack
+ * @param[inout] stack `Stack` instance
+ * @param[in] growth   growth policy or `NULL` for default one
+ * @return zero upon success, non-zero if policy is invalid
+ */
+template <typename T, typename Policy>
+int         StackSetGrowth_     (TypedStack<T, Policy>* stack, const growth_policy* growth);
+
+/**
+ * @brief 
+ * Initialize canaries, debug info and check schedule
+ * of constructed stack
+ */
+template <typename T, typename Policy>
+void        StackInitInfo_      (TypedStack<T, Policy>* stack,
+                                const char* name,
+                                const char* func_name,
+                                const char* file_name,
+                                size_t line_num);
+
+/**
+ * @brief 
+ * Get stack debug info
+ * @param[in] stack `Stack` instance
+ * @return Debug info or `NULL` if it is not readable
+ */
+template <typename T, typename Policy>
+const debug_info_* StackDebugInfo_(const TypedStack<T, Policy>* stack);
+
+/**
+ * @brief 
+ * Release stack buffer. Persistent stack is synced first
+ * @param[inout] stack `Stack` instance
+ */
+template <typename T, typename Policy>
+void        StackFreeBuffer_    (TypedStack<T, Policy>* stack);
+
+/**
+ * @brief 
+ * Make `dest` own buffer of `source`. Inline elements are copied
+ * to inline storage of `dest`. Header of `dest` is not rehashed
+ * @param[inout] dest   receiving instance
+ * @param[in]    source instance, whose buffer is taken
+ */
+template <typename T, typename Policy>
+void        StackTakeBuffer_    (TypedStack<T, Policy>* dest,
+                                const TypedStack<T, Policy>* source);
+
+/**
+ * @brief 
+ * Update canaries and hash of stack after it was moved
+ * to its current address
+ * @param[inout] stack `Stack` instance
+ */
+template <typename T, typename Policy>
+void        StackRekey_         (TypedStack<T, Policy>* stack);
+
+/**
+ * @brief 
+ * Fill persistent file header describing current stack state
+ * @param[in]  stack    `Stack` instance
+ * @param[in]  reserved bytes reserved for buffer in file
+ * @param[out] header   filled header
+ */
+template <typename T, typename Policy>
+void        StackFillFileHeader_(const TypedStack<T, Policy>* stack,
+                                size_t reserved,
+                                stack_file_header* header);
+
+/**
+ * @brief 
+ * Read and verify header of persistent stack file. Header
+ * for new stack is created if file is empty
+ * @param[in]  fd           stack file descriptor
+ * @param[in]  max_capacity requested maximum capacity
+ * @param[out] header       read header
+ * @param[out] is_new       set to 1 if file was empty, 0 otherwise
+ * @return zero upon success, some combination of `ErrorFlags` otherwise
+ */
+template <typename T, typename Policy>
+unsigned int StackReadFileHeader_(int fd, size_t max_capacity,
+                                  stack_file_header* header, int* is_new);
 
-void StackDtor(Stack* stack)
+/**
+ * @brief 
+ * Calculate persistent file header hash
+ * @param[in] header file header
+ * @return Hash value
+ */
+inline hash_t GetFileHeaderHash_(const stack_file_header* header)
 {
-    if (StackAssert(stack) != STK_NO_ERROR)
-        return;
-    FreeWithCanary_(stack->data);
-    *stack = {};
-    log_message(MSG_TRACE, "Destroyed stack at %p", stack);
+    stack_file_header copy = *header;
+    copy.hash = 0;
+    return GetHash(&copy, sizeof(copy));
 }
 
-unsigned int StackPush(Stack* stack, element_t value)
+template <typename T, typename Policy>
+int StackCtor_(TypedStack<T, Policy>* stack,
+                [[maybe_unused]] const char* name,
+                [[maybe_unused]] const char* func_name,
+                [[maybe_unused]] const char* file_name,
+                [[maybe_unused]] size_t line_num,
+                const growth_policy* growth,
+                size_t max_capacity)
 {
-    unsigned int err = StackAssert(stack);
-    if (err) return err;
+    *stack = {};
 
-    int push_status = StackTryGrow_(stack);
-    if (push_status < 0)
+    if (StackSetGrowth_(stack, growth) != 0)
+        return -1;
+
+    if (max_capacity > 0)
     {
-        log_message(MSG_WARNING, "Failed to push to stack %p. Not enough memory", stack);
-        return STK_NO_MEMORY;
+        if (StackMapReserve_(stack, max_capacity) != 0)
+        {
+            log_message(MSG_WARNING, "Failed to reserve %zu elements for stack %p",
+                                     max_capacity, stack);
+            return -1;
+        }
+    }
+    else if constexpr (Policy::inline_capacity > 0)
+    {
+        stack->data     = StackInlineData_(stack);
+        stack->capacity = Policy::inline_capacity;
+        InitWithCanary_<Policy>(stack->data, 0, stack->capacity);
+    }
+    else
+    {
+        T* data = ReallocWithCanary_<Policy>((T*)NULL, 0, stack->growth_->min_capacity);
+
+        if (!data)
+            return -1; // TODO: What about an enum for errors?)
+
+        stack->data     = data;
+        stack->capacity = stack->growth_->min_capacity;
     }
-    
-    stack->data[stack->size++] = value;
+
+    StackInitInfo_(stack, name, func_name, file_name, line_num);
 
     StackRecalculateHash_(stack);
 
-    return STK_NO_ERROR;
+    log_message(MSG_TRACE, "Constructed stack at %p", stack);
+    return 0;
 }
 
-unsigned int StackPop (Stack* stack)
+template <typename T, typename Policy>
+int StackSetGrowth_(TypedStack<T, Policy>* stack, const growth_policy* growth)
 {
-    unsigned int err = StackAssert(stack);
-    if (err) return err;
+    if (!growth)
+        growth = &STK_GROWTH_DEFAULT;
 
-    if (stack->size == 0)
+    if (growth->factor_den == 0 || growth->factor_num <= growth->factor_den ||
+        growth->min_capacity == 0)
     {
-        log_message(MSG_WARNING, "Attempt to pop empty stack %p spotted.", stack);
-        return STK_EMPTY;
+        log_message(MSG_WARNING, "Invalid growth policy for stack %p", stack);
+        return -1;
     }
 
-    stack->data[--stack->size] = element_poison;
-    StackTryShrink_(stack);
-
-    StackRecalculateHash_(stack);
-
-    return STK_NO_ERROR;
+    stack->growth_ = growth;
+    return 0;
 }
 
-element_t StackPopCopy    (Stack* stack, unsigned int* err = NULL)
+template <typename T, typename Policy>
+void StackInitInfo_(TypedStack<T, Policy>* stack,
+                    [[maybe_unused]] const char* name,
+                    [[maybe_unused]] const char* func_name,
+                    [[maybe_unused]] const char* file_name,
+                    [[maybe_unused]] size_t line_num)
 {
-    unsigned int err_flags = StackAssert(stack);
-    if (err_flags)
+    if constexpr (Policy::has_canary)
     {
-        TRY_ASSIGN_PTR(err, err_flags);
-        return element_poison;
+        canary_t canary = CANARY ^ (canary_t)stack;
+        stack->canary_start_ = canary;
+        stack->canary_end_   = canary;
     }
 
-    if (stack->size == 0)
+    if constexpr (Policy::has_debug_info)
+    {
+        debug_info_ debug = {
+            .name       = name,
+            .func_name  = func_name,
+            .file_name  = file_name,
+            .line_num   = line_num
+        };
+
+        if constexpr (Policy::split_layout)
+        {
+            /* Stack stays usable without debug info */
+            stack->debug_ = (debug_info_*)calloc(1, sizeof(debug_info_));
+            if (stack->debug_)
+                *stack->debug_ = debug;
+        }
+        else
+            stack->debug_ = debug;
+    }
+
+    if constexpr (Policy::has_sampled_check)
+        stack->check_ = {
+            .period       = 1,
+            .budget_ns    = 0,
+            .ops_left     = 1,
+            .credit_ns    = 0,
+            .last_cost_ns = 0
+        };
+}
+
+template <typename T, typename Policy>
+const debug_info_* StackDebugInfo_(const TypedStack<T, Policy>* stack)
+{
+    static_assert(Policy::has_debug_info, "Policy has no debug info");
+
+    if constexpr (Policy::split_layout)
+    {
+        /* Cold pointer is not hashed */
+        if (!stack->debug_ || !CanReadRange(stack->debug_, sizeof(debug_info_)))
+            return NULL;
+        return stack->debug_;
+    }
+    else
+        return &stack->debug_;
+}
+
+template <typename T, typename Policy>
+void StackDtor(TypedStack<T, Policy>* stack)
+{
+    if (StackAssert(stack) != STK_NO_ERROR)
+        return;
+    StackFreeBuffer_(stack);
+    if constexpr (Policy::has_debug_info && Policy::split_layout)
+        free(stack->debug_);
+    *stack = {};
+    log_message(MSG_TRACE, "Destroyed stack at %p", stack);
+}
+
+template <typename T, typename Policy>
+void StackFreeBuffer_(TypedStack<T, Policy>* stack)
+{
+    if (stack->file_)
+    {
+        if (StackSync(stack) != STK_NO_ERROR)
+            log_message(MSG_ERROR, "Failed to sync persistent stack %p\n", stack);
+
+        MapRelease(stack->file_, GetPageSize() + stack->reserved_);
+        InvalidateReadableRanges();
+    }
+    else if (stack->reserved_)
+    {
+        const size_t canary_size = Policy::has_canary ? sizeof(canary_t) : 0;
+        MapRelease((char*)stack->data - canary_size, stack->reserved_);
+        InvalidateReadableRanges();
+    }
+    else if (!StackIsInline_(stack))
+        FreeWithCanary_<Policy>(stack->data, stack->capacity);
+}
+
+template <typename T, typename Policy>
+unsigned int StackPush(TypedStack<T, Policy>* stack, std::type_identity_t<T> value)
+{
+    unsigned int err = StackAssert(stack);
+    if (err) return err;
+
+    /* Poison would be indistinguishable from free slot */
+    if (ElementTraits<T>::IsPoison(value))
+    {
+        log_message(MSG_WARNING, "Attempt to push poison value to stack %p spotted.", stack);
+        return STK_POISON_VALUE;
+    }
+
+    int push_status = StackTryGrow_(stack);
+    if (push_status < 0)
+    {
+        log_message(MSG_WARNING, "Failed to push to stack %p. Not enough memory", stack);
+        return STK_NO_MEMORY;
+    }
+
+    stack->data[stack->size] = value;
+    if constexpr (Policy::has_hash)
+        stack->data_hash_ += GetSlotHash_(stack, stack->size);
+    stack->size++;
+
+    StackUpdateHash_(stack);
+
+    return STK_NO_ERROR;
+}
+
+template <typename T, typename Policy>
+unsigned int StackPop (TypedStack<T, Policy>* stack)
+{
+    unsigned int err = StackAssert(stack);
+    if (err) return err;
+
+    if (stack->size == 0)
+    {
+        log_message(MSG_WARNING, "Attempt to pop empty stack %p spotted.", stack);
+        return STK_EMPTY;
+    }
+
+    stack->size--;
+    if constexpr (Policy::has_hash)
+        stack->data_hash_ -= GetSlotHash_(stack, stack->size);
+    stack->data[stack->size] = ElementTraits<T>::poison;
+    StackTryShrink_(stack);
+
+    StackUpdateHash_(stack);
+
+    return STK_NO_ERROR;
+}
+
+template <typename T, typename Policy>
+T StackPopCopy    (TypedStack<T, Policy>* stack, unsigned int* err)
+{
+    unsigned int err_flags = StackAssert(stack);
+    if (err_flags)
+    {
+        TRY_ASSIGN_PTR(err, err_flags);
+        return ElementTraits<T>::poison;
+    }
+
+    if (stack->size == 0)
     {
         TRY_ASSIGN_PTR(err, STK_EMPTY);
-        return element_poison;
+        return ElementTraits<T>::poison;
     }
-    
-    element_t result = stack->data[stack->size - 1];
-    stack->data[--stack->size] = element_poison;
+
+    stack->size--;
+    T result = stack->data[stack->size];
+    if constexpr (Policy::has_hash)
+        stack->data_hash_ -= GetSlotHash_(stack, stack->size);
+    stack->data[stack->size] = ElementTraits<T>::poison;
     StackTryShrink_(stack);
 
-    _ON_HASH(
-        stack->hash_ = 0;
-        stack->data_hash_ = GetHash(stack->data, stack->capacity);
-        stack->hash_      = GetHash(stack, sizeof(*stack));
-    )
+    StackUpdateHash_(stack);
 
     TRY_ASSIGN_PTR(err, STK_NO_ERROR);
     return result;
 }
 
-element_t* StackPeek      (const Stack* stack, unsigned int* err = NULL)
+template <typename T, typename Policy>
+T* StackPeek      (const TypedStack<T, Policy>* stack, unsigned int* err)
 {
     unsigned int err_flags = StackAssert(stack);
     if (err_flags)
@@ -286,86 +874,396 @@ element_t* StackPeek      (const Stack* stack, unsigned int* err = NULL)
         return NULL;
     }
 
-    TRY_ASSIGN_PTR(err, err_flags);
-    return stack->data + stack->size;
+    if (stack->size == 0)
+    {
+        TRY_ASSIGN_PTR(err, STK_EMPTY);
+        return NULL;
+    }
+
+    TRY_ASSIGN_PTR(err, STK_NO_ERROR);
+    return stack->data + stack->size - 1;
+}
+
+template <typename T, typename Policy>
+unsigned int StackPushN(TypedStack<T, Policy>* stack, const T* values, size_t count)
+{
+    unsigned int err = StackAssert(stack);
+    if (err) return err;
+
+    if (count == 0)
+        return STK_NO_ERROR;
+    if (!values)
+        return STK_BAD_PTR;
+
+    if (FindPoison_(values, count) != count)
+    {
+        log_message(MSG_WARNING, "Attempt to push poison value to stack %p spotted.", stack);
+        return STK_POISON_VALUE;
+    }
+
+    if (count > SIZE_MAX / sizeof(T) - stack->size || StackTryGrow_(stack, count) < 0)
+    {
+        log_message(MSG_WARNING, "Failed to push %zu elements to stack %p. "
+                                 "Not enough memory", count, stack);
+        return STK_NO_MEMORY;
+    }
+
+    memcpy(stack->data + stack->size, values, count*sizeof(T));
+    if constexpr (Policy::has_hash)
+        stack->data_hash_ += GetSlotsHash(stack->data + stack->size, count,
+                                          sizeof(T), stack->size);
+    stack->size += count;
+
+    StackUpdateHash_(stack);
+
+    return STK_NO_ERROR;
+}
+
+template <typename T, typename Policy>
+unsigned int StackPopN(TypedStack<T, Policy>* stack, T* values, size_t count)
+{
+    unsigned int err = StackAssert(stack);
+    if (err) return err;
+
+    if (stack->size < count)
+    {
+        log_message(MSG_WARNING, "Attempt to pop %zu elements from stack %p "
+                                 "of size %zu spotted.", count, stack, stack->size);
+        return STK_EMPTY;
+    }
+
+    stack->size -= count;
+    if (values)
+        memcpy(values, stack->data + stack->size, count*sizeof(T));
+    if constexpr (Policy::has_hash)
+        stack->data_hash_ -= GetSlotsHash(stack->data + stack->size, count,
+                                          sizeof(T), stack->size);
+    FillPattern(stack->data + stack->size, count,
+                &ElementTraits<T>::poison, sizeof(T));
+    StackTryShrink_(stack);
+
+    StackUpdateHash_(stack);
+
+    return STK_NO_ERROR;
+}
+
+template <typename T, typename Policy>
+unsigned int StackReplaceN(TypedStack<T, Policy>* stack, size_t pop_count,
+                           const T* values, size_t push_count)
+{
+    unsigned int err = StackAssert(stack);
+    if (err) return err;
+
+    if (push_count && !values)
+        return STK_BAD_PTR;
+
+    if (stack->size < pop_count)
+    {
+        log_message(MSG_WARNING, "Attempt to pop %zu elements from stack %p "
+                                 "of size %zu spotted.", pop_count, stack, stack->size);
+        return STK_EMPTY;
+    }
+
+    if (FindPoison_(values, push_count) != push_count)
+    {
+        log_message(MSG_WARNING, "Attempt to push poison value to stack %p spotted.", stack);
+        return STK_POISON_VALUE;
+    }
+
+    /* Grow before removing anything, so that failure leaves stack unchanged */
+    size_t base = stack->size - pop_count;
+    if (push_count > pop_count &&
+        (push_count - pop_count > SIZE_MAX / sizeof(T) - stack->size ||
+         StackTryGrow_(stack, push_count - pop_count) < 0))
+    {
+        log_message(MSG_WARNING, "Failed to push %zu elements to stack %p. "
+                                 "Not enough memory", push_count, stack);
+        return STK_NO_MEMORY;
+    }
+
+    size_t old_size = stack->size;
+    if constexpr (Policy::has_hash)
+        stack->data_hash_ -= GetSlotsHash(stack->data + base, pop_count,
+                                          sizeof(T), base);
+
+    if (push_count)
+        memcpy(stack->data + base, values, push_count*sizeof(T));
+    if constexpr (Policy::has_hash)
+        stack->data_hash_ += GetSlotsHash(stack->data + base, push_count,
+                                          sizeof(T), base);
+    stack->size = base + push_count;
+
+    if (stack->size < old_size)
+    {
+        FillPattern(stack->data + stack->size, old_size - stack->size,
+                    &ElementTraits<T>::poison, sizeof(T));
+        StackTryShrink_(stack);
+    }
+
+    StackUpdateHash_(stack);
+
+    return STK_NO_ERROR;
+}
+
+template <typename T, typename Policy>
+unsigned int StackPeekN(const TypedStack<T, Policy>* stack, T* values, size_t count)
+{
+    unsigned int err = StackAssert(stack);
+    if (err) return err;
+
+    if (count == 0)
+        return STK_NO_ERROR;
+    if (!values)
+        return STK_BAD_PTR;
+
+    if (stack->size < count)
+        return STK_EMPTY;
+
+    memcpy(values, stack->data + stack->size - count, count*sizeof(T));
+
+    return STK_NO_ERROR;
+}
+
+template <typename T, typename Policy>
+unsigned int StackCheck(const TypedStack<T, Policy>* stack)
+{
+    unsigned int flags = StackHeaderCheck_(stack);
+
+    if (flags & (STK_BAD_PTR | STK_CORRUPTED_SIZE | STK_CORRUPTED_CAP))
+        return flags;
+
+    return flags | StackDataCheck_(stack);
+}
+
+template <typename T, typename Policy>
+unsigned int StackScheduledCheck_(const TypedStack<T, Policy>* stack)
+{
+    unsigned int flags = StackHeaderCheck_(stack);
+
+    if (flags & (STK_BAD_PTR | STK_CORRUPTED_SIZE | STK_CORRUPTED_CAP))
+        return flags;
+
+    flags |= StackTopCheck_(stack);
+
+    if constexpr (!Policy::has_sampled_check)
+    {
+        return flags;
+    }
+    else
+    {
+        /* Schedule is not hash-protected, so it can be updated here */
+        check_schedule_* schedule = &const_cast<TypedStack<T, Policy>*>(stack)->check_;
+
+        int is_due = 0;
+        if (schedule->period && --schedule->ops_left == 0)
+            is_due = 1;
+
+        if (!schedule->budget_ns)
+            schedule->credit_ns = 0;
+        else if (schedule->credit_ns < schedule->last_cost_ns)
+            schedule->credit_ns += schedule->budget_ns;
+        else
+            is_due = 1;
+
+        if (!is_due)
+            return flags;
+
+        unsigned long long start_ns = schedule->budget_ns ? GetTimeNs() : 0;
+
+        flags |= StackDataCheck_(stack);
+
+        schedule->ops_left = schedule->period;
+        if (schedule->budget_ns)
+        {
+            schedule->last_cost_ns = GetTimeNs() - start_ns;
+            schedule->credit_ns    = schedule->credit_ns > schedule->last_cost_ns
+                                        ? schedule->credit_ns - schedule->last_cost_ns
+                                        : 0;
+        }
+
+        return flags;
+    }
 }
 
-unsigned int StackCheck(const Stack* stack)
+template <typename T, typename Policy>
+unsigned int StackHeaderCheck_(const TypedStack<T, Policy>* stack)
 {
-    if (!CanReadPointer(stack))
+    if (!CanReadRange(stack, sizeof(*stack)))
         return STK_BAD_PTR;
 
     unsigned int flags = STK_NO_ERROR;
 
-    _ON_HASH(
+    if constexpr (Policy::has_hash)
     flags |= GetErrorFlag(GetStackHash_(stack) != stack->hash_, STK_WRONG_HASH);
-    )
 
-    _ON_CANARY(
+    if constexpr (Policy::has_canary)
+    {
     canary_t canary = CANARY ^ (canary_t)stack;
     flags |= GetErrorFlag(stack->canary_start_ != canary,       STK_DEAD_CANARY);
     flags |= GetErrorFlag(stack->canary_end_   != canary,       STK_DEAD_CANARY);
-    )
+    }
 
     flags |= GetErrorFlag((long long)stack->size < 0,           STK_CORRUPTED_SIZE);
     flags |= GetErrorFlag(stack->size > stack->capacity,        STK_CORRUPTED_SIZE);
 
     flags |= GetErrorFlag((long long)stack->capacity < 0,       STK_CORRUPTED_CAP);
+    flags |= GetErrorFlag(stack->reserved_ &&
+                          stack->capacity > StackMappedCapacity_(stack),
+                                                                STK_CORRUPTED_CAP);
 
-    if (flags & (STK_CORRUPTED_SIZE | STK_CORRUPTED_SIZE)) 
-        return flags;
+    return flags;
+}
+
+template <typename T, typename Policy>
+unsigned int StackTopCheck_(const TypedStack<T, Policy>* stack)
+{
+    if (!StackCanReadData_(stack))
+        return STK_BAD_DATA_PTR;
+
+    unsigned int flags = STK_NO_ERROR;
+
+    if constexpr (Policy::has_canary)
+    {
+    canary_t* start = ((canary_t*) stack->data)- 1;
+    canary_t* end   =  (canary_t*)(stack->data + stack->capacity);
+
+    flags |= GetErrorFlag(CANARY != *start || CANARY != *end, STK_CORRUPTED_DATA);
+    }
 
-    flags |= StackDataCheck_(stack);
+    if (stack->size > 0 && ElementTraits<T>::IsPoison(stack->data[stack->size - 1]))
+        flags |= STK_CORRUPTED_DATA;
+
+    if (stack->size < stack->capacity && !ElementTraits<T>::IsPoison(stack->data[stack->size]))
+        flags |= STK_CORRUPTED_DATA;
 
     return flags;
 }
 
-unsigned int StackDataCheck_(const Stack* stack)
+template <typename T, typename Policy>
+unsigned int StackDataCheck_(const TypedStack<T, Policy>* stack)
 {
     unsigned int flags = STK_NO_ERROR;
 
-    if (!CanReadPointer(stack->data))
+    if (!StackCanReadData_(stack))
         return flags | STK_BAD_DATA_PTR;
 
-    _ON_HASH(
+    if constexpr (Policy::has_hash)
     flags |= GetErrorFlag(
-                stack->data_hash_ != GetHash(stack->data, stack->capacity),
+                stack->data_hash_ != GetDataHash_(stack),
                 STK_WRONG_DATA_HASH);
-    )
 
-    _ON_CANARY(
+    if constexpr (Policy::has_canary)
+    {
     canary_t* start = ((canary_t*) stack->data)- 1;
     canary_t* end   =  (canary_t*)(stack->data + stack->capacity);
-    
-    if (!CanReadPointer(start) || !CanReadPointer(end))
-        return flags | STK_BAD_DATA_PTR;
 
     flags |= GetErrorFlag(CANARY != *start || CANARY != *end, STK_CORRUPTED_DATA);
-    )
+    }
 
-    // TODO: Extractable
-    for (size_t i = 0; i < stack->size; i++)
-        if (!CanReadPointer(stack->data + i) || IsPoison(stack->data[i]))
-            return flags | STK_CORRUPTED_DATA;
+    if (StackFindPoison_(stack, 0, stack->size) != stack->size)
+        return flags | STK_CORRUPTED_DATA;
+
+    if (StackFindNotPoison_(stack, stack->size, stack->capacity) != stack->capacity)
+        return flags | STK_CORRUPTED_DATA;
 
-    for (size_t i = stack->size; i < stack->capacity; i++)
-        if (!CanReadPointer(stack->data + i) || !IsPoison(stack->data[i]))
-            return flags | STK_CORRUPTED_DATA;
-    
     return flags;
 }
 
-unsigned int StackAssert_(const Stack* stack,
+template <typename T>
+size_t FindPoison_(const T* values, size_t count)
+{
+    if constexpr (ElementTraits<T>::is_bitwise_poison)
+        return FindPattern(values, count, &ElementTraits<T>::poison, sizeof(T));
+    else
+    {
+        for (size_t i = 0; i < count; i++)
+            if (ElementTraits<T>::IsPoison(values[i]))
+                return i;
+        return count;
+    }
+}
+
+template <typename T, typename Policy>
+size_t StackFindPoison_(const TypedStack<T, Policy>* stack, size_t from, size_t to)
+{
+    return from + FindPoison_(stack->data + from, to - from);
+}
+
+template <typename T, typename Policy>
+size_t StackFindNotPoison_(const TypedStack<T, Policy>* stack, size_t from, size_t to)
+{
+    if constexpr (ElementTraits<T>::is_bitwise_poison)
+        return from + FindNotPattern(stack->data + from, to - from,
+                                     &ElementTraits<T>::poison, sizeof(T));
+    else
+    {
+        for (size_t i = from; i < to; i++)
+            if (!ElementTraits<T>::IsPoison(stack->data[i]))
+                return i;
+        return to;
+    }
+}
+
+template <typename T, typename Policy>
+int StackCanReadData_(const TypedStack<T, Policy>* stack)
+{
+    if (stack->capacity > (SIZE_MAX - 2*sizeof(canary_t)) / sizeof(T))
+        return 0;
+
+    size_t length = stack->capacity * sizeof(T);
+
+    if constexpr (Policy::has_canary)
+        return CanReadRange((const canary_t*)stack->data - 1,
+                            length + 2*sizeof(canary_t));
+
+    return CanReadRange(stack->data, length);
+}
+
+template <typename T, typename Policy>
+unsigned int StackAssert_(const TypedStack<T, Policy>* stack,
                             const char*  func,
                             const char*  file,
                             size_t       line,
-                            int force = 0)
+                            int force)
 {
-    unsigned int errs = StackCheck(stack);
-    
+    unsigned int errs = force ? StackCheck(stack) : StackScheduledCheck_(stack);
+
     if (!errs && !force)
         return STK_NO_ERROR;
 
+    return StackReport_(stack, errs, func, file, line);
+}
+
+template <typename T, typename Policy>
+unsigned int StackHeaderAssert_(const TypedStack<T, Policy>* stack,
+                                const char*  func,
+                                const char*  file,
+                                size_t       line)
+{
+    unsigned int errs = StackHeaderCheck_(stack);
+    if (!errs)
+        return STK_NO_ERROR;
+
+    return StackReport_(stack, errs, func, file, line);
+}
+
+template <typename T, typename Policy>
+unsigned int StackReport_(const TypedStack<T, Policy>* stack,
+                          unsigned int errs,
+                          const char*  func,
+                          const char*  file,
+                          size_t       line)
+{
+    if (errs & STK_BAD_PTR)
+    {
+        log_message(MSG_ERROR, "Stack[%p] is NOT READABLE\n"
+            "\tin %s:%zu in file \'%s\'\n",
+                stack, func, line, file);
+        return errs;
+    }
+
+    int is_data_readable = StackCanReadData_(stack);
+
     message_level level = errs ? MSG_ERROR : MSG_INFO;
 
     log_message(level, "Dumping stack[%p] (status: %s)\n"
@@ -373,218 +1271,1174 @@ unsigned int StackAssert_(const Stack* stack,
             stack,
             errs ? "CORRUPTED" : "ok",
             func, line, file);
-    
-    _ON_DEBUG_INFO(
-    log_message(level, "Stack \'%s\' declared in %s on line %zu, file \'%s\'\n",
-            stack->debug_.name,
-            stack->debug_.func_name,
-            stack->debug_.line_num,
-            stack->debug_.file_name);
-    )
+
+    if constexpr (Policy::has_debug_info)
+    {
+        const debug_info_* debug = StackDebugInfo_(stack);
+        if (debug)
+        log_message(level, "Stack \'%s\' declared in %s on line %zu, file \'%s\'\n",
+                debug->name,
+                debug->func_name,
+                debug->line_num,
+                debug->file_name);
+        else
+        log_message(level, "Stack debug info is NOT READABLE\n");
+    }
 
 
     if (errs)
         log_message(level, "Error flags: %o\n", errs);
 
-    _ON_HASH(
+    if constexpr (Policy::has_hash)
     log_message(level, "Hash:"
             "\tstored: %#llx\n"
             "\tactual: %#llx\n",
             stack->hash_, GetStackHash_(stack));
-    )
 
     // TODO: Extractable!
-    _ON_CANARY(
+    if constexpr (Policy::has_canary)
     log_message(level, "Canary state:\n"
         "\tstart: %#016llx ^ %#016llx\n"
         "\tend  : %#016llx ^ %#016llx\n",
         CANARY, stack->canary_start_ ^ CANARY,
         CANARY, stack->canary_end_   ^ CANARY);
-    )
 
     // TODO: Extractable!
     log_message(level, "Elements stored: %zu\n"
         "Total capacity : %zu\n",
         stack->size,
         stack->capacity);
-    
-    _ON_HASH(
-        log_message(level, "Data hash:\n"
-                "\tstored: %#llx\n"
-                "\tactual: %#llx\n",
-                stack->data_hash_,
-                GetHash(stack->data, stack->capacity));
-    )
-    
-    // TODO: Extractable!
-    log_message(level, "Data[%p]:\n", stack->data);
-    if (errs & STK_BAD_DATA_PTR) // TODO: Mix of conditinally and uncoditionally compilated, can you reduce?
+
+    if (stack->file_)
+        log_message(level, "Storage: file-backed, %zu bytes reserved\n", stack->reserved_);
+    else if (stack->reserved_)
+        log_message(level, "Storage: mapped, %zu bytes reserved\n", stack->reserved_);
+    else
+        log_message(level, "Storage: %s\n", StackIsInline_(stack) ? "inline" : "heap");
+
+    if (CanReadRange(stack->growth_, sizeof(*stack->growth_)))
+        log_message(level, "Growth: x%zu/%zu, min %zu, pages from %zu bytes, "
+                           "shrink at 1/%zu\n",
+                stack->growth_->factor_num,
+                stack->growth_->factor_den,
+                stack->growth_->min_capacity,
+                stack->growth_->page_threshold,
+                stack->growth_->shrink_ratio);
+    else
+        log_message(level, "Growth policy[%p] is NOT READABLE\n", stack->growth_);
+
+    /* Data hash covers `size` elements, which cannot be read if size is corrupted */
+    if constexpr (Policy::has_hash)
     {
-        log_message(level, "\tNOT READABLE\n");
-        return errs;
+        if (is_data_readable && stack->size <= stack->capacity)
+            log_message(level, "Data hash:\n"
+                    "\tstored: %#llx\n"
+                    "\tactual: %#llx\n",
+                    stack->data_hash_,
+                    GetDataHash_(stack));
+        else
+            log_message(level, "Data hash:\n"
+                    "\tstored: %#llx\n"
+                    "\tactual: n/a\n",
+                    stack->data_hash_);
     }
 
-    _ON_CANARY(
-    canary_t* start = ((canary_t*) stack->data)- 1;
+    if (stack_dump_dir_)
+    {
+        static unsigned int dump_count = 0;
 
-    if (CanReadPointer(start))
-        log_message(level, "\tcanary: %#016llx\n", *start);
-    else
-        log_message(level, "\tcanary: NOT READABLE\n");
-    )
-
-    for (size_t i = 0; i < stack->capacity; i++)
-    {
-        log_message(level, "\t%c[%zu]: %s",
-            i < stack->size ? '*' : ' ',
-            i,
-            CanReadPointer(stack->data + i) 
-                ? IsPoison(stack->data[i])
-                    ? "POISON"
-                    : "ok"      /* How to print actual element here? */
-                : "NOT_READABLE");
-        /*
-        if (i < stack->size)
-            log_message(level, "*");
-        else
-            log_message(level, " ");
-        
-        log_message(level, "[%zu]: ", i);
-        
-        if (!CanReadPointer(stack->data + i))
-            log_message(level, "NOT READABLE");
-        else if (IsPoison(stack->data[i]))
-            log_message(level, "POISON");
+        char path[512] = "";
+        snprintf(path, sizeof(path), "%s/stack-%p-%u.stkdump", stack_dump_dir_, stack,
+                 __atomic_fetch_add(&dump_count, 1, __ATOMIC_RELAXED));
+
+        if (StackWriteDump_(stack, errs, path, func, file, line) == STK_NO_ERROR)
+            log_message(level, "Binary dump written to \'%s\'\n", path);
         else
-            PrintElement(stack->data[i]);
-        
-        log_message(level, "\n");*/
+            log_message(level, "Failed to write binary dump to \'%s\'\n", path);
     }
 
-    _ON_CANARY(
-    canary_t* end = (canary_t*)(stack->data + stack->capacity);
+    // TODO: Extractable!
+    log_message(level, "Data[%p]:\n", stack->data);
+    if (!is_data_readable)
+    {
+        log_message(level, "\tNOT READABLE\n");
+        return errs;
+    }
 
-    if (CanReadPointer(end))
-        log_message(level, "\tcanary: %#016llx\n", *end);
-    else
-        log_message(level, "\tcanary: NOT READABLE\n");
-    )
+    if constexpr (Policy::has_canary)
+    {
+    canary_t* start = ((canary_t*) stack->data)- 1;
+    log_message(level, "\tcanary: %#016llx\n", *start);
+    }
+
+    StackLogSlots_(stack, level);
+
+    if constexpr (Policy::has_canary)
+    {
+    canary_t* end = (canary_t*)(stack->data + stack->capacity);
+    log_message(level, "\tcanary: %#016llx\n", *end);
+    }
 
     return errs;
 }
 
-element_t* ReallocWithCanary_(element_t* old_array,
-                            size_t   old_size,
-                            size_t   new_size)
+template <typename T, typename Policy>
+void StackLogSlots_(const TypedStack<T, Policy>* stack, message_level level)
 {
-    _ON_CANARY(
-        if (old_array == NULL) old_size = 0;
+    size_t ranges = 0;
 
-        /* Allocate result */
-        void* allocated = realloc(
-                /* Calculate real array start*/
-                old_array
-                    ? (canary_t*)old_array - 1  /* get real beginning */
-                    : NULL,                     /* allocate new array */
-                /* Ensure there is enough space for canaries */
-                new_size*sizeof(element_t) + 2*sizeof(canary_t));
-        
-        if (allocated == NULL) // TODO: Check why? perror?
-            return NULL;
+    for (size_t start = 0; start < stack->capacity;)
+    {
+        int is_stored = start < stack->size;
+        int is_poison = ElementTraits<T>::IsPoison(stack->data[start]) != 0;
+
+        size_t end = start + 1;
+        while (end < stack->capacity && (end < stack->size) == is_stored &&
+               (ElementTraits<T>::IsPoison(stack->data[end]) != 0) == is_poison)
+            end++;
+
+        if (ranges++ < dump_max_ranges_)
+        {
+            if (end - start == 1)
+                log_message(level, "\t%c[%zu]: %s",
+                    is_stored ? '*' : ' ', start,
+                    is_poison ? "POISON" : "ok");
+            else
+                log_message(level, "\t%c[%zu..%zu]: %s",
+                    is_stored ? '*' : ' ', start, end - 1,
+                    is_poison ? "POISON" : "ok");
+        }
+
+        start = end;
+    }
+
+    if (ranges > dump_max_ranges_)
+        log_message(level, "\t... %zu more ranges", ranges - dump_max_ranges_);
+}
+
+template <typename T, typename Policy>
+unsigned int StackDumpBinary_(const TypedStack<T, Policy>* stack,
+                              const char* path,
+                              const char* func,
+                              const char* file,
+                              size_t line)
+{
+    unsigned int errs = StackCheck(stack);
+
+    if (errs & STK_BAD_PTR)
+        return errs;
+
+    return errs | StackWriteDump_(stack, errs, path, func, file, line);
+}
+
+/**
+ * @brief 
+ * Copy string to fixed-size dump field
+ */
+inline void CopyDumpString_(char* dest, const char* src)
+{
+    if (CanReadRange(src, 1))
+        strncpy(dest, src, STK_DUMP_STRING_LENGTH - 1);
+}
+
+template <typename T, typename Policy>
+unsigned int StackWriteDump_(const TypedStack<T, Policy>* stack,
+                             unsigned int errs,
+                             const char* path,
+                             const char* func,
+                             const char* file,
+                             size_t line)
+{
+    int is_data_readable = StackCanReadData_(stack);
+    size_t slot_count    = is_data_readable ? stack->capacity : 0;
+
+    /* Whole dump is assembled in memory and written at once */
+    size_t length = sizeof(stack_dump_header) + slot_count*(1 + sizeof(T));
+    unsigned char* buffer = (unsigned char*)calloc(length, 1);
+    if (!buffer)
+        return STK_NO_MEMORY;
+
+    stack_dump_header* header = (stack_dump_header*)buffer;
+
+    header->magic            = STK_DUMP_MAGIC;
+    header->version          = STK_DUMP_VERSION;
+    header->errors           = errs;
+    header->protection       = (Policy::has_canary     ? STK_CANARY_PROT : 0) |
+                               (Policy::has_hash       ? STK_HASH_PROT   : 0) |
+                               (Policy::has_debug_info ? STK_DEBUG_INFO  : 0);
+    header->is_data_readable = (unsigned int)is_data_readable;
+    header->stack_address    = (unsigned long long)stack;
+    header->data_address     = (unsigned long long)stack->data;
+    header->element_size     = sizeof(T);
+    header->size             = stack->size;
+    header->capacity         = stack->capacity;
+    header->reserved         = stack->reserved_;
+    header->slot_count       = slot_count;
+    header->caller_line      = line;
+
+    CopyDumpString_(header->caller_func, func);
+    CopyDumpString_(header->caller_file, file);
+
+    if constexpr (Policy::has_hash)
+    {
+        header->stored_hash      = stack->hash_;
+        header->actual_hash      = GetStackHash_(stack);
+        header->stored_data_hash = stack->data_hash_;
+        if (is_data_readable && stack->size <= stack->capacity)
+            header->actual_data_hash = GetDataHash_(stack);
+    }
+
+    if constexpr (Policy::has_canary)
+    {
+        header->canary_start = stack->canary_start_;
+        header->canary_end   = stack->canary_end_;
+        if (is_data_readable)
+        {
+            header->data_canary_start = ((canary_t*)stack->data)[-1];
+            header->data_canary_end   = *(canary_t*)(stack->data + stack->capacity);
+        }
+    }
+
+    if constexpr (Policy::has_debug_info)
+    {
+        if (const debug_info_* debug = StackDebugInfo_(stack))
+        {
+            header->line_num = debug->line_num;
+            CopyDumpString_(header->name,      debug->name);
+            CopyDumpString_(header->func_name, debug->func_name);
+            CopyDumpString_(header->file_name, debug->file_name);
+        }
+    }
+
+    unsigned char* status = buffer + sizeof(stack_dump_header);
+    for (size_t i = 0; i < slot_count; i++)
+        status[i] = (unsigned char)(
+                        (i < stack->size ? STK_SLOT_STORED : STK_SLOT_FREE) |
+                        (ElementTraits<T>::IsPoison(stack->data[i]) ? STK_SLOT_POISON : 0));
 
-        element_t* result = (element_t*)((canary_t*)allocated + 1);
-        /* Fill new elements (if any) with poison*/
-        
-        for (size_t i = old_size; i < new_size; i++) // TODO: Trying to beat memset, huh?)
-            result[i] = element_poison;
+    if (slot_count)
+        memcpy(status + slot_count, stack->data, slot_count*sizeof(T));
 
-        /* Set canaries before and after array*/
-        ((canary_t*) result)[-1]        = CANARY;
-        *(canary_t*)(result + new_size) = CANARY;
-        return result;
-    )
-    _NO_CANARY(
-        return realloc(old_array, new_size);
-    )
+    FILE* output = fopen(path, "wb");
+    int is_written = output && fwrite(buffer, 1, length, output) == length;
+    if (output && fclose(output) != 0)
+        is_written = 0;
 
+    free(buffer);
+
+    return is_written ? STK_NO_ERROR : STK_BAD_FILE;
 }
 
-void FreeWithCanary_(element_t* ptr)
+template <typename Policy, typename T>
+T* ReallocWithCanary_(T* old_array,
+                      size_t   old_size,
+                      size_t   new_size)
 {
-    free((canary_t*)ptr - 1);
+    /* Canaries occupy space before and after array*/
+    const size_t canary_size = Policy::has_canary ? sizeof(canary_t) : 0;
+
+    if (old_array == NULL) old_size = 0;
+
+    /* Allocate result */
+    void* allocated = BufferRealloc(
+            /* Calculate real array start*/
+            old_array
+                ? (char*)old_array - canary_size    /* get real beginning */
+                : NULL,                             /* allocate new array */
+            old_size*sizeof(T) + 2*canary_size,
+            /* Ensure there is enough space for canaries */
+            new_size*sizeof(T) + 2*canary_size);
+
+    if (allocated == NULL) // TODO: Check why? perror?
+        return NULL;
+
+    if (old_size*sizeof(T) >= unmap_threshold_)
+        InvalidateReadableRanges();
+
+    T* result = (T*)((char*)allocated + canary_size);
+    InitWithCanary_<Policy>(result, old_size, new_size);
+
+    return result;
 }
 
-inline size_t GetNewCapacity_(size_t size)
+template <typename Policy, typename T>
+void InitWithCanary_(T* array, size_t old_size, size_t new_size)
 {
-    return (size_t)round((double)size * stack_growth_);
+    /* Fill new elements (if any) with poison*/
+    if (old_size < new_size)
+        FillPattern(array + old_size, new_size - old_size,
+                    &ElementTraits<T>::poison, sizeof(T));
+
+    /* Set canaries before and after array*/
+    if constexpr (Policy::has_canary)
+    {
+        ((canary_t*) array)[-1]        = CANARY;
+        *(canary_t*)(array + new_size) = CANARY;
+    }
 }
 
-inline size_t GetCapacityLimit_(size_t size)
+template <typename T, typename Policy>
+T* StackInlineData_(const TypedStack<T, Policy>* stack)
 {
-    return (size_t)round((double)size * stack_growth_*stack_growth_);
+    static_assert(Policy::inline_capacity > 0, "Policy has no inline storage");
+
+    const size_t canary_size = Policy::has_canary ? sizeof(canary_t) : 0;
+    return (T*)(const_cast<unsigned char*>(stack->inline_.bytes) + canary_size);
 }
 
-int StackTryGrow_(Stack* stack)
+template <typename T, typename Policy>
+int StackIsInline_(const TypedStack<T, Policy>* stack)
 {
-    if (stack->size < stack->capacity)
+    if constexpr (Policy::inline_capacity > 0)
+        return stack->data == StackInlineData_(stack);
+    else
         return 0;
-    
-    size_t new_capacity = GetNewCapacity_(stack->size);
-    
-    element_t* new_data = ReallocWithCanary_(stack->data,
-                                           stack->capacity,
-                                           new_capacity);
+}
+
+template <typename Policy, typename T>
+void FreeWithCanary_(T* ptr, size_t size)
+{
+    const size_t canary_size = Policy::has_canary ? sizeof(canary_t) : 0;
+
+    BufferFree((char*)ptr - canary_size, size*sizeof(T) + 2*canary_size);
+
+    if (size*sizeof(T) >= unmap_threshold_)
+        InvalidateReadableRanges();
+}
+
+template <typename T, typename Policy>
+size_t GetNewCapacity_(const TypedStack<T, Policy>* stack, size_t capacity)
+{
+    const growth_policy* growth = stack->growth_;
+
+    const size_t canary_size  = Policy::has_canary ? sizeof(canary_t) : 0;
+    const size_t max_capacity = stack->reserved_
+                                    ? StackMappedCapacity_(stack)
+                                    : (SIZE_MAX - 2*canary_size - page_size_) / sizeof(T);
+
+    if (capacity >= max_capacity)
+        return capacity;
+
+    size_t new_capacity = max_capacity;
+
+    /* Split `capacity` to avoid overflow in `capacity * factor_num` */
+    if (capacity / growth->factor_den < max_capacity / growth->factor_num)
+        new_capacity = capacity / growth->factor_den * growth->factor_num
+                     + capacity % growth->factor_den * growth->factor_num
+                                                     / growth->factor_den;
+
+    if (new_capacity <= capacity)
+        new_capacity = capacity + 1;
+
+    if (new_capacity < growth->min_capacity)
+        new_capacity = growth->min_capacity;
+
+    /* Mapped storage is committed by pages anyway */
+    size_t bytes = new_capacity*sizeof(T) + 2*canary_size;
+    if (stack->reserved_ ||
+        (growth->page_threshold != 0 && bytes >= growth->page_threshold))
+    {
+        bytes = (bytes + page_size_ - 1) / page_size_ * page_size_;
+        new_capacity = (bytes - 2*canary_size) / sizeof(T);
+    }
+
+    return new_capacity < max_capacity ? new_capacity : max_capacity;
+}
+
+template <typename T, typename Policy>
+int StackResize_(TypedStack<T, Policy>* stack, size_t new_capacity)
+{
+    if (stack->reserved_)
+        return StackMapResize_(stack, new_capacity);
+
+    /* Inline buffer is never reallocated, elements are moved to heap */
+    int is_inline = StackIsInline_(stack);
+
+    if constexpr (Policy::inline_capacity > 0)
+    {
+        if (new_capacity <= Policy::inline_capacity)
+        {
+            if (is_inline)
+                return 0;
+
+            T* inline_data = StackInlineData_(stack);
+            memcpy(inline_data, stack->data, stack->size*sizeof(T));
+            InitWithCanary_<Policy>(inline_data, stack->size, Policy::inline_capacity);
+            FreeWithCanary_<Policy>(stack->data, stack->capacity);
+
+            stack->data     = inline_data;
+            stack->capacity = Policy::inline_capacity;
+            return 0;
+        }
+    }
+
+    T* new_data = ReallocWithCanary_<Policy>(is_inline ? NULL : stack->data,
+                                             stack->capacity,
+                                             new_capacity);
     if (!new_data)
         return -1; /* There is no bool in C*/
-    
+
+    if (is_inline)
+        memcpy(new_data, stack->data, stack->size*sizeof(T));
+
     stack->data     = new_data;
     stack->capacity = new_capacity;
 
     return 0;
 }
 
-int StackTryShrink_(Stack* stack)
+template <typename T, typename Policy>
+int StackMapReserve_(TypedStack<T, Policy>* stack, size_t max_capacity)
 {
-    size_t capacity_limit = GetCapacityLimit_(stack->size);
+    const size_t canary_size = Policy::has_canary ? sizeof(canary_t) : 0;
+    const size_t page_size   = GetPageSize();
 
-    if (capacity_limit <= default_cap_ || stack->capacity < capacity_limit)
-        return 0;
+    if (max_capacity > (SIZE_MAX - 2*canary_size - page_size) / sizeof(T))
+        return -1;
 
-    size_t new_capacity = GetNewCapacity_(stack->size);
+    size_t reserved = max_capacity*sizeof(T) + 2*canary_size;
+    reserved = (reserved + page_size - 1) / page_size * page_size;
 
-    if (new_capacity <= default_cap_)
-        new_capacity = default_cap_;
-    
-    element_t* new_data = ReallocWithCanary_(
-                                        stack->data,
-                                        stack->capacity,
-                                           new_capacity);
-    if (!new_data)
-        return -1; /* Still no bools in C */
-    
-    stack->data     = new_data;
+    char* range = (char*)MapReserve(reserved);
+    if (!range)
+        return -1;
+
+    stack->data      = (T*)(range + canary_size);
+    stack->reserved_ = reserved;
+
+    size_t capacity = GetNewCapacity_(stack, 0);
+    if (MapCommit(range, 0, capacity*sizeof(T) + 2*canary_size) != 0)
+    {
+        MapRelease(range, reserved);
+        stack->data      = NULL;
+        stack->reserved_ = 0;
+        return -1;
+    }
+
+    InitWithCanary_<Policy>(stack->data, 0, capacity);
+    stack->capacity = capacity;
+
+    return 0;
+}
+
+template <typename T, typename Policy>
+int StackMapResize_(TypedStack<T, Policy>* stack, size_t new_capacity)
+{
+    const size_t canary_size = Policy::has_canary ? sizeof(canary_t) : 0;
+
+    if (new_capacity > StackMappedCapacity_(stack))
+        return -1;
+
+    size_t old_bytes = stack->capacity*sizeof(T) + 2*canary_size;
+    size_t new_bytes =     new_capacity*sizeof(T) + 2*canary_size;
+
+    if (MapCommit((char*)stack->data - canary_size, old_bytes, new_bytes) != 0)
+        return -1;
+
+    /* Decommitted pages are no longer readable */
+    if (new_bytes < old_bytes)
+        InvalidateReadableRanges();
+
+    InitWithCanary_<Policy>(stack->data, stack->capacity, new_capacity);
     stack->capacity = new_capacity;
 
     return 0;
 }
 
-void StackRecalculateHash_(Stack* stack)
+template <typename T, typename Policy>
+size_t StackMappedCapacity_(const TypedStack<T, Policy>* stack)
+{
+    const size_t canary_size = Policy::has_canary ? sizeof(canary_t) : 0;
+    return (stack->reserved_ - 2*canary_size) / sizeof(T);
+}
+
+template <typename T, typename Policy>
+int StackTryGrow_(TypedStack<T, Policy>* stack, size_t count)
+{
+    if (stack->size + count <= stack->capacity)
+        return 0;
+
+    size_t new_capacity = stack->capacity;
+    while (new_capacity < stack->size + count)
+    {
+        size_t next_capacity = GetNewCapacity_(stack, new_capacity);
+        if (next_capacity <= new_capacity)
+            return -1;
+        new_capacity = next_capacity;
+    }
+
+    return StackResize_(stack, new_capacity);
+}
+
+template <typename T, typename Policy>
+int StackTryShrink_(TypedStack<T, Policy>* stack)
+{
+    const growth_policy* growth = stack->growth_;
+
+    /* Lazy policy and inline buffer never shrink */
+    if (growth->shrink_ratio == 0 || StackIsInline_(stack))
+        return 0;
+
+    /* Shrink only when capacity is `shrink_ratio` times bigger than size,
+       so that stack oscillating around threshold is not reallocated */
+    if (stack->size > stack->capacity / growth->shrink_ratio)
+        return 0;
+
+    size_t new_capacity = GetNewCapacity_(stack, stack->size);
+
+    /* Move elements back inline once they fit there with hysteresis */
+    if (Policy::inline_capacity > 0 &&
+        stack->size <= Policy::inline_capacity / growth->shrink_ratio)
+        new_capacity = Policy::inline_capacity;
+
+    if (new_capacity >= stack->capacity)
+        return 0;
+
+    return StackResize_(stack, new_capacity);
+}
+
+template <typename T, typename Policy>
+void StackRecalculateHash_(TypedStack<T, Policy>* stack)
+{
+    if constexpr (Policy::has_hash)
+    {
+        stack->data_hash_ = GetDataHash_(stack);
+        stack->hash_      = GetStackHash_(stack);
+    }
+}
+
+template <typename T, typename Policy>
+void StackUpdateHash_(TypedStack<T, Policy>* stack)
 {
-    _ON_HASH(
-        stack->data_hash_ = GetHash(stack->data, stack->capacity);
+    if constexpr (Policy::has_hash)
         stack->hash_      = GetStackHash_(stack);
-    )
 }
 
-hash_t GetStackHash_(const Stack* stack)
+template <typename T, typename Policy>
+hash_t GetSlotHash_(const TypedStack<T, Policy>* stack, size_t index)
+{
+    return GetSlotHash(stack->data + index, sizeof(T), index);
+}
+
+template <typename T, typename Policy>
+hash_t GetDataHash_(const TypedStack<T, Policy>* stack)
+{
+    return GetSlotsHash(stack->data, stack->size, sizeof(T), 0);
+}
+
+template <typename T, typename Policy>
+hash_t GetStackHash_(const TypedStack<T, Policy>* stack)
 {
-    _ON_HASH(
-        hash_t old_hash = stack->hash_;
-        const_cast<Stack*>(stack)->hash_ = 0;
-        hash_t new_hash = GetHash(stack, sizeof(*stack));
-        const_cast<Stack*>(stack)->hash_ = old_hash;
-        return new_hash;
-    )
+    if constexpr (Policy::has_hash && Policy::split_layout)
+    {
+        /* Only fields describing buffer are protected */
+        const struct
+        {
+            const T*                data;
+            size_t                  size;
+            size_t                  capacity;
+            hash_t                  data_hash;
+            const growth_policy*    growth;
+            size_t                  reserved;
+            const void*             file;
+        } hot = {
+            stack->data, stack->size, stack->capacity, stack->data_hash_,
+            stack->growth_, stack->reserved_, stack->file_
+        };
+        return GetHash(&hot, sizeof(hot));
+    }
+    else if constexpr (Policy::has_hash)
+    {
+        /* Copy bytewise, so that padding is hashed as well */
+        TypedStack<T, Policy> copy;
+        memcpy(&copy, stack, sizeof(copy));
+        copy.hash_ = 0;
+        if constexpr (Policy::has_sampled_check)
+        {
+            /* Keep settings protected, but not the changing state */
+            copy.check_.ops_left     = 0;
+            copy.check_.credit_ns    = 0;
+            copy.check_.last_cost_ns = 0;
+        }
+        return GetHash(&copy, sizeof(copy));
+    }
     return 0;
 }
+
+template <typename T, typename Policy>
+unsigned int StackSetCheckPeriod(TypedStack<T, Policy>* stack, size_t period)
+{
+    static_assert(Policy::has_sampled_check, "Policy has no sampled checks");
+
+    unsigned int err = StackAssert(stack);
+    if (err) return err;
+
+    stack->check_.period   = period;
+    stack->check_.ops_left = period;
+
+    StackUpdateHash_(stack);
+
+    return STK_NO_ERROR;
+}
+
+template <typename T, typename Policy>
+unsigned int StackSetCheckBudget(TypedStack<T, Policy>* stack, unsigned long long budget_ns)
+{
+    static_assert(Policy::has_sampled_check, "Policy has no sampled checks");
+
+    unsigned int err = StackAssert(stack);
+    if (err) return err;
+
+    stack->check_.budget_ns = budget_ns;
+    stack->check_.credit_ns = 0;
+
+    StackUpdateHash_(stack);
+
+    return STK_NO_ERROR;
+}
+
+template <typename T, typename Policy>
+unsigned int StackReserve(TypedStack<T, Policy>* stack, size_t capacity)
+{
+    unsigned int err = StackAssert(stack);
+    if (err) return err;
+
+    if (capacity <= stack->capacity)
+        return STK_NO_ERROR;
+
+    const size_t canary_size = Policy::has_canary ? sizeof(canary_t) : 0;
+
+    if (capacity > (SIZE_MAX - 2*canary_size) / sizeof(T) || StackResize_(stack, capacity) < 0)
+    {
+        log_message(MSG_WARNING, "Failed to reserve %zu elements in stack %p. "
+                                 "Not enough memory", capacity, stack);
+        return STK_NO_MEMORY;
+    }
+
+    StackUpdateHash_(stack);
+
+    return STK_NO_ERROR;
+}
+
+template <typename T, typename Policy>
+unsigned int StackShrinkToFit(TypedStack<T, Policy>* stack)
+{
+    unsigned int err = StackAssert(stack);
+    if (err) return err;
+
+    /* Heap buffer is never empty */
+    size_t new_capacity = stack->size ? stack->size : 1;
+
+    if (new_capacity >= stack->capacity || StackIsInline_(stack))
+        return STK_NO_ERROR;
+
+    if (StackResize_(stack, new_capacity) < 0)
+    {
+        log_message(MSG_WARNING, "Failed to shrink stack %p", stack);
+        return STK_NO_MEMORY;
+    }
+
+    StackUpdateHash_(stack);
+
+    return STK_NO_ERROR;
+}
+
+template <typename T, typename Policy, typename... Args>
+unsigned int StackEmplace(TypedStack<T, Policy>* stack, Args&&... args)
+{
+    unsigned int err = StackAssert(stack);
+    if (err) return err;
+
+    if (StackTryGrow_(stack) < 0)
+    {
+        log_message(MSG_WARNING, "Failed to push to stack %p. Not enough memory", stack);
+        return STK_NO_MEMORY;
+    }
+
+    /* Slot holds poison, which needs no destruction */
+    new (stack->data + stack->size) T(std::forward<Args>(args)...);
+
+    /* Constructed poison leaves slot free, as it was before */
+    if (ElementTraits<T>::IsPoison(stack->data[stack->size]))
+    {
+        log_message(MSG_WARNING, "Attempt to push poison value to stack %p spotted.", stack);
+        return STK_POISON_VALUE;
+    }
+    if constexpr (Policy::has_hash)
+        stack->data_hash_ += GetSlotHash_(stack, stack->size);
+    stack->size++;
+
+    StackUpdateHash_(stack);
+
+    return STK_NO_ERROR;
+}
+
+template <typename T, typename Policy>
+unsigned int StackMove(TypedStack<T, Policy>* dest, TypedStack<T, Policy>* source)
+{
+    /* Header check is enough to trust transferred buffer, keeping move O(1) */
+    unsigned int err = StackHeaderAssert(source);
+    if (err) return err;
+
+    if (dest == source)
+        return STK_NO_ERROR;
+
+    *dest = {};
+    StackTakeBuffer_(dest, source);
+
+    if constexpr (Policy::has_debug_info)
+        dest->debug_ = source->debug_;
+    if constexpr (Policy::has_sampled_check)
+        dest->check_ = source->check_;
+
+    StackRekey_(dest);
+    *source = {};
+
+    log_message(MSG_TRACE, "Moved stack from %p to %p", source, dest);
+    return STK_NO_ERROR;
+}
+
+template <typename T, typename Policy>
+unsigned int StackSwap(TypedStack<T, Policy>* first, TypedStack<T, Policy>* second)
+{
+    unsigned int err = StackHeaderAssert(first) | StackHeaderAssert(second);
+    if (err) return err;
+
+    if (first == second)
+        return STK_NO_ERROR;
+
+    TypedStack<T, Policy> temp = {};
+    StackTakeBuffer_(&temp,  first);
+    StackTakeBuffer_(first,  second);
+    StackTakeBuffer_(second, &temp);
+
+    StackRekey_(first);
+    StackRekey_(second);
+
+    return STK_NO_ERROR;
+}
+
+template <typename T, typename Policy>
+unsigned int StackSteal(TypedStack<T, Policy>* dest, TypedStack<T, Policy>* source)
+{
+    unsigned int err = StackHeaderAssert(dest) | StackHeaderAssert(source);
+    if (err) return err;
+
+    if (dest == source)
+        return STK_NO_ERROR;
+
+    /* Replacement buffer is allocated first, so that failure changes nothing */
+    T*     data     = NULL;
+    size_t capacity = Policy::inline_capacity;
+    if constexpr (Policy::inline_capacity == 0)
+    {
+        capacity = source->growth_->min_capacity;
+        data     = ReallocWithCanary_<Policy>((T*)NULL, 0, capacity);
+        if (!data)
+        {
+            log_message(MSG_WARNING, "Failed to steal buffer of stack %p. "
+                                     "Not enough memory", source);
+            return STK_NO_MEMORY;
+        }
+    }
+
+    StackFreeBuffer_(dest);
+    StackTakeBuffer_(dest, source);
+    StackRekey_(dest);
+
+    if constexpr (Policy::inline_capacity > 0)
+    {
+        data = StackInlineData_(source);
+        InitWithCanary_<Policy>(data, 0, capacity);
+    }
+
+    source->data      = data;
+    source->size      = 0;
+    source->capacity  = capacity;
+    source->reserved_ = 0;
+    source->file_     = NULL;
+    StackRecalculateHash_(source);
+
+    return STK_NO_ERROR;
+}
+
+template <typename T, typename Policy>
+void StackTakeBuffer_(TypedStack<T, Policy>* dest, const TypedStack<T, Policy>* source)
+{
+    dest->data      = source->data;
+    dest->size      = source->size;
+    dest->capacity  = source->capacity;
+    dest->growth_   = source->growth_;
+    dest->reserved_ = source->reserved_;
+    dest->file_     = source->file_;
+
+    if constexpr (Policy::has_hash)
+        dest->data_hash_ = source->data_hash_;
+
+    if constexpr (Policy::inline_capacity > 0)
+    {
+        if (StackIsInline_(source))
+        {
+            memcpy(dest->inline_.bytes, source->inline_.bytes, sizeof(dest->inline_.bytes));
+            dest->data = StackInlineData_(dest);
+        }
+    }
+}
+
+template <typename T, typename Policy>
+void StackRekey_(TypedStack<T, Policy>* stack)
+{
+    if constexpr (Policy::has_canary)
+    {
+        canary_t canary = CANARY ^ (canary_t)stack;
+        stack->canary_start_ = canary;
+        stack->canary_end_   = canary;
+    }
+
+    StackUpdateHash_(stack);
+}
+
+template <typename T, typename Policy>
+unsigned int StackOpen_(TypedStack<T, Policy>* stack,
+                        const char* path,
+                        size_t max_capacity,
+                        const char* name,
+                        const char* func_name,
+                        const char* file_name,
+                        size_t line_num,
+                        const growth_policy* growth)
+{
+    *stack = {};
+
+    if (StackSetGrowth_(stack, growth) != 0)
+        return STK_CORRUPTED_CAP;
+
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+    {
+        log_message(MSG_WARNING, "Failed to open stack file \'%s\'", path);
+        return STK_BAD_FILE;
+    }
+
+    stack_file_header header = {};
+    int is_new = 0;
+
+    unsigned int errs = StackReadFileHeader_<T, Policy>(fd, max_capacity, &header, &is_new);
+    if (errs)
+    {
+        close(fd);
+        log_message(MSG_ERROR, "Stack file \'%s\' is CORRUPTED (error flags: %o)\n",
+                               path, errs);
+        return errs;
+    }
+
+    const size_t canary_size = Policy::has_canary ? sizeof(canary_t) : 0;
+
+    /* Mapping keeps file open */
+    char* range = (char*)MapReserveFile(fd, header.data_offset + header.reserved);
+    close(fd);
+
+    if (!range || MapCommit(range, 0, header.data_offset) != 0)
+    {
+        MapRelease(range, header.data_offset + header.reserved);
+        log_message(MSG_WARNING, "Failed to map stack file \'%s\'", path);
+        return STK_BAD_FILE;
+    }
+
+    stack->file_     = (stack_file_header*)range;
+    stack->data      = (T*)(range + header.data_offset + canary_size);
+    stack->reserved_ = header.reserved;
+    stack->size      = header.size;
+    stack->capacity  = is_new ? GetNewCapacity_(stack, 0) : header.capacity;
+
+    if (MapCommit(range + header.data_offset, 0,
+                  stack->capacity*sizeof(T) + 2*canary_size) != 0)
+    {
+        MapRelease(range, header.data_offset + header.reserved);
+        *stack = {};
+        log_message(MSG_WARNING, "Failed to map stack file \'%s\'", path);
+        return STK_BAD_FILE;
+    }
+
+    if (is_new)
+        InitWithCanary_<Policy>(stack->data, 0, stack->capacity);
+
+    /* Stored elements are checked lazily against stored data hash */
+    if constexpr (Policy::has_hash)
+        stack->data_hash_ = header.data_hash;
+
+    StackInitInfo_(stack, name, func_name, file_name, line_num);
+    StackUpdateHash_(stack);
+
+    /* Header is rewritten, as reservation may have been extended */
+    StackFillFileHeader_(stack, stack->reserved_, stack->file_);
+
+    log_message(MSG_TRACE, "Opened stack at %p from file \'%s\'", stack, path);
+    return STK_NO_ERROR;
+}
+
+template <typename T, typename Policy>
+unsigned int StackSync(TypedStack<T, Policy>* stack)
+{
+    unsigned int err = StackAssert(stack);
+    if (err) return err;
+
+    if (!stack->file_)
+        return STK_BAD_FILE;
+
+    StackFillFileHeader_(stack, stack->reserved_, stack->file_);
+
+    const size_t canary_size = Policy::has_canary ? sizeof(canary_t) : 0;
+    size_t length = GetPageSize() + stack->capacity*sizeof(T) + 2*canary_size;
+
+    if (msync(stack->file_, length, MS_SYNC) != 0)
+    {
+        log_message(MSG_WARNING, "Failed to sync persistent stack %p", stack);
+        return STK_BAD_FILE;
+    }
+
+    return STK_NO_ERROR;
+}
+
+template <typename T, typename Policy>
+unsigned int StackSnapshot(const TypedStack<T, Policy>* stack, const char* path)
+{
+    unsigned int err = StackAssert(stack);
+    if (err) return err;
+
+    const size_t canary_size = Policy::has_canary ? sizeof(canary_t) : 0;
+    const size_t page_size   = GetPageSize();
+
+    size_t length   = stack->capacity*sizeof(T) + 2*canary_size;
+    size_t reserved = stack->reserved_
+                        ? stack->reserved_
+                        : (length + page_size - 1) / page_size * page_size;
+
+    stack_file_header header = {};
+    StackFillFileHeader_(stack, reserved, &header);
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        log_message(MSG_WARNING, "Failed to create snapshot file \'%s\'", path);
+        return STK_BAD_FILE;
+    }
+
+    int is_written =
+        pwrite(fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header) &&
+        pwrite(fd, (const char*)stack->data - canary_size, length,
+               (off_t)page_size) == (ssize_t)length &&
+        ftruncate(fd, (off_t)(page_size + reserved)) == 0 &&
+        fsync(fd) == 0;
+
+    close(fd);
+
+    if (!is_written)
+    {
+        log_message(MSG_WARNING, "Failed to write snapshot file \'%s\'", path);
+        return STK_BAD_FILE;
+    }
+
+    return STK_NO_ERROR;
+}
+
+template <typename T, typename Policy>
+void StackFillFileHeader_(const TypedStack<T, Policy>* stack,
+                          size_t reserved,
+                          stack_file_header* header)
+{
+    *header = {
+        .magic          = STK_FILE_MAGIC,
+        .version        = STK_FILE_VERSION,
+        .protection     = (Policy::has_canary ? STK_CANARY_PROT : 0) |
+                          (Policy::has_hash   ? STK_HASH_PROT   : 0),
+        .hash_backend   = {},
+        .element_size   = sizeof(T),
+        .data_offset    = GetPageSize(),
+        .reserved       = reserved,
+        .size           = stack->size,
+        .capacity       = stack->capacity,
+        .data_hash      = 0,
+        .canary         = CANARY,
+        .hash           = 0
+    };
+
+    strncpy(header->hash_backend, GetHashBackend()->name, sizeof(header->hash_backend) - 1);
+
+    if constexpr (Policy::has_hash)
+        header->data_hash = stack->data_hash_;
+
+    header->hash = GetFileHeaderHash_(header);
+}
+
+template <typename T, typename Policy>
+unsigned int StackReadFileHeader_(int fd, size_t max_capacity,
+                                  stack_file_header* header, int* is_new)
+{
+    const size_t canary_size = Policy::has_canary ? sizeof(canary_t) : 0;
+    const size_t page_size   = GetPageSize();
+
+    struct stat file_stat = {};
+    if (fstat(fd, &file_stat) != 0)
+        return STK_BAD_FILE;
+
+    *is_new = file_stat.st_size == 0;
+
+    size_t reserved = 0;
+    if (max_capacity > 0 &&
+        max_capacity <= (SIZE_MAX - 2*canary_size - 2*page_size) / sizeof(T))
+    {
+        reserved = max_capacity*sizeof(T) + 2*canary_size;
+        reserved = (reserved + page_size - 1) / page_size * page_size;
+    }
+
+    if (*is_new)
+    {
+        if (reserved == 0)
+            return STK_CORRUPTED_CAP;
+
+        *header = {};
+        header->data_offset = page_size;
+        header->reserved    = reserved;
+
+        if (ftruncate(fd, (off_t)(page_size + reserved)) != 0)
+            return STK_BAD_FILE;
+
+        return STK_NO_ERROR;
+    }
+
+    if (pread(fd, header, sizeof(*header), 0) != (ssize_t)sizeof(*header))
+        return STK_BAD_FILE;
+
+    if (header->magic != STK_FILE_MAGIC || header->version != STK_FILE_VERSION)
+        return STK_BAD_FILE;
+
+    if (strncmp(header->hash_backend, GetHashBackend()->name,
+                sizeof(header->hash_backend)) != 0)
+    {
+        log_message(MSG_WARNING, "Stack file was hashed with \'%.*s\' backend, "
+                                 "select it with `SetHashBackend`",
+                                 (int)sizeof(header->hash_backend), header->hash_backend);
+        return STK_BAD_FILE;
+    }
+
+    unsigned int flags = STK_NO_ERROR;
+
+    flags |= GetErrorFlag(header->hash   != GetFileHeaderHash_(header), STK_WRONG_HASH);
+    flags |= GetErrorFlag(header->canary != CANARY,                     STK_DEAD_CANARY);
+
+    unsigned int protection = (Policy::has_canary ? STK_CANARY_PROT : 0) |
+                              (Policy::has_hash   ? STK_HASH_PROT   : 0);
+
+    flags |= GetErrorFlag(header->protection   != protection,           STK_BAD_FILE);
+    flags |= GetErrorFlag(header->element_size != sizeof(T),            STK_BAD_FILE);
+    flags |= GetErrorFlag(header->data_offset  != page_size,            STK_BAD_FILE);
+    flags |= GetErrorFlag(header->reserved % page_size != 0 ||
+                          header->reserved < 2*canary_size + sizeof(T), STK_CORRUPTED_CAP);
+    if (flags)
+        return flags;
+
+    flags |= GetErrorFlag((unsigned long long)file_stat.st_size !=
+                          (unsigned long long)(page_size + header->reserved),
+                                                                        STK_BAD_FILE);
+    flags |= GetErrorFlag(header->capacity == 0 ||
+                          header->capacity > (header->reserved - 2*canary_size) / sizeof(T),
+                                                                        STK_CORRUPTED_CAP);
+    flags |= GetErrorFlag(header->size > header->capacity,              STK_CORRUPTED_SIZE);
+    if (flags)
+        return flags;
+
+    /* Existing stack may be given more room, but never less */
+    if (reserved > header->reserved)
+    {
+        if (ftruncate(fd, (off_t)(page_size + reserved)) != 0)
+            return STK_BAD_FILE;
+        header->reserved = reserved;
+    }
+
+    return flags;
+}
+
+/**
+ * @brief 
+ * Explicitly instantiate, or declare with `extern`, out-of-line
+ * stack functions for stored type `T` and protection policy `Policy`
+ */
+#define STK_STACK_FUNCTIONS_(prefix, T, Policy)                                 \
+    prefix template int StackCtor_(TypedStack<T, Policy>*,                      \
+                                   const char*, const char*, const char*,       \
+                                   size_t, const growth_policy*, size_t);       \
+    prefix template unsigned int StackOpen_(TypedStack<T, Policy>*,             \
+                                   const char*, size_t,                         \
+                                   const char*, const char*, const char*,       \
+                                   size_t, const growth_policy*);               \
+    prefix template void StackDtor(TypedStack<T, Policy>*);                     \
+    prefix template unsigned int StackSync(TypedStack<T, Policy>*);             \
+    prefix template unsigned int StackSnapshot(const TypedStack<T, Policy>*,    \
+                                   const char*);                                \
+    prefix template unsigned int StackCheck(const TypedStack<T, Policy>*);      \
+    prefix template unsigned int StackScheduledCheck_(                          \
+                                   const TypedStack<T, Policy>*);               \
+    prefix template unsigned int StackReport_(const TypedStack<T, Policy>*,     \
+                                   unsigned int,                                \
+                                   const char*, const char*, size_t);           \
+    prefix template unsigned int StackDumpBinary_(const TypedStack<T, Policy>*, \
+                                   const char*,                                 \
+                                   const char*, const char*, size_t);           \
+    prefix template int StackResize_(TypedStack<T, Policy>*, size_t);           \
+    prefix template unsigned int StackReserve(TypedStack<T, Policy>*, size_t);  \
+    prefix template unsigned int StackShrinkToFit(TypedStack<T, Policy>*);      \
+    prefix template unsigned int StackMove(TypedStack<T, Policy>*,              \
+                                   TypedStack<T, Policy>*);                     \
+    prefix template unsigned int StackSwap(TypedStack<T, Policy>*,              \
+                                   TypedStack<T, Policy>*);                     \
+    prefix template unsigned int StackSteal(TypedStack<T, Policy>*,             \
+                                   TypedStack<T, Policy>*);
+
+/**
+ * @brief 
+ * Declare out-of-line stack functions, which are
+ * instantiated in another translation unit
+ */
+#define STK_EXTERN_STACK(T, Policy)         STK_STACK_FUNCTIONS_(extern, T, Policy)
+
+/**
+ * @brief 
+ * Instantiate out-of-line stack functions
+ */
+#define STK_INSTANTIATE_STACK(T, Policy)    STK_STACK_FUNCTIONS_(, T, Policy)
+
+/**
+ * @brief 
+ * Apply `macro` to stacks of `T` of every protection
+ * level, which can be selected at runtime
+ */
+#define STK_FOR_PROTECTION_LEVELS_(macro, T)                                    \
+    macro(T, StackProtection<0>)                                                \
+    macro(T, StackProtection<1>)                                                \
+    macro(T, StackProtection<2>)                                                \
+    macro(T, StackProtection<3>)                                                \
+    macro(T, StackProtection<4>)                                                \
+    macro(T, StackProtection<5>)                                                \
+    macro(T, StackProtection<6>)                                                \
+    macro(T, StackProtection<7>)
+
+/**
+ * @brief 
+ * Apply `macro` to stacks compiled into `libstack`: stacks of
+ * `void*` and stacks of element types of `SafeStack`
+ */
+#define STK_FOR_LIBRARY_STACKS_(macro)                                          \
+    STK_FOR_PROTECTION_LEVELS_(macro, void*)                                    \
+    STK_FOR_PROTECTION_LEVELS_(macro, int8_t)                                   \
+    STK_FOR_PROTECTION_LEVELS_(macro, int16_t)                                  \
+    STK_FOR_PROTECTION_LEVELS_(macro, int32_t)                                  \
+    STK_FOR_PROTECTION_LEVELS_(macro, int64_t)                                  \
+    STK_FOR_PROTECTION_LEVELS_(macro, float)                                    \
+    STK_FOR_PROTECTION_LEVELS_(macro, double)
+
+#ifndef STK_HEADER_ONLY
+STK_FOR_LIBRARY_STACKS_(STK_EXTERN_STACK)
+#endif
+
 #endif
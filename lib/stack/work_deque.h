@@ -0,0 +1,358 @@
+#ifndef WORK_DEQUE_IMPL
+#define WORK_DEQUE_IMPL
+
+/**
+ * @file work_deque.h
+ * @author MeerkatBoss
+ * @brief Work-stealing deque
+ * @version 0.1
+ * @date 2022-10-07
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ * @warning This header DOES NOT support separate compilation
+ */
+
+#include "_work_deque_interface.h"
+#include "stack.h"
+
+/**
+ * @brief 
+ * Get capacity of deque buffer
+ * @param[in] buffer buffer index
+ * @return Buffer capacity, power of two
+ */
+inline size_t WorkDequeCapacity_(unsigned int buffer)
+{
+    return WDQ_MIN_CAPACITY << buffer;
+}
+
+/**
+ * @brief 
+ * Read deque slot. Slot may be written by owner concurrently,
+ * in which case read value is discarded by caller
+ */
+template <typename T>
+T WorkDequeLoad_(const T* slot)
+{
+    static_assert(__atomic_always_lock_free(sizeof(T), 0),
+                  "Deque elements must be copied atomically");
+
+    T result;
+    __atomic_load(slot, &result, __ATOMIC_RELAXED);
+    return result;
+}
+
+/**
+ * @brief 
+ * Write deque slot
+ */
+template <typename T>
+void WorkDequeStore_(T* slot, const T& value)
+{
+    __atomic_store(slot, &value, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief 
+ * Move elements to buffer twice as big. Old buffer is
+ * kept, as thieves may still read from it
+ * @param[inout] deque `WorkDeque` instance
+ * @param[in] top     first element index
+ * @param[in] bottom  index after last element
+ * @return zero upon success, non-zero otherwise
+ */
+template <typename T, typename Policy>
+int WorkDequeGrow_          (WorkDeque<T, Policy>* deque, long long top, long long bottom);
+
+/**
+ * @brief 
+ * Poison slots of elements stolen since last call.
+ * Owner thread only
+ * @param[inout] deque `WorkDeque` instance
+ * @param[in] top      first element index
+ */
+template <typename T, typename Policy>
+void WorkDequePoisonStolen_ (WorkDeque<T, Policy>* deque, long long top);
+
+template <typename T, typename Policy>
+int WorkDequeCtor_(WorkDeque<T, Policy>* deque,
+                   [[maybe_unused]] const char* name,
+                   [[maybe_unused]] const char* func_name,
+                   [[maybe_unused]] const char* file_name,
+                   [[maybe_unused]] size_t line_num)
+{
+    *deque = {};
+
+    T* data = ReallocWithCanary_<Policy>((T*)NULL, 0, WorkDequeCapacity_(0));
+    if (!data)
+        return -1;
+
+    deque->buffers_[0] = data;
+
+    if constexpr (Policy::has_canary)
+    {
+        canary_t canary = CANARY ^ (canary_t)deque;
+        deque->canary_start_ = canary;
+        deque->canary_end_   = canary;
+    }
+
+    if constexpr (Policy::has_debug_info)
+        deque->debug_ = {
+            .name       = name,
+            .func_name  = func_name,
+            .file_name  = file_name,
+            .line_num   = line_num
+        };
+
+    log_message(MSG_TRACE, "Constructed work deque at %p", deque);
+    return 0;
+}
+
+template <typename T, typename Policy>
+void WorkDequeDtor(WorkDeque<T, Policy>* deque)
+{
+    unsigned int errs = WorkDequeCheck(deque);
+    if (errs)
+    {
+        log_message(MSG_ERROR, "Work deque[%p] is CORRUPTED (error flags: %o)\n",
+                               deque, errs);
+        return;
+    }
+
+    for (unsigned int i = 0; i <= deque->current_; i++)
+        FreeWithCanary_<Policy>(deque->buffers_[i], WorkDequeCapacity_(i));
+
+    *deque = {};
+    log_message(MSG_TRACE, "Destroyed work deque at %p", deque);
+}
+
+template <typename T, typename Policy>
+unsigned int WorkDequePush(WorkDeque<T, Policy>* deque, std::type_identity_t<T> value)
+{
+    /* Poison marks free and stolen slots */
+    if (ElementTraits<T>::IsPoison(value))
+    {
+        log_message(MSG_WARNING, "Attempt to push poison value to work deque %p spotted.",
+                                 deque);
+        return STK_POISON_VALUE;
+    }
+
+    long long bottom = deque->bottom_;
+    long long top    = __atomic_load_n(&deque->top_, __ATOMIC_ACQUIRE);
+
+    WorkDequePoisonStolen_(deque, top);
+
+    size_t capacity = WorkDequeCapacity_(deque->current_);
+    if ((size_t)(bottom - top) >= capacity)
+    {
+        if (WorkDequeGrow_(deque, top, bottom) != 0)
+        {
+            log_message(MSG_WARNING, "Failed to push to work deque %p. "
+                                     "Not enough memory", deque);
+            return STK_NO_MEMORY;
+        }
+        capacity = WorkDequeCapacity_(deque->current_);
+    }
+
+    T* slot = deque->buffers_[deque->current_] + ((size_t)bottom & (capacity - 1));
+
+    if (!ElementTraits<T>::IsPoison(*slot))
+    {
+        log_message(MSG_ERROR, "Work deque[%p] has CORRUPTED free slot %p\n", deque, slot);
+        return STK_CORRUPTED_DATA;
+    }
+
+    WorkDequeStore_(slot, value);
+
+    /* Element must be visible to thieves before new bottom */
+    __atomic_store_n(&deque->bottom_, bottom + 1, __ATOMIC_RELEASE);
+
+    return STK_NO_ERROR;
+}
+
+template <typename T, typename Policy>
+T WorkDequePop(WorkDeque<T, Policy>* deque, unsigned int* err)
+{
+    long long bottom = deque->bottom_ - 1;
+    __atomic_store_n(&deque->bottom_, bottom, __ATOMIC_RELAXED);
+
+    /* Thieves must see decreased bottom before top is read */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    long long top = __atomic_load_n(&deque->top_, __ATOMIC_RELAXED);
+
+    if (top > bottom)
+    {
+        __atomic_store_n(&deque->bottom_, bottom + 1, __ATOMIC_RELAXED);
+        TRY_ASSIGN_PTR(err, STK_EMPTY);
+        return ElementTraits<T>::poison;
+    }
+
+    size_t capacity = WorkDequeCapacity_(deque->current_);
+    T*     slot     = deque->buffers_[deque->current_] + ((size_t)bottom & (capacity - 1));
+    T      result   = *slot;
+
+    if (top == bottom)
+    {
+        /* Last element, race with thieves for it */
+        int won = __atomic_compare_exchange_n(&deque->top_, &top, top + 1, 0,
+                                              __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+        __atomic_store_n(&deque->bottom_, bottom + 1, __ATOMIC_RELAXED);
+
+        if (!won)
+        {
+            TRY_ASSIGN_PTR(err, STK_EMPTY);
+            return ElementTraits<T>::poison;
+        }
+    }
+
+    WorkDequeStore_(slot, ElementTraits<T>::poison);
+
+    if (ElementTraits<T>::IsPoison(result))
+    {
+        log_message(MSG_ERROR, "Work deque[%p] has POISONED element %p\n", deque, slot);
+        TRY_ASSIGN_PTR(err, STK_CORRUPTED_DATA);
+        return result;
+    }
+
+    TRY_ASSIGN_PTR(err, STK_NO_ERROR);
+    return result;
+}
+
+template <typename T, typename Policy>
+T WorkDequeSteal(WorkDeque<T, Policy>* deque, unsigned int* err)
+{
+    for (;;)
+    {
+        long long top = __atomic_load_n(&deque->top_, __ATOMIC_ACQUIRE);
+
+        /* Top must be read before bottom, see `WorkDequePop` */
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+        long long bottom = __atomic_load_n(&deque->bottom_, __ATOMIC_ACQUIRE);
+
+        if (top >= bottom)
+        {
+            TRY_ASSIGN_PTR(err, STK_EMPTY);
+            return ElementTraits<T>::poison;
+        }
+
+        unsigned int buffer = __atomic_load_n(&deque->current_, __ATOMIC_ACQUIRE);
+        const T* data = __atomic_load_n(&deque->buffers_[buffer], __ATOMIC_RELAXED);
+
+        T result = WorkDequeLoad_(data + ((size_t)top & (WorkDequeCapacity_(buffer) - 1)));
+
+        if (!__atomic_compare_exchange_n(&deque->top_, &top, top + 1, 0,
+                                         __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+            continue;
+
+        if (ElementTraits<T>::IsPoison(result))
+        {
+            log_message(MSG_ERROR, "Work deque[%p] has POISONED element %lld\n",
+                                   deque, top);
+            TRY_ASSIGN_PTR(err, STK_CORRUPTED_DATA);
+            return result;
+        }
+
+        TRY_ASSIGN_PTR(err, STK_NO_ERROR);
+        return result;
+    }
+}
+
+template <typename T, typename Policy>
+unsigned int WorkDequeCheck(const WorkDeque<T, Policy>* deque)
+{
+    if (!CanReadRange(deque, sizeof(*deque)))
+        return STK_BAD_PTR;
+
+    unsigned int flags = STK_NO_ERROR;
+
+    if constexpr (Policy::has_canary)
+    {
+    canary_t canary = CANARY ^ (canary_t)deque;
+    flags |= GetErrorFlag(deque->canary_start_ != canary,       STK_DEAD_CANARY);
+    flags |= GetErrorFlag(deque->canary_end_   != canary,       STK_DEAD_CANARY);
+    }
+
+    if (deque->current_ >= WDQ_MAX_BUFFERS)
+        return flags | STK_CORRUPTED_CAP;
+
+    long long top    = __atomic_load_n(&deque->top_, __ATOMIC_ACQUIRE);
+    long long bottom = deque->bottom_;
+    size_t capacity  = WorkDequeCapacity_(deque->current_);
+    const T* data    = deque->buffers_[deque->current_];
+
+    flags |= GetErrorFlag(bottom < deque->poisoned_top_,        STK_CORRUPTED_SIZE);
+    flags |= GetErrorFlag((size_t)(bottom - deque->poisoned_top_) > capacity,
+                                                                STK_CORRUPTED_SIZE);
+    if (flags)
+        return flags;
+
+    const size_t canary_size = Policy::has_canary ? sizeof(canary_t) : 0;
+    if (!CanReadRange((const char*)data - canary_size, capacity*sizeof(T) + 2*canary_size))
+        return flags | STK_BAD_DATA_PTR;
+
+    if constexpr (Policy::has_canary)
+    {
+    canary_t* start = ((canary_t*) data) - 1;
+    canary_t* end   =  (canary_t*)(data + capacity);
+
+    flags |= GetErrorFlag(CANARY != *start || CANARY != *end, STK_CORRUPTED_DATA);
+    }
+
+    /* Elements may be stolen meanwhile, but their slots
+       keep values until owner poisons them */
+    for (long long i = top < bottom ? top : bottom; i < bottom; i++)
+        if (ElementTraits<T>::IsPoison(WorkDequeLoad_(data + ((size_t)i & (capacity - 1)))))
+            return flags | STK_CORRUPTED_DATA;
+
+    /* Slots of stolen elements, which are not poisoned yet, are skipped */
+    for (long long i = bottom; i < deque->poisoned_top_ + (long long)capacity; i++)
+        if (!ElementTraits<T>::IsPoison(data[(size_t)i & (capacity - 1)]))
+            return flags | STK_CORRUPTED_DATA;
+
+    return flags;
+}
+
+template <typename T, typename Policy>
+int WorkDequeGrow_(WorkDeque<T, Policy>* deque, long long top, long long bottom)
+{
+    unsigned int old_buffer = deque->current_;
+    if (old_buffer + 1 >= WDQ_MAX_BUFFERS)
+        return -1;
+
+    size_t old_capacity = WorkDequeCapacity_(old_buffer);
+    size_t new_capacity = WorkDequeCapacity_(old_buffer + 1);
+
+    T* new_data = ReallocWithCanary_<Policy>((T*)NULL, 0, new_capacity);
+    if (!new_data)
+        return -1;
+
+    const T* old_data = deque->buffers_[old_buffer];
+    for (long long i = top; i < bottom; i++)
+        new_data[(size_t)i & (new_capacity - 1)] = old_data[(size_t)i & (old_capacity - 1)];
+
+    /* Stolen slots below `top` are poisoned in new buffer already */
+    deque->poisoned_top_ = top;
+
+    __atomic_store_n(&deque->buffers_[old_buffer + 1], new_data, __ATOMIC_RELAXED);
+    __atomic_store_n(&deque->current_, old_buffer + 1, __ATOMIC_RELEASE);
+
+    return 0;
+}
+
+template <typename T, typename Policy>
+void WorkDequePoisonStolen_(WorkDeque<T, Policy>* deque, long long top)
+{
+    size_t capacity = WorkDequeCapacity_(deque->current_);
+    T*     data     = deque->buffers_[deque->current_];
+
+    for (long long i = deque->poisoned_top_; i < top; i++)
+        WorkDequeStore_(data + ((size_t)i & (capacity - 1)), ElementTraits<T>::poison);
+
+    if (deque->poisoned_top_ < top)
+        deque->poisoned_top_ = top;
+}
+
+#endif
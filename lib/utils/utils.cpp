@@ -3,10 +3,38 @@
 #include <errno.h>
 #include <signal.h>
 #include <setjmp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef __x86_64__
+#include <immintrin.h>
+#define UTILS_X86_KERNELS
+#endif
 
 #include "utils.h"
 
-hash_t GetHash(const void* data, size_t length)
+/**
+ * @brief
+ * splitmix64 finalizer
+ */
+static inline hash_t MixHash_(hash_t value)
+{
+    value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    value = (value ^ (value >> 27)) * 0x94D049BB133111EBULL;
+    return value ^ (value >> 31);
+}
+
+static inline hash_t LoadWord_(const unsigned char* bytes)
+{
+    hash_t word = 0;
+    memcpy(&word, bytes, sizeof(word));
+    return word;
+}
+
+static hash_t HashBytewise_(const void* data, size_t length)
 {
     static const hash_t base = 269; /* prime number near 256 */
     static const hash_t add  = 31;  /* small prime number */
@@ -15,10 +43,383 @@ hash_t GetHash(const void* data, size_t length)
     const unsigned char* bytes = (const unsigned char*)data;
     for (size_t i = 0; i < length; i++)
         result = (result * base) + bytes[i] + add;
-    
+
     return result;
 }
 
+static hash_t HashWords_(const void* data, size_t length)
+{
+    static const hash_t mult = 0x9FB21C651E98DF25ULL;
+
+    const unsigned char* bytes = (const unsigned char*)data;
+    hash_t result = length * 0x9E3779B97F4A7C15ULL;
+
+    size_t i = 0;
+    for (; i + sizeof(hash_t) <= length; i += sizeof(hash_t))
+    {
+        result = (result ^ LoadWord_(bytes + i)) * mult;
+        result ^= result >> 29;
+    }
+
+    if (i < length)
+    {
+        hash_t tail = 0;
+        memcpy(&tail, bytes + i, length - i);
+        result = (result ^ tail) * mult;
+        result ^= result >> 29;
+    }
+
+    return MixHash_(result);
+}
+
+#ifdef UTILS_X86_KERNELS
+
+/**
+ * @brief
+ * Vector hash is used only for inputs of at least this size,
+ * shorter ones are hashed word-at-a-time
+ */
+static const size_t HASH_VECTOR_MIN_LENGTH = 256;
+
+__attribute__((target("avx2")))
+static hash_t HashAvx2_(const void* data, size_t length)
+{
+    if (length < HASH_VECTOR_MIN_LENGTH)
+        return HashWords_(data, length);
+
+    const unsigned char* bytes = (const unsigned char*)data;
+
+    /* Keys change after every stripe, so that equal stripes
+       at different positions contribute differently */
+    __m256i key0 = _mm256_set_epi64x(0x1CAD21F72C81017CLL, 0x3F349CE33F76FAA8LL,
+                                     0x7C01812CF721AD1CLL, 0x5E2A3F1B9C6D8E47LL);
+    __m256i key1 = _mm256_set_epi64x(0x2B7E151628AED2A6LL, 0x243F6A8885A308D3LL,
+                                     0x13198A2E03707344LL, 0x452821E638D01377LL);
+    const __m256i step = _mm256_set1_epi64x((long long)0x9E3779B97F4A7C15ULL);
+
+    __m256i acc0 = _mm256_set1_epi64x((long long)length);
+    __m256i acc1 = _mm256_setzero_si256();
+
+    size_t i = 0;
+    for (; i + 2*sizeof(__m256i) <= length; i += 2*sizeof(__m256i))
+    {
+        __m256i chunk0 = _mm256_loadu_si256((const __m256i*)(bytes + i));
+        __m256i chunk1 = _mm256_loadu_si256((const __m256i*)(bytes + i + sizeof(__m256i)));
+
+        __m256i keyed0 = _mm256_xor_si256(chunk0, key0);
+        __m256i keyed1 = _mm256_xor_si256(chunk1, key1);
+
+        /* Multiply low and high halves of each keyed word */
+        acc0 = _mm256_add_epi64(acc0, _mm256_mul_epu32(keyed0, _mm256_srli_epi64(keyed0, 32)));
+        acc1 = _mm256_add_epi64(acc1, _mm256_mul_epu32(keyed1, _mm256_srli_epi64(keyed1, 32)));
+
+        /* Add data itself, so that zero products do not lose it */
+        acc0 = _mm256_add_epi64(acc0, _mm256_shuffle_epi32(chunk0, _MM_SHUFFLE(1, 0, 3, 2)));
+        acc1 = _mm256_add_epi64(acc1, _mm256_shuffle_epi32(chunk1, _MM_SHUFFLE(1, 0, 3, 2)));
+
+        key0 = _mm256_add_epi64(key0, step);
+        key1 = _mm256_add_epi64(key1, step);
+    }
+
+    hash_t lanes[2*sizeof(__m256i) / sizeof(hash_t)] = {};
+    _mm256_storeu_si256((__m256i*) lanes,      acc0);
+    _mm256_storeu_si256((__m256i*)(lanes + 4), acc1);
+
+    /* Lanes are weighted independently, so that they are folded in parallel */
+    hash_t result = HashWords_(bytes + i, length - i);
+    for (size_t lane = 0; lane < sizeof(lanes) / sizeof(*lanes); lane++)
+        result += MixHash_(lanes[lane]) * (2*lane + 1);
+
+    return MixHash_(result);
+}
+
+__attribute__((target("sse4.2")))
+static hash_t HashCrc32c_(const void* data, size_t length)
+{
+    const unsigned char* bytes = (const unsigned char*)data;
+
+    /* Three independent streams hide latency of crc32 instruction */
+    unsigned long long crc0 = 0xFFFFFFFF;
+    unsigned long long crc1 = 0x2F2F2F2F;
+    unsigned long long crc2 = 0x5A5A5A5A;
+
+    size_t i = 0;
+    for (; i + 3*sizeof(hash_t) <= length; i += 3*sizeof(hash_t))
+    {
+        crc0 = _mm_crc32_u64(crc0, LoadWord_(bytes + i));
+        crc1 = _mm_crc32_u64(crc1, LoadWord_(bytes + i + sizeof(hash_t)));
+        crc2 = _mm_crc32_u64(crc2, LoadWord_(bytes + i + 2*sizeof(hash_t)));
+    }
+
+    for (; i + sizeof(hash_t) <= length; i += sizeof(hash_t))
+        crc0 = _mm_crc32_u64(crc0, LoadWord_(bytes + i));
+
+    for (; i < length; i++)
+        crc0 = _mm_crc32_u8((unsigned int)crc0, bytes[i]);
+
+    return MixHash_((crc0 << 32 | crc1) ^ MixHash_(crc2 << 32 | length));
+}
+
+#endif
+
+static const hash_backend hash_backends_[] = {
+#ifdef UTILS_X86_KERNELS
+    { .name = "crc32c",   .hash = HashCrc32c_   },
+    { .name = "avx2",     .hash = HashAvx2_     },
+#endif
+    { .name = "word",     .hash = HashWords_    },
+    { .name = "bytewise", .hash = HashBytewise_ },
+};
+
+static const size_t hash_backend_count_ = sizeof(hash_backends_) / sizeof(*hash_backends_);
+
+static const hash_backend* current_hash_backend_ = NULL;
+
+static int IsHashBackendSupported_(const hash_backend* backend)
+{
+#ifdef UTILS_X86_KERNELS
+    if (backend->hash == HashAvx2_)
+        return __builtin_cpu_supports("avx2");
+    if (backend->hash == HashCrc32c_)
+        return __builtin_cpu_supports("sse4.2");
+#endif
+    (void) backend;
+    return 1;
+}
+
+/**
+ * @brief
+ * Select first backend supported by CPU. Backends are
+ * ordered by throughput on small inputs, such as stack headers
+ */
+static const hash_backend* SelectHashBackend_(void)
+{
+    const hash_backend* selected = NULL;
+    for (size_t i = 0; i < hash_backend_count_ && !selected; i++)
+        if (IsHashBackendSupported_(&hash_backends_[i]))
+            selected = &hash_backends_[i];
+
+    /* Backend may be already set by another thread */
+    const hash_backend* expected = NULL;
+    __atomic_compare_exchange_n(&current_hash_backend_, &expected, selected, 0,
+                                __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+    return expected ? expected : selected;
+}
+
+const hash_backend* GetHashBackend(void)
+{
+    const hash_backend* backend = __atomic_load_n(&current_hash_backend_, __ATOMIC_ACQUIRE);
+    return backend ? backend : SelectHashBackend_();
+}
+
+int SetHashBackend(const char* name)
+{
+    for (size_t i = 0; i < hash_backend_count_; i++)
+    {
+        if (strcmp(hash_backends_[i].name, name) != 0)
+            continue;
+
+        if (!IsHashBackendSupported_(&hash_backends_[i]))
+            return -1;
+
+        __atomic_store_n(&current_hash_backend_, &hash_backends_[i], __ATOMIC_RELEASE);
+        return 0;
+    }
+
+    return -1;
+}
+
+const hash_backend* GetHashBackends(size_t* count)
+{
+    *count = hash_backend_count_;
+    return hash_backends_;
+}
+
+hash_t GetHash(const void* data, size_t length)
+{
+    return GetHashBackend()->hash(data, length);
+}
+
+/**
+ * @brief
+ * Combine hash of slot contents with slot position
+ */
+static inline hash_t GetSlotHash_(hash_t data_hash, size_t index)
+{
+    static const hash_t index_mult = 0x9E3779B97F4A7C15ULL; /* 2^64 / phi */
+
+    /* splitmix64 finalizer, so that neighbouring slots do not cancel out */
+    return MixHash_(data_hash ^ (index * index_mult));
+}
+
+hash_t GetSlotHash(const void* data, size_t length, size_t index)
+{
+    return GetSlotHash_(GetHash(data, length), index);
+}
+
+hash_t GetSlotsHash(const void* data, size_t count, size_t length, size_t first_index)
+{
+    hash_t (*hash)(const void*, size_t) = GetHashBackend()->hash;
+
+    const unsigned char* bytes = (const unsigned char*)data;
+    hash_t result = 0;
+    for (size_t i = 0; i < count; i++)
+        result += GetSlotHash_(hash(bytes + i*length, length), first_index + i);
+
+    return result;
+}
+
+/**
+ * @brief
+ * Reduce byte equality mask to per-element equality mask:
+ * bit `k*size` is set iff all bytes of element `k` are equal
+ * @param[in] mask      Byte equality mask
+ * @param[in] size      Element size, power of two
+ * @param[in] lane_mask Mask with bits set at multiples of `size`
+ * @return Element equality mask
+ */
+static inline unsigned int ReduceEqualMask_(unsigned int mask, size_t size,
+                                            unsigned int lane_mask)
+{
+    for (size_t shift = 1; shift < size; shift <<= 1)
+        mask &= mask >> shift;
+    return mask & lane_mask;
+}
+
+static unsigned int GetLaneMask_(size_t size, size_t width)
+{
+    unsigned int lane_mask = 0;
+    for (size_t i = 0; i < width; i += size)
+        lane_mask |= 1u << i;
+    return lane_mask;
+}
+
+static size_t FindPatternScalar_(const unsigned char* bytes, size_t start, size_t count,
+                                 const void* pattern, size_t size, int find_equal)
+{
+    for (size_t i = start; i < count; i++)
+        if ((memcmp(bytes + i*size, pattern, size) == 0) == !!find_equal)
+            return i;
+    return count;
+}
+
+#ifdef UTILS_X86_KERNELS
+
+static size_t FindPatternSse2_(const unsigned char* bytes, size_t count,
+                               const void* pattern, size_t size, int find_equal)
+{
+    const size_t width = sizeof(__m128i);
+    unsigned char wide_pattern[sizeof(__m128i)] = {};
+    for (size_t i = 0; i < width; i += size)
+        memcpy(wide_pattern + i, pattern, size);
+
+    const __m128i expected   = _mm_loadu_si128((const __m128i*)wide_pattern);
+    const unsigned int lanes = GetLaneMask_(size, width);
+    const size_t per_vector  = width / size;
+
+    size_t i = 0;
+    for (; i + per_vector <= count; i += per_vector)
+    {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)(bytes + i*size));
+        unsigned int equal = ReduceEqualMask_(
+                            (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, expected)),
+                            size, lanes);
+        unsigned int hits = find_equal ? equal : (~equal & lanes);
+        if (hits)
+            return i + (size_t)__builtin_ctz(hits) / size;
+    }
+
+    return FindPatternScalar_(bytes, i, count, pattern, size, find_equal);
+}
+
+__attribute__((target("avx2")))
+static size_t FindPatternAvx2_(const unsigned char* bytes, size_t count,
+                               const void* pattern, size_t size, int find_equal)
+{
+    const size_t width = sizeof(__m256i);
+    unsigned char wide_pattern[sizeof(__m256i)] = {};
+    for (size_t i = 0; i < width; i += size)
+        memcpy(wide_pattern + i, pattern, size);
+
+    const __m256i expected   = _mm256_loadu_si256((const __m256i*)wide_pattern);
+    const unsigned int lanes = GetLaneMask_(size, width);
+    const size_t per_vector  = width / size;
+
+    size_t i = 0;
+    for (; i + per_vector <= count; i += per_vector)
+    {
+        __m256i chunk = _mm256_loadu_si256((const __m256i*)(bytes + i*size));
+        unsigned int equal = ReduceEqualMask_(
+                            (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, expected)),
+                            size, lanes);
+        unsigned int hits = find_equal ? equal : (~equal & lanes);
+        if (hits)
+            return i + (size_t)__builtin_ctz(hits) / size;
+    }
+
+    return FindPatternScalar_(bytes, i, count, pattern, size, find_equal);
+}
+
+#endif
+
+static size_t FindPattern_(const void* data, size_t count,
+                           const void* pattern, size_t size, int find_equal)
+{
+    const unsigned char* bytes = (const unsigned char*)data;
+    int is_power_of_two = size != 0 && (size & (size - 1)) == 0;
+
+#ifdef UTILS_X86_KERNELS
+    static const int has_avx2 = __builtin_cpu_supports("avx2");
+
+    if (is_power_of_two && has_avx2 && size <= sizeof(__m256i))
+        return FindPatternAvx2_(bytes, count, pattern, size, find_equal);
+
+    if (is_power_of_two && size <= sizeof(__m128i))
+        return FindPatternSse2_(bytes, count, pattern, size, find_equal);
+#else
+    (void) is_power_of_two;
+#endif
+
+    return FindPatternScalar_(bytes, 0, count, pattern, size, find_equal);
+}
+
+size_t FindPattern(const void* data, size_t count, const void* pattern, size_t size)
+{
+    return FindPattern_(data, count, pattern, size, 1);
+}
+
+size_t FindNotPattern(const void* data, size_t count, const void* pattern, size_t size)
+{
+    return FindPattern_(data, count, pattern, size, 0);
+}
+
+void FillPattern(void* data, size_t count, const void* pattern, size_t size)
+{
+    if (count == 0)
+        return;
+
+    unsigned char* bytes = (unsigned char*)data;
+    size_t total  = count * size;
+    size_t filled = size;
+    memcpy(bytes, pattern, size);
+
+    /* Double filled prefix on each step */
+    while (filled < total)
+    {
+        size_t copied = filled < total - filled ? filled : total - filled;
+        memcpy(bytes + filled, bytes, copied);
+        filled += copied;
+    }
+}
+
+unsigned long long GetTimeNs(void)
+{
+    struct timespec now = {};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long)now.tv_sec * 1000000000ULL
+         + (unsigned long long)now.tv_nsec;
+}
+
 static jmp_buf jump_buffer = {};
 static volatile int is_bad_ptr;
 
@@ -29,24 +430,157 @@ static void segfault_handler(int sig)
     longjmp(jump_buffer, 1);
 }
 
+/**
+ * @brief
+ * Readable memory range [start, end)
+ */
+struct mem_range_
+{
+    uintptr_t start;
+    uintptr_t end;
+};
+
+/**
+ * @brief
+ * Sorted array of readable memory ranges
+ */
+struct range_cache_
+{
+    mem_range_*     ranges;
+    size_t          count;
+    size_t          capacity;
+    unsigned long   generation; /* value of `ranges_generation_` at load time */
+};
+
+/**
+ * @brief
+ * Range cache of thread, freed upon thread exit
+ */
+struct thread_range_cache_
+{
+    range_cache_    cache;
+
+    ~thread_range_cache_();
+};
+
+static unsigned long ranges_generation_ = 1;
+
+/* Destructors of other thread-local objects may check pointers after
+ * this cache is destroyed, then ranges are loaded for each check */
+static thread_local int                 thread_ranges_dead_ = 0;
+static thread_local thread_range_cache_ thread_ranges_      = {};
+
+thread_range_cache_::~thread_range_cache_()
+{
+    free(cache.ranges);
+    cache = {};
+    thread_ranges_dead_ = 1;
+}
+
+static int RangeCacheAppend_(range_cache_* cache, uintptr_t start, uintptr_t end)
+{
+    /* Merge adjacent mappings so that ranges spanning them are found */
+    if (cache->count > 0 && cache->ranges[cache->count - 1].end == start)
+    {
+        cache->ranges[cache->count - 1].end = end;
+        return 0;
+    }
+
+    if (cache->count == cache->capacity)
+    {
+        size_t new_capacity = cache->capacity ? 2*cache->capacity : 256;
+        mem_range_* new_ranges = (mem_range_*)realloc(cache->ranges,
+                                        new_capacity*sizeof(*new_ranges));
+        if (!new_ranges)
+            return -1;
+        cache->ranges   = new_ranges;
+        cache->capacity = new_capacity;
+    }
+
+    cache->ranges[cache->count++] = {.start = start, .end = end};
+    return 0;
+}
+
+static int RangeCacheLoad_(range_cache_* cache)
+{
+    cache->count      = 0;
+    cache->generation = __atomic_load_n(&ranges_generation_, __ATOMIC_ACQUIRE);
+
+    FILE* maps = fopen("/proc/self/maps", "r");
+    if (!maps)
+        return -1;
+
+    /* Only first permission character (read access) is needed */
+    unsigned long start = 0, end = 0;
+    char read_perm = 0;
+    int status = 0;
+    while (fscanf(maps, "%lx-%lx %c%*[^\n]", &start, &end, &read_perm) == 3)
+    {
+        if (read_perm == 'r' && RangeCacheAppend_(cache, start, end) != 0)
+        {
+            status = -1;
+            break;
+        }
+    }
+
+    fclose(maps);
+    return status;
+}
+
+static int RangeCacheFind_(const range_cache_* cache, uintptr_t start, uintptr_t end)
+{
+    /* Find last range starting at or before `start` */
+    size_t left = 0, right = cache->count;
+    while (left < right)
+    {
+        size_t mid = left + (right - left) / 2;
+        if (cache->ranges[mid].start <= start)
+            left = mid + 1;
+        else
+            right = mid;
+    }
+
+    return left > 0 && end <= cache->ranges[left - 1].end;
+}
+
 int CanReadPointer(const void *ptr)
+{
+    return CanReadRange(ptr, 1);
+}
+
+int CanReadRange(const void *ptr, size_t length)
 {
     if (!ptr)
         return 0;
-    
-    int fd = open("/dev/random", O_RDWR);
-    int res = write(fd, ptr, 1);
-    close(fd);
 
-    return res >= 0;
+    uintptr_t start = (uintptr_t)ptr;
+    uintptr_t end   = start + length;
+    if (end < start)
+        return 0;
 
-/*
-    if (setjmp(jump_buffer) == 0)
+    if (thread_ranges_dead_)
     {
-        signal(SIGSEGV, segfault_handler);
-        char c = *(const char*) ptr;
-        signal(SIGSEGV, SIG_DFL);
-        return 1;
+        range_cache_ temp = {};
+        int is_readable = RangeCacheLoad_(&temp) == 0 && RangeCacheFind_(&temp, start, end);
+        free(temp.ranges);
+        return is_readable;
     }
-    return 0;*/
+
+    range_cache_* cache = &thread_ranges_.cache;
+    int is_outdated = cache->generation !=
+                        __atomic_load_n(&ranges_generation_, __ATOMIC_ACQUIRE);
+
+    if (!is_outdated && RangeCacheFind_(cache, start, end))
+        return 1;
+
+    /* Either cache is outdated or range was mapped after last load */
+    if (RangeCacheLoad_(cache) != 0)
+        return 0;
+
+    return RangeCacheFind_(cache, start, end);
+}
+
+void InvalidateReadableRanges(void)
+{
+    __atomic_add_fetch(&ranges_generation_, 1, __ATOMIC_RELEASE);
 }
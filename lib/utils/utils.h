@@ -18,13 +18,120 @@ typedef unsigned long long hash_t;
 
 /**
  * @brief
- * Calculate hash value of data
+ * Hash function implementation
+ */
+struct hash_backend
+{
+    const char* name;
+    hash_t (*hash)(const void* data, size_t length);
+};
+
+/**
+ * @brief
+ * Get backend used by `GetHash`. Upon first call the fastest
+ * backend supported by CPU is selected: "crc32c" (SSE4.2),
+ * then "avx2", then portable word-at-a-time "word"
+ * @return Current backend
+ */
+const hash_backend* GetHashBackend(void);
+
+/**
+ * @brief
+ * Select backend used by `GetHash`
+ * @param[in] name Backend name
+ * @return zero upon success, non-zero if there is no such
+ * backend or it is not supported by CPU
+ *
+ * @warning Hashes calculated by different backends differ,
+ * so backend must not be changed while hashed data exists
+ */
+int SetHashBackend(const char* name);
+
+/**
+ * @brief
+ * Get all backends compiled in, including ones
+ * not supported by CPU
+ * @param[out] count Number of backends
+ * @return Array of backends
+ */
+const hash_backend* GetHashBackends(size_t* count);
+
+/**
+ * @brief
+ * Calculate hash value of data using current backend
  * @param[in] data   Memory area 
  * @param[in] length Memory area size
  * @return Calculated hash
  */
 hash_t GetHash(const void* data, size_t length);
 
+/**
+ * @brief
+ * Calculate position-dependent hash of a single array slot.
+ * Slot hashes are meant to be combined by addition, so that
+ * array hash can be updated in O(1) when one slot changes
+ * @param[in] data   Slot contents
+ * @param[in] length Slot size
+ * @param[in] index  Slot position in array
+ * @return Calculated hash
+ */
+hash_t GetSlotHash(const void* data, size_t length, size_t index);
+
+/**
+ * @brief
+ * Calculate sum of `GetSlotHash` over array slots
+ * @param[in] data        First slot contents
+ * @param[in] count       Number of slots
+ * @param[in] length      Slot size
+ * @param[in] first_index Position of first slot in array
+ * @return Calculated hash
+ */
+hash_t GetSlotsHash(const void* data, size_t count, size_t length, size_t first_index);
+
+/**
+ * @brief
+ * Find first array element bytewise equal to pattern.
+ * Uses SSE2/AVX2 compare kernels if element size is
+ * a power of two not exceeding vector width
+ * @param[in] data    Array start
+ * @param[in] count   Array length
+ * @param[in] pattern Searched element
+ * @param[in] size    Element size
+ * @return Index of first matching element, `count` if there is none
+ */
+size_t FindPattern(const void* data, size_t count, const void* pattern, size_t size);
+
+/**
+ * @brief
+ * Find first array element bytewise different from pattern.
+ * Uses SSE2/AVX2 compare kernels if element size is
+ * a power of two not exceeding vector width
+ * @param[in] data    Array start
+ * @param[in] count   Array length
+ * @param[in] pattern Expected element
+ * @param[in] size    Element size
+ * @return Index of first mismatching element, `count` if there is none
+ */
+size_t FindNotPattern(const void* data, size_t count, const void* pattern, size_t size);
+
+/**
+ * @brief
+ * Fill array with copies of pattern
+ * @param[out] data    Array start
+ * @param[in]  count   Array length
+ * @param[in]  pattern Filler element
+ * @param[in]  size    Element size
+ */
+void FillPattern(void* data, size_t count, const void* pattern, size_t size);
+
+/**
+ * @brief
+ * Get monotonic time. Does not perform system call
+ * on platforms with vDSO clock
+ * @return Time in nanoseconds
+ */
+unsigned long long GetTimeNs(void);
+
 /**
  * @brief 
  * Check if pointer is readable
@@ -33,4 +140,29 @@ hash_t GetHash(const void* data, size_t length);
  */
 int CanReadPointer(const void *ptr);
 
+/**
+ * @brief
+ * Check if memory range [ptr, ptr + length) is readable.
+ * Lookup is performed in per-thread cached map of readable
+ * process memory mappings. The map is reloaded only if range
+ * is not found in it or if it was invalidated, so that cache hit
+ * takes no system calls
+ * @warning Ranges unmapped or protected without a call to
+ * `InvalidateReadableRanges` (e.g. by other libraries) may still
+ * be reported as readable until the map is reloaded
+ * @param[in] ptr    Range start
+ * @param[in] length Range length
+ * @return 1 if whole range is readable, 0 otherwise
+ */
+int CanReadRange(const void *ptr, size_t length);
+
+/**
+ * @brief
+ * Mark cached memory maps of all threads as outdated.
+ * Should be called after memory is returned to system
+ * (e.g. after `munmap` or `free` of a large block), so that
+ * released ranges are no longer reported as readable
+ */
+void InvalidateReadableRanges(void);
+
 #endif
\ No newline at end of file
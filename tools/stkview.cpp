@@ -0,0 +1,521 @@
+/**
+ * @file stkview.cpp
+ * @author MeerkatBoss
+ * @brief Binary stack dump viewer
+ * @version 0.1
+ * @date 2022-10-09
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * @note Usage:
+ *      stkview [--html] [--slots] DUMP     render dump as text or HTML
+ *      stkview --diff DUMP1 DUMP2          show differences between dumps
+ *
+ * Slots with the same status are collapsed into ranges unless
+ * `--slots` is given, in which case every slot is printed with
+ * its raw contents
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "_stack_dump_format.h"
+
+/**
+ * @brief
+ * Loaded dump
+ */
+struct dump_file_
+{
+    unsigned char*              buffer;
+    size_t                      length;
+    const stack_dump_header*    header;
+    const unsigned char*        status;     /* slot statuses */
+    const unsigned char*        slots;      /* raw slot contents */
+};
+
+/**
+ * @brief
+ * Output format
+ */
+enum view_format_
+{
+    VIEW_TEXT,
+    VIEW_HTML
+};
+
+/**
+ * @brief
+ * Error flag names
+ */
+static const struct { unsigned int flag; const char* name; } error_names_[] = {
+    { STK_EMPTY,            "STK_EMPTY"             },
+    { STK_NO_MEMORY,        "STK_NO_MEMORY"         },
+    { STK_BAD_PTR,          "STK_BAD_PTR"           },
+    { STK_BAD_DATA_PTR,     "STK_BAD_DATA_PTR"      },
+    { STK_DEAD_CANARY,      "STK_DEAD_CANARY"       },
+    { STK_WRONG_HASH,       "STK_WRONG_HASH"        },
+    { STK_WRONG_DATA_HASH,  "STK_WRONG_DATA_HASH"   },
+    { STK_CORRUPTED_SIZE,   "STK_CORRUPTED_SIZE"    },
+    { STK_CORRUPTED_CAP,    "STK_CORRUPTED_CAP"     },
+    { STK_CORRUPTED_DATA,   "STK_CORRUPTED_DATA"    },
+    { STK_BAD_FILE,         "STK_BAD_FILE"          },
+    { STK_POISON_VALUE,     "STK_POISON_VALUE"      },
+};
+
+/**
+ * @brief
+ * Load and validate dump file
+ * @param[in]  path dump file
+ * @param[out] dump loaded dump
+ * @return zero upon success, non-zero otherwise
+ */
+static int  LoadDump_           (const char* path, dump_file_* dump);
+
+/**
+ * @brief
+ * Render dump in given format
+ */
+static void PrintDump_          (const dump_file_* dump, view_format_ format, int print_slots);
+
+/**
+ * @brief
+ * Print differences between two dumps
+ * @return zero if dumps are equal, 1 otherwise
+ */
+static int  PrintDiff_          (const dump_file_* first, const dump_file_* second);
+
+/**
+ * @brief
+ * Print string, escaping HTML special characters if needed
+ */
+static void PrintString_        (const char* str, view_format_ format);
+
+/**
+ * @brief
+ * Print error flags with their names
+ */
+static void PrintErrors_        (unsigned int errors);
+
+/**
+ * @brief
+ * Print raw slot contents in hex
+ */
+static void PrintSlotBytes_     (const dump_file_* dump, size_t index);
+
+/**
+ * @brief
+ * Check whether slot status is consistent with its position
+ */
+static int  IsSlotValid_        (unsigned char status);
+
+/**
+ * @brief
+ * Check whether slot differs between dumps
+ */
+static int  IsSlotDifferent_    (const dump_file_* first, const dump_file_* second, size_t index);
+
+static void PrintUsage_(const char* program)
+{
+    fprintf(stderr, "Usage: %s [--html] [--slots] DUMP\n"
+                    "       %s --diff DUMP1 DUMP2\n", program, program);
+}
+
+int main(int argc, char* argv[])
+{
+    view_format_ format      = VIEW_TEXT;
+    int          print_slots = 0;
+    int          is_diff     = 0;
+    const char*  paths[2]    = {};
+    int          path_count  = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if      (strcmp(argv[i], "--html")  == 0) format      = VIEW_HTML;
+        else if (strcmp(argv[i], "--slots") == 0) print_slots = 1;
+        else if (strcmp(argv[i], "--diff")  == 0) is_diff     = 1;
+        else if (path_count < 2)                  paths[path_count++] = argv[i];
+        else
+        {
+            PrintUsage_(argv[0]);
+            return 2;
+        }
+    }
+
+    if (path_count != (is_diff ? 2 : 1))
+    {
+        PrintUsage_(argv[0]);
+        return 2;
+    }
+
+    dump_file_ dumps[2] = {};
+    for (int i = 0; i < path_count; i++)
+        if (LoadDump_(paths[i], &dumps[i]) != 0)
+        {
+            for (int j = 0; j < i; j++)
+                free(dumps[j].buffer);
+            return 2;
+        }
+
+    int result = 0;
+    if (is_diff)
+        result = PrintDiff_(&dumps[0], &dumps[1]);
+    else
+        PrintDump_(&dumps[0], format, print_slots);
+
+    for (int i = 0; i < path_count; i++)
+        free(dumps[i].buffer);
+
+    return result;
+}
+
+static int LoadDump_(const char* path, dump_file_* dump)
+{
+    *dump = {};
+
+    FILE* input = fopen(path, "rb");
+    if (!input)
+    {
+        fprintf(stderr, "Cannot open '%s'\n", path);
+        return -1;
+    }
+
+    long length = 0;
+    if (fseek(input, 0, SEEK_END) != 0 || (length = ftell(input)) < 0 ||
+        fseek(input, 0, SEEK_SET) != 0)
+    {
+        fprintf(stderr, "Cannot read '%s'\n", path);
+        fclose(input);
+        return -1;
+    }
+
+    dump->length = (size_t)length;
+    dump->buffer = (unsigned char*)calloc(dump->length + 1, 1);
+
+    int is_read = dump->buffer &&
+                  fread(dump->buffer, 1, dump->length, input) == dump->length;
+    fclose(input);
+
+    if (!is_read)
+    {
+        fprintf(stderr, "Cannot read '%s'\n", path);
+        free(dump->buffer);
+        return -1;
+    }
+
+    const stack_dump_header* header = (const stack_dump_header*)dump->buffer;
+
+    /* Element size is bounded first, so that size arithmetic cannot overflow */
+    int is_valid = dump->length >= sizeof(stack_dump_header) &&
+                   header->magic   == STK_DUMP_MAGIC &&
+                   header->version == STK_DUMP_VERSION &&
+                   header->element_size > 0 &&
+                   header->element_size <= dump->length &&
+                   header->slot_count <= (dump->length - sizeof(stack_dump_header))
+                                            / (1 + header->element_size) &&
+                   dump->length == sizeof(stack_dump_header)
+                                    + header->slot_count*(1 + header->element_size);
+    if (!is_valid)
+    {
+        fprintf(stderr, "'%s' is not a valid stack dump\n", path);
+        free(dump->buffer);
+        return -1;
+    }
+
+    dump->header = header;
+    dump->status = dump->buffer + sizeof(stack_dump_header);
+    dump->slots  = dump->status + header->slot_count;
+
+    /* Strings may be not terminated in damaged dump */
+    stack_dump_header* writable = (stack_dump_header*)dump->buffer;
+    writable->name       [STK_DUMP_STRING_LENGTH - 1] = '\0';
+    writable->func_name  [STK_DUMP_STRING_LENGTH - 1] = '\0';
+    writable->file_name  [STK_DUMP_STRING_LENGTH - 1] = '\0';
+    writable->caller_func[STK_DUMP_STRING_LENGTH - 1] = '\0';
+    writable->caller_file[STK_DUMP_STRING_LENGTH - 1] = '\0';
+
+    return 0;
+}
+
+static void PrintDump_(const dump_file_* dump, view_format_ format, int print_slots)
+{
+    const stack_dump_header* header = dump->header;
+    int is_html = format == VIEW_HTML;
+
+    if (is_html)
+        printf("<!DOCTYPE html>\n<html><head><title>Stack dump</title><style>\n"
+               "td, th { padding: 0 8px; font-family: monospace; text-align: left; }\n"
+               ".bad { background: #f88; }\n"
+               ".stored { background: #dfd; }\n"
+               "</style></head><body>\n<pre>\n");
+
+    printf("Dump of stack[%#llx] (status: %s)\n"
+           "\tin ", header->stack_address, header->errors ? "CORRUPTED" : "ok");
+    PrintString_(header->caller_func, format);
+    printf(":%llu in file '", header->caller_line);
+    PrintString_(header->caller_file, format);
+    printf("'\n");
+
+    if (header->protection & STK_DEBUG_INFO)
+    {
+        printf("Stack '");
+        PrintString_(header->name, format);
+        printf("' declared in ");
+        PrintString_(header->func_name, format);
+        printf(" on line %llu, file '", header->line_num);
+        PrintString_(header->file_name, format);
+        printf("'\n");
+    }
+
+    PrintErrors_(header->errors);
+
+    printf("Elements stored: %llu\n"
+           "Total capacity : %llu\n"
+           "Element size   : %llu\n",
+           header->size, header->capacity, header->element_size);
+
+    if (header->reserved)
+        printf("Mapped range   : %llu bytes\n", header->reserved);
+
+    if (header->protection & STK_HASH_PROT)
+        printf("Hash:\n"
+               "\tstored: %#llx\n"
+               "\tactual: %#llx%s\n"
+               "Data hash:\n"
+               "\tstored: %#llx\n"
+               "\tactual: %#llx%s\n",
+               header->stored_hash, header->actual_hash,
+               header->stored_hash == header->actual_hash ? "" : " (MISMATCH)",
+               header->stored_data_hash, header->actual_data_hash,
+               header->stored_data_hash == header->actual_data_hash ? "" : " (MISMATCH)");
+
+    if (header->protection & STK_CANARY_PROT)
+    {
+        canary_t expected = CANARY ^ header->stack_address;
+        printf("Canary state:\n"
+               "\tstart: %#016llx%s\n"
+               "\tend  : %#016llx%s\n",
+               header->canary_start, header->canary_start == expected ? "" : " (DEAD)",
+               header->canary_end,   header->canary_end   == expected ? "" : " (DEAD)");
+    }
+
+    printf("Data[%#llx]:\n", header->data_address);
+    if (!header->is_data_readable)
+    {
+        printf("\tNOT READABLE\n");
+        if (is_html)
+            printf("</pre></body></html>\n");
+        return;
+    }
+
+    if (header->protection & STK_CANARY_PROT)
+        printf("\tcanary: %#016llx%s\n", header->data_canary_start,
+               header->data_canary_start == CANARY ? "" : " (DEAD)");
+
+    if (is_html)
+        printf("</pre>\n<table>\n<tr><th>Slots</th><th>Status</th>%s</tr>\n",
+               print_slots ? "<th>Contents</th>" : "");
+
+    size_t slot_count = (size_t)header->slot_count;
+    for (size_t start = 0; start < slot_count;)
+    {
+        size_t end = start + 1;
+        if (!print_slots)
+            while (end < slot_count && dump->status[end] == dump->status[start])
+                end++;
+
+        unsigned char status    = dump->status[start];
+        int           is_stored = (status & STK_SLOT_STORED) != 0;
+        const char*   name      = (status & STK_SLOT_POISON) ? "POISON" : "ok";
+
+        if (is_html)
+            printf("<tr class=\"%s\"><td>", !IsSlotValid_(status) ? "bad"
+                                                                   : is_stored ? "stored" : "");
+        else
+            printf("\t%c", is_stored ? '*' : ' ');
+
+        if (end - start == 1)
+            printf("[%zu]", start);
+        else
+            printf("[%zu..%zu]", start, end - 1);
+
+        if (is_html)
+            printf("</td><td>%s</td>", name);
+        else
+            printf(": %s", name);
+
+        if (print_slots)
+        {
+            printf(is_html ? "<td>" : "\t");
+            PrintSlotBytes_(dump, start);
+            printf(is_html ? "</td>" : "");
+        }
+
+        printf(is_html ? "</tr>\n" : "\n");
+        start = end;
+    }
+
+    if (is_html)
+        printf("</table>\n<pre>\n");
+
+    if (header->protection & STK_CANARY_PROT)
+        printf("\tcanary: %#016llx%s\n", header->data_canary_end,
+               header->data_canary_end == CANARY ? "" : " (DEAD)");
+
+    if (is_html)
+        printf("</pre></body></html>\n");
+}
+
+static int PrintDiff_(const dump_file_* first, const dump_file_* second)
+{
+    static const struct { const char* name; size_t offset; } fields[] = {
+        { "stack address",       offsetof(stack_dump_header, stack_address)     },
+        { "data address",        offsetof(stack_dump_header, data_address)      },
+        { "element size",        offsetof(stack_dump_header, element_size)      },
+        { "size",                offsetof(stack_dump_header, size)              },
+        { "capacity",            offsetof(stack_dump_header, capacity)          },
+        { "mapped range",        offsetof(stack_dump_header, reserved)          },
+        { "stored hash",         offsetof(stack_dump_header, stored_hash)       },
+        { "actual hash",         offsetof(stack_dump_header, actual_hash)       },
+        { "stored data hash",    offsetof(stack_dump_header, stored_data_hash)  },
+        { "actual data hash",    offsetof(stack_dump_header, actual_data_hash)  },
+        { "start canary",        offsetof(stack_dump_header, canary_start)      },
+        { "end canary",          offsetof(stack_dump_header, canary_end)        },
+        { "data start canary",   offsetof(stack_dump_header, data_canary_start) },
+        { "data end canary",     offsetof(stack_dump_header, data_canary_end)   },
+    };
+
+    int is_different = 0;
+
+    if (first->header->errors != second->header->errors)
+    {
+        printf("error flags: %o -> %o\n", first->header->errors, second->header->errors);
+        is_different = 1;
+    }
+
+    for (size_t i = 0; i < sizeof(fields) / sizeof(*fields); i++)
+    {
+        unsigned long long old_value = 0, new_value = 0;
+        memcpy(&old_value, (const char*)first->header  + fields[i].offset, sizeof(old_value));
+        memcpy(&new_value, (const char*)second->header + fields[i].offset, sizeof(new_value));
+
+        if (old_value != new_value)
+        {
+            printf("%s: %#llx -> %#llx\n", fields[i].name, old_value, new_value);
+            is_different = 1;
+        }
+    }
+
+    if (first->header->element_size != second->header->element_size)
+    {
+        printf("slots are not compared, element sizes differ\n");
+        return 1;
+    }
+
+    size_t slot_count = (size_t)(first->header->slot_count > second->header->slot_count
+                                    ? first->header->slot_count
+                                    : second->header->slot_count);
+
+    for (size_t start = 0; start < slot_count;)
+    {
+        if (!IsSlotDifferent_(first, second, start))
+        {
+            start++;
+            continue;
+        }
+
+        size_t end = start + 1;
+        while (end < slot_count && IsSlotDifferent_(first, second, end))
+            end++;
+
+        if (end - start == 1)
+            printf("slot [%zu] differs", start);
+        else
+            printf("slots [%zu..%zu] differ", start, end - 1);
+
+        if (end - start == 1 && start < first->header->slot_count
+                             && start < second->header->slot_count)
+        {
+            printf(": ");
+            PrintSlotBytes_(first, start);
+            printf(" -> ");
+            PrintSlotBytes_(second, start);
+        }
+        printf("\n");
+
+        is_different = 1;
+        start = end;
+    }
+
+    if (!is_different)
+        printf("dumps are identical\n");
+
+    return is_different;
+}
+
+static void PrintString_(const char* str, view_format_ format)
+{
+    if (format == VIEW_TEXT)
+    {
+        fputs(str, stdout);
+        return;
+    }
+
+    for (; *str; str++)
+    {
+        switch (*str)
+        {
+            case '<': fputs("&lt;",   stdout); break;
+            case '>': fputs("&gt;",   stdout); break;
+            case '&': fputs("&amp;",  stdout); break;
+            case '"': fputs("&quot;", stdout); break;
+            default:  putchar(*str);           break;
+        }
+    }
+}
+
+static void PrintErrors_(unsigned int errors)
+{
+    if (!errors)
+        return;
+
+    printf("Error flags: %o (", errors);
+
+    const char* separator = "";
+    for (size_t i = 0; i < sizeof(error_names_) / sizeof(*error_names_); i++)
+        if (errors & error_names_[i].flag)
+        {
+            printf("%s%s", separator, error_names_[i].name);
+            separator = " | ";
+        }
+
+    printf(")\n");
+}
+
+static void PrintSlotBytes_(const dump_file_* dump, size_t index)
+{
+    size_t element_size = (size_t)dump->header->element_size;
+    const unsigned char* slot = dump->slots + index*element_size;
+
+    for (size_t i = 0; i < element_size; i++)
+        printf("%02x", (unsigned int)slot[i]);
+}
+
+static int IsSlotValid_(unsigned char status)
+{
+    /* Stored slots must not be poisoned, free slots must be */
+    return ((status & STK_SLOT_STORED) != 0) != ((status & STK_SLOT_POISON) != 0);
+}
+
+static int IsSlotDifferent_(const dump_file_* first, const dump_file_* second, size_t index)
+{
+    if (index >= first->header->slot_count || index >= second->header->slot_count)
+        return 1;
+
+    size_t element_size = (size_t)first->header->element_size;
+
+    return first->status[index] != second->status[index] ||
+           memcmp(first->slots  + index*element_size,
+                  second->slots + index*element_size, element_size) != 0;
+}